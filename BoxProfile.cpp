@@ -0,0 +1,172 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "BoxProfile.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include <liblog++/Log.h>
+
+namespace fritz {
+
+static const char *ENDPOINT_NAMES[BoxProfile::ENDPOINTS_COUNT] = {
+	"locationSettingsLua", "sipSettingsLua", "callListLua", "fonbookXml"
+};
+
+BoxProfile::BoxProfile()
+: loginType{Config::UNKNOWN} {
+	for (size_t endpoint = 0; endpoint < ENDPOINTS_COUNT; endpoint++)
+		endpoints[endpoint] = UNKNOWN;
+}
+
+std::string BoxProfile::getFileName() const {
+	std::string name = dir + "/boxprofile-";
+	for (char c : boxId)
+		name += isalnum(c) ? c : '_';
+	return name + ".conf";
+}
+
+bool BoxProfile::load(const std::string &dir, const std::string &boxId, const std::string &firmware) {
+	std::lock_guard<std::mutex> lock(mutex);
+	this->dir      = dir;
+	this->boxId    = boxId;
+	this->firmware = firmware;
+	if (dir.empty())
+		return false;
+	std::ifstream file(getFileName().c_str());
+	if (!file.good())
+		return false;
+	std::string line;
+	std::string storedFirmware;
+	Config::eLoginType storedType = Config::UNKNOWN;
+	std::string storedLang;
+	eSupport stored[ENDPOINTS_COUNT] = {};
+	while (std::getline(file, line)) {
+		size_t equals = line.find('=');
+		if (line.empty() || line[0] == '#' || equals == std::string::npos)
+			continue;
+		std::string key = line.substr(0, equals);
+		std::string value = line.substr(equals + 1);
+		if (key == "firmware")
+			storedFirmware = value;
+		else if (key == "login")
+			storedType = static_cast<Config::eLoginType>(atoi(value.c_str()));
+		else if (key == "lang")
+			storedLang = value;
+		for (size_t endpoint = 0; endpoint < ENDPOINTS_COUNT; endpoint++)
+			if (key == ENDPOINT_NAMES[endpoint])
+				stored[endpoint] = static_cast<eSupport>(atoi(value.c_str()));
+	}
+	if (storedFirmware != firmware) {
+		INF("firmware of " << boxId << " changed to " << firmware << ", detecting capabilities again");
+		return false;
+	}
+	loginType = storedType;
+	lang = storedLang;
+	for (size_t endpoint = 0; endpoint < ENDPOINTS_COUNT; endpoint++)
+		endpoints[endpoint] = stored[endpoint];
+	DBG("loaded capability profile of " << boxId << " with firmware " << firmware);
+	return true;
+}
+
+bool BoxProfile::save() const {
+	if (dir.empty() || boxId.empty())
+		return false;
+	// write a new file and rename it, so that a crash leaves the old profile intact
+	std::string path = getFileName();
+	std::string tmpPath = path + ".tmp";
+	{
+		std::ofstream file(tmpPath.c_str());
+		file << "# capabilities of a Fritz!Box detected by libfritz++\n";
+		file << "box=" << boxId << "\n";
+		file << "firmware=" << firmware << "\n";
+		file << "login=" << loginType << "\n";
+		file << "lang=" << lang << "\n";
+		for (size_t endpoint = 0; endpoint < ENDPOINTS_COUNT; endpoint++)
+			file << ENDPOINT_NAMES[endpoint] << "=" << endpoints[endpoint] << "\n";
+		if (!file.good()) {
+			ERR("could not write " << tmpPath);
+			return false;
+		}
+	}
+	return rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+bool BoxProfile::ParseBoxInfo(const std::string &xml, std::string &boxId, std::string &firmware) {
+	auto element = [&xml](const std::string &name) {
+		size_t start = xml.find("<j:" + name + ">");
+		if (start == std::string::npos)
+			return std::string();
+		start += name.size() + 4;
+		size_t stop = xml.find('<', start);
+		return stop == std::string::npos ? std::string() : xml.substr(start, stop - start);
+	};
+	boxId = element("Serial");
+	firmware = element("Version");
+	std::string revision = element("Revision");
+	if (revision.size())
+		firmware += "-" + revision;
+	return boxId.size() && firmware.size();
+}
+
+BoxProfile::eSupport BoxProfile::getSupport(eEndpoint endpoint) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return endpoints[endpoint];
+}
+
+void BoxProfile::setSupport(eEndpoint endpoint, eSupport support) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (endpoints[endpoint] == support)
+		return;
+	endpoints[endpoint] = support;
+	save();
+}
+
+Config::eLoginType BoxProfile::getLoginType() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return loginType;
+}
+
+void BoxProfile::setLoginType(Config::eLoginType type) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (loginType == type)
+		return;
+	loginType = type;
+	save();
+}
+
+std::string BoxProfile::getLang() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return lang;
+}
+
+void BoxProfile::setLang(const std::string &lang) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (this->lang == lang)
+		return;
+	this->lang = lang;
+	save();
+}
+
+}
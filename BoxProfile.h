@@ -0,0 +1,91 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef BOXPROFILE_H
+#define BOXPROFILE_H
+
+#include <mutex>
+#include <string>
+
+#include "Config.h"
+
+namespace fritz {
+
+/**
+ * What a Fritz!Box firmware supports, as found out by FritzClient: the login type, the
+ * language of the web interface and which endpoints answer. Requests use the profile to
+ * go to the right endpoint directly, instead of trying the newer one first each time.
+ * The profile is stored in the config directory, one file per box. It is only used
+ * as long as the box runs the same firmware.
+ */
+class BoxProfile {
+public:
+	enum eEndpoint {
+		LOCATION_SETTINGS_LUA,   // /fon_num/sip_option.lua
+		SIP_SETTINGS_LUA,        // /fon_num/fon_num_list.lua
+		CALL_LIST_LUA,           // /fon_num/foncalls_list.lua?csv=
+		FONBOOK_XML,             // phone book export using /cgi-bin/firmwarecfg
+		ENDPOINTS_COUNT
+	};
+	enum eSupport {
+		UNKNOWN,
+		SUPPORTED,
+		UNSUPPORTED
+	};
+private:
+	mutable std::mutex mutex;
+	std::string dir;
+	std::string boxId;
+	std::string firmware;
+	Config::eLoginType loginType;
+	std::string lang;
+	eSupport endpoints[ENDPOINTS_COUNT];
+	std::string getFileName() const;
+	bool save() const;
+public:
+	BoxProfile();
+	/**
+	 * Sets the box this profile belongs to and loads a stored profile.
+	 * @param the directory the profile is stored in, empty to keep it in memory only
+	 * @param a unique identification of the box, e.g., its serial number
+	 * @param the firmware version
+	 * @return true, if a stored profile for this box and firmware was found
+	 */
+	bool load(const std::string &dir, const std::string &boxId, const std::string &firmware);
+	/**
+	 * Extracts identification and firmware version from /jason_boxinfo.xml.
+	 * @return false, if the data is not found
+	 */
+	static bool ParseBoxInfo(const std::string &xml, std::string &boxId, std::string &firmware);
+	eSupport getSupport(eEndpoint endpoint) const;
+	/**
+	 * The following methods store the profile if a value changes.
+	 */
+	void setSupport(eEndpoint endpoint, eSupport support);
+	Config::eLoginType getLoginType() const;
+	void setLoginType(Config::eLoginType type);
+	std::string getLang() const;
+	void setLang(const std::string &lang);
+};
+
+}
+
+#endif /* BOXPROFILE_H */
@@ -0,0 +1,513 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "CallArchive.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Tools.h"
+#include <liblog++/Log.h>
+
+namespace fritz {
+
+const size_t CallArchive::SIDE_INDEX_LIMIT;
+
+static std::string ArchivePath(const std::string &dir, const std::string &box, const char *extension) {
+	// the host may contain characters that are not allowed in file names, e.g., of IPv6 addresses
+	std::string name = "callhistory";
+	if (box.size()) {
+		name += '-';
+		for (char c : box)
+			name += isalnum((unsigned char) c) || c == '.' || c == '-' ? c : '_';
+	}
+	return dir + "/" + name + extension;
+}
+
+CallArchive::CallArchive(const std::string &dir, const std::string &box)
+: dataPath{ArchivePath(dir, box, ".dat")}, indexPath{ArchivePath(dir, box, ".idx")}, sideIndexPath{ArchivePath(dir, box, ".oidx")},
+  numberIndexPath{ArchivePath(dir, box, ".nidx")}, headerPath{ArchivePath(dir, box, ".hdr")},
+  data{nullptr}, dataSize{0}, index{nullptr}, indexSize{0}, numberIndex{nullptr}, numberIndexSize{0} {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!openIndex()) {
+		map();
+		if (dataSize || indexSize || sideIndex.size() || numberIndexSize) {
+			INF("rebuilding call archive index.");
+			rebuildIndex();
+		}
+	}
+	DBG("call archive contains " << indexSize + sideIndex.size() << " entries.");
+}
+
+CallArchive::~CallArchive() {
+	unmap();
+}
+
+bool CallArchive::TimestampLess(const sIndexEntry &a, const sIndexEntry &b) {
+	return a.timestamp < b.timestamp;
+}
+
+bool CallArchive::NumberLess(const sIndexEntry &a, const sIndexEntry &b) {
+	// calls of one number are kept in chronological order
+	if (a.numberHash != b.numberHash)
+		return a.numberHash < b.numberHash;
+	if (a.timestamp != b.timestamp)
+		return a.timestamp < b.timestamp;
+	return a.offset < b.offset;
+}
+
+static const void *MapFile(const std::string &path, size_t &size) {
+	size = 0;
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return nullptr;
+	struct stat st;
+	void *ptr = nullptr;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (ptr == MAP_FAILED) {
+			ERR("could not map " << path << ": " << strerror(errno));
+			ptr = nullptr;
+		} else {
+			size = st.st_size;
+		}
+	}
+	close(fd);
+	return ptr;
+}
+
+static bool WriteFile(const std::string &path, const void *buffer, size_t size, bool append) {
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+	if (fd < 0) {
+		ERR("could not open " << path << ": " << strerror(errno));
+		return false;
+	}
+	const char *pos = static_cast<const char *>(buffer);
+	while (size > 0) {
+		ssize_t written = write(fd, pos, size);
+		if (written < 0) {
+			ERR("could not write " << path << ": " << strerror(errno));
+			close(fd);
+			return false;
+		}
+		pos  += written;
+		size -= written;
+	}
+	close(fd);
+	return true;
+}
+
+static bool ReplaceFile(const std::string &path, const void *buffer, size_t size) {
+	// write to a temporary file first, so that a crash never leaves a truncated file
+	std::string tmpPath = path + ".tmp";
+	if (!WriteFile(tmpPath, buffer, size, false))
+		return false;
+	return rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+static const uint32_t HEADER_MAGIC = 0x31484346;   // "FCH1"
+static const uint32_t HEADER_DIRTY = 1;            // index files are rewritten in place
+
+struct sHeader {
+	uint32_t magic;
+	uint32_t flags;
+	uint64_t dataSize;          // committed length of the data file
+	uint64_t indexSize;         // committed number of entries of the index files
+	uint64_t sideIndexSize;
+	uint64_t numberIndexSize;
+	uint64_t runCount;          // followed by the start of each run in the number index
+	uint64_t checksum;          // of the fields above and the runs
+};
+
+static uint64_t HeaderChecksum(const sHeader &header, const uint64_t *runs) {
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&hash](const void *buffer, size_t size) {
+		for (size_t pos = 0; pos < size; pos++) {
+			hash ^= static_cast<const unsigned char *>(buffer)[pos];
+			hash *= 1099511628211ull;
+		}
+	};
+	add(&header, offsetof(sHeader, checksum));
+	add(runs, header.runCount * sizeof(uint64_t));
+	return hash;
+}
+
+static bool TruncateTo(const std::string &path, uint64_t size) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return size == 0;
+	if ((uint64_t) st.st_size < size)
+		return false;
+	if ((uint64_t) st.st_size > size && truncate(path.c_str(), size) != 0) {
+		ERR("could not truncate " << path << ": " << strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+bool CallArchive::openIndex() {
+	std::ifstream file(headerPath.c_str(), std::ios::binary);
+	sHeader header;
+	if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != HEADER_MAGIC ||
+	    header.flags & HEADER_DIRTY || header.runCount > header.numberIndexSize)
+		return false;
+	std::vector<uint64_t> runs(header.runCount);
+	if (!file.read(reinterpret_cast<char *>(runs.data()), runs.size() * sizeof(uint64_t)) ||
+	    header.checksum != HeaderChecksum(header, runs.data()))
+		return false;
+	// only the committed lengths are verified, data after them was written by an interrupted merge
+	if (!TruncateTo(dataPath, header.dataSize) ||
+	    !TruncateTo(indexPath, header.indexSize * sizeof(sIndexEntry)) ||
+	    !TruncateTo(sideIndexPath, header.sideIndexSize * sizeof(sIndexEntry)) ||
+	    !TruncateTo(numberIndexPath, header.numberIndexSize * sizeof(sIndexEntry)))
+		return false;
+	map();
+	numberRuns.assign(runs.begin(), runs.end());
+	return true;
+}
+
+void CallArchive::writeHeader(bool dirty) {
+	sHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic           = HEADER_MAGIC;
+	header.flags           = dirty ? HEADER_DIRTY : 0;
+	header.dataSize        = dataSize;
+	header.indexSize       = indexSize;
+	header.sideIndexSize   = sideIndex.size();
+	header.numberIndexSize = numberIndexSize;
+	header.runCount        = numberRuns.size();
+	std::vector<uint64_t> runs(numberRuns.begin(), numberRuns.end());
+	header.checksum        = HeaderChecksum(header, runs.data());
+	std::string buffer(reinterpret_cast<const char *>(&header), sizeof(header));
+	buffer.append(reinterpret_cast<const char *>(runs.data()), runs.size() * sizeof(uint64_t));
+	ReplaceFile(headerPath, buffer.data(), buffer.size());
+}
+
+void CallArchive::map() {
+	size_t size;
+	data        = static_cast<const char *>(MapFile(dataPath, dataSize));
+	index       = static_cast<const sIndexEntry *>(MapFile(indexPath, size));
+	indexSize   = size / sizeof(sIndexEntry);
+	numberIndex = static_cast<const sIndexEntry *>(MapFile(numberIndexPath, size));
+	numberIndexSize = size / sizeof(sIndexEntry);
+	// the side index is small, it is kept in memory
+	const sIndexEntry *side = static_cast<const sIndexEntry *>(MapFile(sideIndexPath, size));
+	sideIndex.assign(side, side + size / sizeof(sIndexEntry));
+	if (side)
+		munmap(const_cast<sIndexEntry *>(side), size);
+	std::sort(sideIndex.begin(), sideIndex.end(), TimestampLess);
+}
+
+void CallArchive::unmap() {
+	if (data)
+		munmap(const_cast<char *>(data), dataSize);
+	if (index)
+		munmap(const_cast<sIndexEntry *>(index), indexSize * sizeof(sIndexEntry));
+	if (numberIndex)
+		munmap(const_cast<sIndexEntry *>(numberIndex), numberIndexSize * sizeof(sIndexEntry));
+	data = nullptr;
+	index = nullptr;
+	numberIndex = nullptr;
+	dataSize = indexSize = numberIndexSize = 0;
+	sideIndex.clear();
+}
+
+void CallArchive::rebuildIndex() {
+	std::vector<sIndexEntry> entries;
+	size_t pos = 0;
+	while (pos < dataSize) {
+		const char *end = static_cast<const char *>(memchr(data + pos, '\n', dataSize - pos));
+		if (!end)
+			break; // ignore a partially written last record
+		size_t length = end - (data + pos) + 1;
+		CallEntry ce;
+		if (Parse(data + pos, length, ce))
+			entries.push_back(sIndexEntry{ce.timestamp, pos, (uint32_t) length, HashNumber(ce.remoteNumber)});
+		pos += length;
+	}
+	std::stable_sort(entries.begin(), entries.end(), TimestampLess);
+	if (pos < dataSize) {
+		// drop the partial record, further records are appended after the last complete one
+		if (truncate(dataPath.c_str(), pos) != 0)
+			ERR("could not truncate " << dataPath << ": " << strerror(errno));
+	}
+	ReplaceFile(indexPath, entries.data(), entries.size() * sizeof(sIndexEntry));
+	WriteFile(sideIndexPath, nullptr, 0, false);
+	unmap();
+	map();
+	writeNumberIndex();
+	writeHeader(false);
+}
+
+void CallArchive::writeNumberIndex() {
+	// a single run of all entries
+	std::vector<sIndexEntry> entries(index, index + indexSize);
+	entries.insert(entries.end(), sideIndex.begin(), sideIndex.end());
+	std::sort(entries.begin(), entries.end(), NumberLess);
+	ReplaceFile(numberIndexPath, entries.data(), entries.size() * sizeof(sIndexEntry));
+	numberRuns.clear();
+	if (entries.size())
+		numberRuns.push_back(0);
+	unmap();
+	map();
+}
+
+void CallArchive::appendNumberIndex(std::vector<sIndexEntry> entries) {
+	std::sort(entries.begin(), entries.end(), NumberLess);
+	size_t start = numberIndexSize;
+	// merge runs at the end, as long as the merged run is not much smaller than the one before;
+	// this keeps the number of runs logarithmic and each entry is rewritten O(log n) times
+	for (size_t run = numberRuns.size(); run > 0; run--) {
+		size_t runStart = numberRuns[run-1];
+		if (entries.size() * 2 < start - runStart)
+			break;
+		std::vector<sIndexEntry> merged(start - runStart + entries.size());
+		std::merge(numberIndex + runStart, numberIndex + start, entries.begin(), entries.end(), merged.begin(), NumberLess);
+		entries.swap(merged);
+		start = runStart;
+	}
+	int fd = open(numberIndexPath.c_str(), O_WRONLY | O_CREAT, 0644);
+	if (fd < 0) {
+		ERR("could not open " << numberIndexPath << ": " << strerror(errno));
+		return;
+	}
+	// a write interrupted here leaves the header dirty, see merge()
+	const char *buffer = reinterpret_cast<const char *>(entries.data());
+	size_t size = entries.size() * sizeof(sIndexEntry);
+	off_t offset = start * sizeof(sIndexEntry);
+	while (size > 0) {
+		ssize_t written = pwrite(fd, buffer, size, offset);
+		if (written < 0) {
+			ERR("could not write " << numberIndexPath << ": " << strerror(errno));
+			break;
+		}
+		buffer += written;
+		offset += written;
+		size   -= written;
+	}
+	close(fd);
+	while (numberRuns.size() && numberRuns.back() >= start)
+		numberRuns.pop_back();
+	numberRuns.push_back(start);
+	unmap();
+	map();
+}
+
+void CallArchive::compactIndex() {
+	std::vector<sIndexEntry> merged(indexSize + sideIndex.size());
+	std::merge(index, index + indexSize, sideIndex.begin(), sideIndex.end(), merged.begin(), TimestampLess);
+	ReplaceFile(indexPath, merged.data(), merged.size() * sizeof(sIndexEntry));
+	WriteFile(sideIndexPath, nullptr, 0, false);
+	unmap();
+	map();
+}
+
+uint32_t CallArchive::HashNumber(const std::string &number) {
+	// FNV-1a, as the hash is persisted it must not depend on the standard library
+	std::string normalized = number.size() ? Tools::NormalizeNumber(number) : number;
+	uint32_t hash = 2166136261u;
+	for (unsigned char c : normalized) {
+		hash ^= c;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+std::string CallArchive::Serialize(const CallEntry &ce) {
+	std::string fields[] = { ce.date, ce.time, ce.remoteName, ce.remoteNumber, ce.localName, ce.localNumber, ce.duration };
+	std::stringstream record;
+	record << ce.timestamp << ';' << ce.type;
+	for (std::string &field : fields) {
+		// the separators must not appear in fields
+		std::replace(field.begin(), field.end(), ';', ',');
+		std::replace(field.begin(), field.end(), '\n', ' ');
+		std::replace(field.begin(), field.end(), '\r', ' ');
+		record << ';' << field;
+	}
+	record << '\n';
+	return record.str();
+}
+
+bool CallArchive::Parse(const char *record, size_t length, CallEntry &ce) {
+	// timestamp;type;date;time;remoteName;remoteNumber;localName;localNumber;duration\n
+	std::string line(record, length && record[length-1] == '\n' ? length - 1 : length);
+	std::string fields[9];
+	size_t start = 0;
+	for (size_t field = 0; field < 9; field++) {
+		size_t stop = field < 8 ? line.find(';', start) : line.size();
+		if (stop == std::string::npos)
+			return false;
+		fields[field] = line.substr(start, stop - start);
+		start = stop + 1;
+	}
+	ce.timestamp    = atoll(fields[0].c_str());
+	ce.type         = (CallEntry::eCallType) atoi(fields[1].c_str());
+	ce.date         = fields[2];
+	ce.time         = fields[3];
+	ce.remoteName   = fields[4];
+	ce.remoteNumber = fields[5];
+	ce.localName    = fields[6];
+	ce.localNumber  = fields[7];
+	ce.duration     = fields[8];
+	return true;
+}
+
+CallEntry CallArchive::read(const sIndexEntry &ie) const {
+	CallEntry ce;
+	if (ie.offset + ie.length > dataSize || !Parse(data + ie.offset, ie.length, ce))
+		ERR("invalid record in call archive at offset " << ie.offset);
+	return ce;
+}
+
+bool CallArchive::contains(const CallEntry &ce) const {
+	for (auto range : { std::make_pair(index, index + indexSize), std::make_pair(sideIndex.data(), sideIndex.data() + sideIndex.size()) }) {
+		sIndexEntry first{(int64_t) ce.timestamp, 0, 0, 0};
+		for (const sIndexEntry *it = std::lower_bound(range.first, range.second, first, TimestampLess);
+		     it < range.second && it->timestamp == ce.timestamp; it++) {
+			CallEntry archived = read(*it);
+			if (archived.remoteNumber == ce.remoteNumber && archived.localNumber == ce.localNumber &&
+			    archived.duration == ce.duration && archived.type == ce.type)
+				return true;
+		}
+	}
+	return false;
+}
+
+size_t CallArchive::merge(const std::vector<CallEntry> &entries) {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<CallEntry> newEntries;
+	for (const CallEntry &ce : entries) {
+		if (contains(ce))
+			continue;
+		bool duplicate = false;
+		for (const CallEntry &other : newEntries)
+			if (other.timestamp == ce.timestamp && other.remoteNumber == ce.remoteNumber && other.localNumber == ce.localNumber &&
+			    other.duration == ce.duration && other.type == ce.type) {
+				duplicate = true;
+				break;
+			}
+		if (!duplicate)
+			newEntries.push_back(ce);
+	}
+	if (newEntries.empty())
+		return 0;
+	std::stable_sort(newEntries.begin(), newEntries.end(), [](const CallEntry &a, const CallEntry &b) {
+		return a.timestamp < b.timestamp;
+	});
+
+	// append the records
+	std::string records;
+	std::vector<sIndexEntry> indexEntries;
+	for (const CallEntry &ce : newEntries) {
+		std::string record = Serialize(ce);
+		indexEntries.push_back(sIndexEntry{ce.timestamp, dataSize + records.size(), (uint32_t) record.size(), HashNumber(ce.remoteNumber)});
+		records += record;
+	}
+	if (!WriteFile(dataPath, records.data(), records.size(), true)) {
+		// the offsets of the next merge start at the committed end again
+		if (truncate(dataPath.c_str(), dataSize) != 0)
+			ERR("could not truncate " << dataPath << ": " << strerror(errno));
+		return 0;
+	}
+
+	// new calls are usually newer than all archived ones and are appended to the index,
+	// older ones are appended to the side index
+	int64_t newest = indexSize ? index[indexSize-1].timestamp : INT64_MIN;
+	auto ordered = std::find_if(indexEntries.begin(), indexEntries.end(), [newest](const sIndexEntry &ie) {
+		return ie.timestamp >= newest;
+	});
+	if (ordered != indexEntries.end())
+		WriteFile(indexPath, &*ordered, (indexEntries.end() - ordered) * sizeof(sIndexEntry), true);
+	if (ordered != indexEntries.begin())
+		WriteFile(sideIndexPath, indexEntries.data(), (ordered - indexEntries.begin()) * sizeof(sIndexEntry), true);
+	// the number index and the compaction rewrite committed parts of the index files,
+	// if this is interrupted, the dirty header causes a rebuild on the next start
+	writeHeader(true);
+	unmap();
+	map();
+	appendNumberIndex(indexEntries);
+	if (sideIndex.size() > std::max<size_t>(SIDE_INDEX_LIMIT, indexSize / 16))
+		compactIndex();
+	writeHeader(false);
+	INF("added " << newEntries.size() << " entries to call archive.");
+	return newEntries.size();
+}
+
+size_t CallArchive::size() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return indexSize + sideIndex.size();
+}
+
+std::vector<CallEntry> CallArchive::callsBetween(time_t from, time_t to) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<CallEntry> result;
+	sIndexEntry first{(int64_t) from, 0, 0, 0};
+	const sIndexEntry *it = std::lower_bound(index, index + indexSize, first, TimestampLess);
+	const sIndexEntry *side = std::lower_bound(sideIndex.data(), sideIndex.data() + sideIndex.size(), first, TimestampLess);
+	const sIndexEntry *sideEnd = sideIndex.data() + sideIndex.size();
+	// merge the matching entries of both indexes
+	while (true) {
+		bool inIndex = it < index + indexSize && it->timestamp < to;
+		bool inSide  = side < sideEnd && side->timestamp < to;
+		if (inIndex && (!inSide || it->timestamp <= side->timestamp))
+			result.push_back(read(*it++));
+		else if (inSide)
+			result.push_back(read(*side++));
+		else
+			break;
+	}
+	return result;
+}
+
+std::vector<CallEntry> CallArchive::callsByNumber(const std::string &number) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<sIndexEntry> matches;
+	sIndexEntry first{INT64_MIN, 0, 0, HashNumber(number)};
+	for (size_t run = 0; run < numberRuns.size(); run++) {
+		const sIndexEntry *end = numberIndex + (run + 1 < numberRuns.size() ? numberRuns[run+1] : numberIndexSize);
+		for (const sIndexEntry *it = std::lower_bound(numberIndex + numberRuns[run], end, first, NumberLess);
+		     it < end && it->numberHash == first.numberHash; it++)
+			matches.push_back(*it);
+	}
+	std::sort(matches.begin(), matches.end(), NumberLess);
+	std::vector<CallEntry> result;
+	std::string normalized = number.size() ? Tools::NormalizeNumber(number) : number;
+	for (const sIndexEntry &ie : matches) {
+		CallEntry ce = read(ie);
+		// different numbers may share a hash
+		if ((ce.remoteNumber.size() ? Tools::NormalizeNumber(ce.remoteNumber) : ce.remoteNumber) == normalized)
+			result.push_back(ce);
+	}
+	return result;
+}
+
+}
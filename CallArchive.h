@@ -0,0 +1,132 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef CALLARCHIVE_H
+#define CALLARCHIVE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CallList.h"
+
+namespace fritz {
+
+/**
+ * Persistent, append-only archive of call list entries.
+ * The Fritz!Box only reports its most recent calls, the archive keeps all
+ * calls ever merged into it. Each box has its own archive, the name of its files
+ * contains the host of the box, e.g., callhistory-fritz.box.dat:
+ * - .dat: one text record per call, only appended to
+ * - .idx: fixed size entries ordered by timestamp, pointing into the .dat file; only
+ *   appended to, as new calls are usually newer than all archived ones
+ * - .oidx: the entries of calls older than the last one in .idx, appended in any order;
+ *   when it gets too large, it is merged into .idx
+ * - .nidx: all entries in runs ordered by remote number; each merge appends
+ *   a run, small runs at the end are merged in place, so there are O(log n) runs
+ * - .hdr: the committed length of each file and the runs of .nidx, with a checksum;
+ *   it is replaced after each merge, data after the committed length is left over
+ *   from an interrupted merge and dropped on the next start
+ * The index files are memory mapped for queries, records are read on demand,
+ * so the archive is never loaded into memory completely.
+ */
+class CallArchive {
+private:
+	struct sIndexEntry {
+		int64_t  timestamp;
+		uint64_t offset;      // position of the record in the data file
+		uint32_t length;      // length of the record including '\n'
+		uint32_t numberHash;  // hash of the normalized remote number
+	};
+	static const size_t SIDE_INDEX_LIMIT = 256;   // minimum size of .oidx before it is merged into .idx
+	std::string dataPath;
+	std::string indexPath;
+	std::string sideIndexPath;
+	std::string numberIndexPath;
+	std::string headerPath;
+	mutable std::mutex mutex;
+	const char *data;
+	size_t dataSize;
+	const sIndexEntry *index;
+	size_t indexSize;
+	std::vector<sIndexEntry> sideIndex;   // ordered by timestamp
+	const sIndexEntry *numberIndex;
+	size_t numberIndexSize;
+	std::vector<size_t> numberRuns;  // start of each ordered run in numberIndex
+	void map();
+	void unmap();
+	/**
+	 * Opens the index files, if the header is valid and the files are not shorter than committed.
+	 * @return false, if the index has to be rebuilt
+	 */
+	bool openIndex();
+	void writeHeader(bool dirty);
+	void rebuildIndex();
+	void writeNumberIndex();
+	void appendNumberIndex(std::vector<sIndexEntry> entries);
+	void compactIndex();
+	static bool NumberLess(const sIndexEntry &a, const sIndexEntry &b);
+	static bool TimestampLess(const sIndexEntry &a, const sIndexEntry &b);
+	bool contains(const CallEntry &ce) const;
+	CallEntry read(const sIndexEntry &ie) const;
+	static std::string Serialize(const CallEntry &ce);
+	static bool Parse(const char *record, size_t length, CallEntry &ce);
+	static uint32_t HashNumber(const std::string &number);
+public:
+	/**
+	 * Opens the archive in the given directory, files are created on the first merge.
+	 * @param the directory to store the archive files in
+	 * @param the host of the box the calls are from, empty for an archive without box
+	 */
+	explicit CallArchive(const std::string &dir, const std::string &box = "");
+	virtual ~CallArchive();
+	/**
+	 * Adds all entries that are not yet part of the archive.
+	 * Entries are considered equal, if timestamp, remote number, local number,
+	 * duration and type are equal.
+	 * @param the entries to add
+	 * @return the number of entries added
+	 */
+	size_t merge(const std::vector<CallEntry> &entries);
+	/**
+	 * Returns the number of archived calls.
+	 * @return the number of calls
+	 */
+	size_t size() const;
+	/**
+	 * Returns all archived calls in the time range [from, to).
+	 * @param start of the time range (inclusive)
+	 * @param end of the time range (exclusive)
+	 * @return the calls, ordered by ascending timestamp
+	 */
+	std::vector<CallEntry> callsBetween(time_t from, time_t to) const;
+	/**
+	 * Returns all archived calls from or to the given number.
+	 * @param the remote number, it is normalized before comparison
+	 * @return the calls, ordered by ascending timestamp
+	 */
+	std::vector<CallEntry> callsByNumber(const std::string &number) const;
+};
+
+}
+
+#endif /* CALLARCHIVE_H */
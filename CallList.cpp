@@ -23,8 +23,13 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
 #include <time.h>
 
+#include "CallArchive.h"
+#include "CallStatistics.h"
 #include "Tools.h"
 #include "Config.h"
 #include <liblog++/Log.h>
@@ -32,59 +37,140 @@
 
 namespace fritz{
 
+/**
+ * Sort order on CallList entries.
+ * The sort key of each entry is extracted once, strings are replaced by their rank
+ * among all values of this element, so that comparisons are cheap.
+ */
 class CallEntrySort {
 private:
 	bool ascending;
-	CallEntry::eElements element;
-public:
-	CallEntrySort(CallEntry::eElements element = CallEntry::ELEM_DATE, bool ascending = true) {
-		this->element   = element;
-		this->ascending = ascending;
+	std::vector<long long> keys;
+	void rankStrings(const CallStore &entries, StringPool::id_t (CallStore::*column)(size_t) const) {
+		// rank the distinct strings of this column, not the entries
+		std::vector<StringPool::id_t> ids;
+		for (size_t pos = 0; pos < entries.size(); pos++)
+			ids.push_back((entries.*column)(pos));
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+		std::sort(ids.begin(), ids.end(), [&](StringPool::id_t a, StringPool::id_t b) {
+			return entries.getString(a) < entries.getString(b);
+		});
+		std::unordered_map<StringPool::id_t, long long> ranks;
+		for (size_t rank = 0; rank < ids.size(); rank++)
+			ranks[ids[rank]] = rank;
+		for (size_t pos = 0; pos < entries.size(); pos++)
+			keys[pos] = ranks[(entries.*column)(pos)];
 	}
-	bool operator() (CallEntry ce1, CallEntry ce2){
+public:
+	CallEntrySort(const CallStore &entries, CallEntry::eElements element = CallEntry::ELEM_DATE, bool ascending = true)
+	: ascending{ascending}, keys(entries.size(), 0) {
 		switch(element) {
 		case CallEntry::ELEM_DATE:
-			return (ascending ? (ce1.timestamp < ce2.timestamp) : (ce1.timestamp > ce2.timestamp));
+			for (size_t pos = 0; pos < entries.size(); pos++)
+				keys[pos] = entries.getTimestamp(pos);
 			break;
 		case CallEntry::ELEM_DURATION:
-			if (ce1.duration.size() < ce2.duration.size())
-				return (ascending ? true : false);
-			if (ce1.duration.size() > ce2.duration.size())
-				return (ascending ? false : true);
-			return (ascending ? (ce1.duration < ce2.duration) : (ce1.duration > ce2.duration));
+			for (size_t pos = 0; pos < entries.size(); pos++)
+				keys[pos] = entries.getDuration(pos);
 			break;
 		case CallEntry::ELEM_LOCALNAME:
-			return (ascending ? (ce1.localName < ce2.localName) : (ce1.localName > ce2.localName));
+			rankStrings(entries, &CallStore::getLocalName);
 			break;
 		case CallEntry::ELEM_LOCALNUMBER:
-			return (ascending ? (ce1.localNumber < ce2.localNumber) : (ce1.localNumber > ce2.localNumber));
+			rankStrings(entries, &CallStore::getLocalNumber);
 			break;
 		case CallEntry::ELEM_REMOTENAME:
-			if (ce1.remoteName == "unknown" && ce2.remoteName == "unknown")
-				return false;
-			if (ce1.remoteName == "unknown")
-				return (ascending ? true : false);
-			if (ce2.remoteName == "unknown")
-				return (ascending ? false : true);
-			return (ascending ? (ce1.remoteName < ce2.remoteName) : (ce1.remoteName > ce2.remoteName));
+			rankStrings(entries, &CallStore::getRemoteName);
+			// "unknown" is always sorted before any other name
+			for (size_t pos = 0; pos < entries.size(); pos++)
+				if (entries.getString(entries.getRemoteName(pos)) == "unknown")
+					keys[pos] = -1;
 			break;
 		case CallEntry::ELEM_REMOTENUMBER:
-			return (ascending ? (ce1.remoteNumber < ce2.remoteNumber) : (ce1.remoteNumber > ce2.remoteNumber));
+			rankStrings(entries, &CallStore::getRemoteNumber);
 			break;
 		case CallEntry::ELEM_TYPE:
-			return (ascending ? (ce1.type < ce2.type) : (ce1.type > ce2.type));
+			for (size_t pos = 0; pos < entries.size(); pos++)
+				keys[pos] = entries.getType(pos);
 			break;
 		default:
 			ERR("invalid element given for sorting.");
-			return false;
 		}
 	}
+	bool operator() (size_t pos1, size_t pos2) const {
+		return (ascending ? (keys[pos1] < keys[pos2]) : (keys[pos1] > keys[pos2]));
+	}
 };
 
+StringPool::id_t StringPool::intern(const std::string &s) {
+	auto it = ids.find(&s);
+	if (it != ids.end())
+		return it->second;
+	id_t id = strings.size();
+	strings.push_back(s);
+	ids[&strings.back()] = id;
+	return id;
+}
+
+bool StringPool::find(const std::string &s, id_t &id) const {
+	auto it = ids.find(&s);
+	if (it == ids.end())
+		return false;
+	id = it->second;
+	return true;
+}
+
+size_t CallStore::add(const CallEntry &ce) {
+	timestamps.push_back(ce.timestamp);
+	durations.push_back(CallList::ParseDuration(ce.duration));
+	types.push_back(ce.type);
+	dates.push_back(pool.intern(ce.date));
+	times.push_back(pool.intern(ce.time));
+	remoteNames.push_back(pool.intern(ce.remoteName));
+	remoteNumbers.push_back(pool.intern(ce.remoteNumber));
+	localNames.push_back(pool.intern(ce.localName));
+	localNumbers.push_back(pool.intern(ce.localNumber));
+	provisionals.push_back(ce.provisional);
+	return types.size() - 1;
+}
+
+CallEntry CallStore::get(size_t pos) const {
+	CallEntry ce;
+	ce.type         = getType(pos);
+	ce.date         = pool.get(dates[pos]);
+	ce.time         = pool.get(times[pos]);
+	ce.remoteName   = pool.get(remoteNames[pos]);
+	ce.remoteNumber = pool.get(remoteNumbers[pos]);
+	ce.localName    = pool.get(localNames[pos]);
+	ce.localNumber  = pool.get(localNumbers[pos]);
+	ce.duration     = CallList::FormatDuration(durations[pos]);
+	ce.timestamp    = timestamps[pos];
+	ce.provisional  = provisionals[pos];
+	return ce;
+}
+
+void CallStore::swap(CallStore &other) {
+	std::swap(pool, other.pool);
+	timestamps.swap(other.timestamps);
+	durations.swap(other.durations);
+	types.swap(other.types);
+	dates.swap(other.dates);
+	times.swap(other.times);
+	remoteNames.swap(other.remoteNames);
+	remoteNumbers.swap(other.remoteNumbers);
+	localNames.swap(other.localNames);
+	localNumbers.swap(other.localNumbers);
+	provisionals.swap(other.provisionals);
+}
+
 CallList *CallList::me = nullptr;
 
 CallList::CallList()
-: thread{nullptr}, lastCall{0}, lastMissedCall{0}, valid{false} {
+: thread{nullptr}, delayThread{nullptr}, delayStop{false}, entries{std::make_shared<CallStore>()}, releaseRetired{false},
+  missedFilterCount{0}, sortCacheVersion{0}, version{0},
+  statistics{new CallStatistics}, statisticsWatermark{0},
+  archive{gConfig->getConfigDir().size() ? new CallArchive(gConfig->getConfigDir(), gConfig->getUrl()) : nullptr}, contentHash{0}, lastCall{0}, lastMissedCall{0}, valid{false} {
 	reload();
 }
 
@@ -110,20 +196,24 @@ void CallList::DeleteCallList() {
 
 CallList::~CallList()
 {
-	thread->join(); //TODO cancellation?
+	if (delayThread) {
+		{
+			std::lock_guard<std::mutex> lock(delayMutex);
+			delayStop = true;
+			delayChanged.notify_all();
+		}
+		delayThread->join();
+		delete delayThread;
+	}
+	// Config::Shutdown() cancels pending retries of the request before
+	thread->join();
 	delete thread;
+	delete statistics;
+	delete archive;
 	DBG("deleted call list");
 }
 
-void CallList::run() {
-	DBG("CallList thread started");
-
-	FritzClient *fc = gConfig->fritzClientFactory->create();
-	std::string msg = fc->requestCallList();
-	delete fc;
-
-	std::vector<CallEntry> callList;
-	// parse answer
+void CallList::parse(const std::string &msg, CallStore &callList) {
 	size_t pos = 2;
 	// parse body
 	int count = 0;
@@ -134,7 +224,13 @@ void CallList::run() {
 			DBG("parser skipped line in calllist");
 			continue;
 		}
-		int dateStart     = msg.find(';', type)          +1;
+		size_t dateStart  = msg.find(';', type);
+		size_t lineStop   = msg.find('\n', type);
+		if (dateStart == std::string::npos || dateStart > lineStop) { // ignore incomplete lines
+			DBG("parser skipped incomplete line in calllist");
+			continue;
+		}
+		dateStart++;
 		int timeStart	  = msg.find(' ', dateStart)     +1;
 		int nameStart     = msg.find(';', timeStart)     +1;
 		int numberStart   = msg.find(';', nameStart)     +1;
@@ -178,46 +274,185 @@ void CallList::run() {
 		if (ce.remoteNumber.compare("1234567") == 0 && ce.date.compare("12.03.2005") == 0)
 			continue;
 
-		callList.push_back(ce);
+		callList.add(ce);
 
 		count++;
 	}
 	INF("CallList -> read " << count << " entries.");
+}
 
-	valid = false;
-	callListAll = callList;
-	callListIn.clear();
-	callListOut.clear();
-	callListMissed.clear();
-	lastCall = 0;
-	lastMissedCall = 0;
-
-	for(auto ce : callListAll) {
-		if (lastCall < ce.timestamp)
-			lastCall = ce.timestamp;
-
-		switch (ce.type) {
+void CallList::run() {
+	DBG("CallList thread started");
+
+	// the list is hashed while it is received
+	FritzClient *fc = gConfig->fritzClientFactory->create();
+	std::string msg;
+	ContentHasher hasher;
+	bool received = fc->streamCallList([&msg, &hasher](const char *data, size_t length) {
+		if (!data) {
+			// the request is repeated, the list starts again
+			msg.clear();
+			hasher = ContentHasher();
+			return;
+		}
+		msg.append(data, length);
+		hasher.update(data, length);
+	});
+	delete fc;
+	if (!received && valid) {
+		DBG("CallList not received, keeping the current list, thread ended");
+		return;
+	}
+
+	// periodic reloads mostly return the same data, the parser is skipped then
+	uint64_t hash = hasher.digest();
+	bool unchanged = valid && hash == contentHash;
+	contentHash = hash;
+
+	CallStore callList;
+	if (!unchanged) {
+		parse(msg, callList);
+		// keep calls that the Fritz!Box will drop from its list later on
+		if (archive) {
+			std::vector<CallEntry> calls;
+			calls.reserve(callList.size());
+			for (size_t pos = 0; pos < callList.size(); pos++)
+				calls.push_back(callList.get(pos));
+			archive->merge(calls);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(updateMutex);
+	if (unchanged) {
+		if (provisionalEntries.empty()) {
+			DBG("CallList unchanged, thread ended");
+			return;
+		}
+		// take the entries of the Fritz!Box from the current call list
+		for (size_t pos = 0; pos < entries->size(); pos++)
+			if (!entries->isProvisional(pos))
+				callList.add(entries->get(pos));
+	}
+	// drop provisional entries that are confirmed by the Fritz!Box or outdated
+	time_t now = time(nullptr);
+	std::vector<sProvisional> pending;
+	// numbers are normalized once, and only for entries close in time to a provisional one
+	std::vector<std::string> normalized(callList.size());
+	std::vector<bool> isNormalized(callList.size(), false);
+	for (sProvisional &p : provisionalEntries) {
+		bool confirmed = false;
+		std::string number = Tools::NormalizeNumber(p.entry.remoteNumber);
+		for (size_t pos = 0; pos < callList.size() && !confirmed; pos++) {
+			if (llabs((long long) (callList.getTimestamp(pos) - p.entry.timestamp)) > 120)
+				continue;
+			if (!isNormalized[pos]) {
+				normalized[pos] = Tools::NormalizeNumber(callList.getString(callList.getRemoteNumber(pos)));
+				isNormalized[pos] = true;
+			}
+			confirmed = normalized[pos] == number;
+		}
+		if (!confirmed && now - p.added < PROVISIONAL_TIMEOUT)
+			pending.push_back(p);
+	}
+	if (unchanged && pending.size() == provisionalEntries.size()) {
+		DBG("CallList unchanged, thread ended");
+		return;
+	}
+	provisionalEntries.swap(pending);
+	CallStore combined;
+	for (sProvisional &p : provisionalEntries)
+		combined.add(p.entry);
+	for (size_t pos = 0; pos < callList.size(); pos++)
+		combined.add(callList.get(pos));
+	install(combined);
+	DBG("CallList thread ended");
+}
+
+void CallList::addProvisional(const CallEntry &ce) {
+	std::lock_guard<std::mutex> lock(updateMutex);
+	sProvisional p = { ce, time(nullptr) };
+	p.entry.provisional = true;
+	provisionalEntries.insert(provisionalEntries.begin(), p);
+	// newest first, like the Fritz!Box sends its list
+	CallStore combined;
+	for (sProvisional &p : provisionalEntries)
+		combined.add(p.entry);
+	for (size_t pos = 0; pos < entries->size(); pos++)
+		if (!entries->isProvisional(pos))
+			combined.add(entries->get(pos));
+	install(combined);
+}
+
+void CallList::install(CallStore &callList) {
+	// build views and indexes
+	std::vector<size_t> lists[CallEntry::TYPES_COUNT];
+	std::vector<size_t> index[CallEntry::TYPES_COUNT];
+	std::unordered_map<StringPool::id_t, size_t> missedPerMsn;
+	for (size_t pos = 0; pos < callList.size(); pos++) {
+		CallEntry::eCallType type = callList.getType(pos);
+		lists[CallEntry::ALL].push_back(pos);
+		switch (type) {
 		case CallEntry::INCOMING:
-			callListIn.push_back(ce);
-			break;
 		case CallEntry::OUTGOING:
-			callListOut.push_back(ce);
+			lists[type].push_back(pos);
 			break;
 		case CallEntry::MISSED:
-			if (lastMissedCall < ce.timestamp)
-				lastMissedCall = ce.timestamp;
-			callListMissed.push_back(ce);
+			lists[type].push_back(pos);
+			missedPerMsn[callList.getLocalNumber(pos)]++;
 			break;
 		default:
 			DBG("parser skipped unknown call type");
 			continue;
 		}
 	}
+	for (size_t type = 0; type < CallEntry::TYPES_COUNT; type++) {
+		index[type] = lists[type];
+		std::stable_sort(index[type].begin(), index[type].end(), [&callList](size_t a, size_t b) {
+			return callList.getTimestamp(a) < callList.getTimestamp(b);
+		});
+	}
+
+	// readers keep the previous store while they hold a reference to it
+	std::shared_ptr<CallStore> store = std::make_shared<CallStore>();
+	store->swap(callList);
+
+	boost::unique_lock<boost::shared_mutex> lock(dataMutex);
+	valid = false;
+	entries = store;
+	if (releaseRetired) {
+		retired.clear();
+		materialized.clear();
+		releaseRetired = false;
+	}
+	for (std::unique_ptr<CallEntry> &entry : materialized)
+		if (entry)
+			retired.push_back(std::move(entry));
+	materialized.clear();
+	materialized.resize(entries->size());
+	for (size_t type = 0; type < CallEntry::TYPES_COUNT; type++) {
+		callLists[type].swap(lists[type]);
+		timeIndex[type].swap(index[type]);
+	}
+	missedCallsPerMsn.swap(missedPerMsn);
+	version++;
+	countMissedCalls();
+	updateStatistics();
+	lastCall       = timeIndex[CallEntry::ALL].size()    ? entries->getTimestamp(timeIndex[CallEntry::ALL].back())    : 0;
+	lastMissedCall = timeIndex[CallEntry::MISSED].size() ? entries->getTimestamp(timeIndex[CallEntry::MISSED].back()) : 0;
 	valid = true;
-	DBG("CallList thread ended");
 }
 
 void CallList::reload() {
+	{
+		// entries handed out so far are freed with the list fetched now
+		boost::unique_lock<boost::shared_mutex> lock(dataMutex);
+		releaseRetired = true;
+	}
+	startReload();
+}
+
+void CallList::startReload() {
+	std::lock_guard<std::mutex> lock(reloadMutex);
 	if (thread) {
 		thread->join();
 		delete thread;
@@ -226,56 +461,193 @@ void CallList::reload() {
 	thread = new std::thread(&CallList::run, this);
 }
 
+void CallList::reloadLater(std::chrono::seconds delay) {
+	std::lock_guard<std::mutex> lock(delayMutex);
+	if (!delayThread)
+		delayThread = new std::thread(&CallList::runDelayedReloads, this);
+	if (reloadDue == std::chrono::steady_clock::time_point()) {
+		reloadDue = std::chrono::steady_clock::now() + delay;
+		delayChanged.notify_all();
+	}
+}
+
+void CallList::runDelayedReloads() {
+	std::unique_lock<std::mutex> lock(delayMutex);
+	while (!delayStop) {
+		if (reloadDue == std::chrono::steady_clock::time_point()) {
+			delayChanged.wait(lock);
+			continue;
+		}
+		if (std::chrono::steady_clock::now() < reloadDue) {
+			delayChanged.wait_until(lock, reloadDue);
+			continue;
+		}
+		reloadDue = std::chrono::steady_clock::time_point();
+		lock.unlock();
+		startReload();
+		lock.lock();
+	}
+}
+
 CallEntry *CallList::retrieveEntry(CallEntry::eCallType type, size_t id) {
-	switch (type) {
-	case CallEntry::ALL:
-		return &callListAll[id];
-	case CallEntry::INCOMING:
-		return &callListIn[id];
-	case CallEntry::OUTGOING:
-		return &callListOut[id];
-	case CallEntry::MISSED:
-		return &callListMissed[id];
-	default:
+	boost::shared_lock<boost::shared_mutex> lock(dataMutex);
+	if (type >= CallEntry::TYPES_COUNT || id >= callLists[type].size())
 		return nullptr;
-	}
+	return materialize(callLists[type][id]);
+}
+
+CallEntry *CallList::materialize(size_t pos) {
+	std::lock_guard<std::mutex> lock(materializeMutex);
+	if (!materialized[pos])
+		materialized[pos].reset(new CallEntry(entries->get(pos)));
+	return materialized[pos].get();
 }
 
 size_t CallList::getSize(CallEntry::eCallType type) {
-	switch (type) {
-	case CallEntry::ALL:
-		return callListAll.size();
-	case CallEntry::INCOMING:
-		return callListIn.size();
-	case CallEntry::OUTGOING:
-		return callListOut.size();
-	case CallEntry::MISSED:
-		return callListMissed.size();
-	default:
+	boost::shared_lock<boost::shared_mutex> lock(dataMutex);
+	if (type >= CallEntry::TYPES_COUNT)
 		return 0;
+	return callLists[type].size();
+}
+
+void CallList::countMissedCalls() {
+	// precompute the number of missed calls matching the current MSN filter,
+	// so that missedCalls() does not need to scan the list
+	const std::vector<size_t> &missed = timeIndex[CallEntry::MISSED];
+	missedFilter = gConfig->getMsnFilter();
+	missedFilterCount.resize(missed.size() + 1);
+	missedFilterCount[0] = 0;
+	for (size_t pos = 0; pos < missed.size(); pos++)
+		missedFilterCount[pos + 1] = missedFilterCount[pos] + (CallEntry::MatchesFilter(entries->getString(entries->getLocalNumber(missed[pos]))) ? 1 : 0);
+}
+
+void CallList::updateStatistics() {
+	// add entries not seen in a previous reload, in chronological order;
+	// entries older than the watermark were added before, so only the tail is visited
+	const std::vector<size_t> &index = timeIndex[CallEntry::ALL];
+	time_t watermark = statisticsWatermark;
+	// copies of each key at the watermark in this list, and at the newest timestamp
+	std::unordered_map<std::string, size_t> atWatermark;
+	std::unordered_map<std::string, size_t> atNewest;
+	std::string key;
+	for (size_t i = findTime(CallEntry::ALL, watermark); i < index.size(); i++) {
+		size_t pos = index[i];
+		if (entries->isProvisional(pos))
+			continue;
+		time_t timestamp = entries->getTimestamp(pos);
+		// pool ids change with each reload, so the strings are used
+		key.assign(entries->getString(entries->getRemoteNumber(pos))).append(1, ';')
+		   .append(entries->getString(entries->getLocalNumber(pos))).append(1, ';')
+		   .append(std::to_string(entries->getDuration(pos))).append(1, ';')
+		   .append(std::to_string(entries->getType(pos)));
+		if (timestamp > statisticsWatermark) {
+			statisticsWatermark = timestamp;
+			atNewest.clear();
+		}
+		atNewest[key]++;
+		// added before, unless this list holds more copies than seen so far
+		if (timestamp == watermark && ++atWatermark[key] <= statisticsAtWatermark[key])
+			continue;
+		statistics->ingest(entries->get(pos));
+	}
+	if (statisticsWatermark > watermark) {
+		statisticsAtWatermark.swap(atNewest);
+	} else {
+		for (auto &count : atNewest)
+			statisticsAtWatermark[count.first] = std::max(statisticsAtWatermark[count.first], count.second);
 	}
 }
 
+size_t CallList::findTime(CallEntry::eCallType type, time_t time, bool upper) const {
+	const std::vector<size_t> &index = timeIndex[type];
+	auto it = upper ?
+			std::upper_bound(index.begin(), index.end(), time, [this](time_t t, size_t pos) { return t < entries->getTimestamp(pos); }) :
+			std::lower_bound(index.begin(), index.end(), time, [this](size_t pos, time_t t) { return entries->getTimestamp(pos) < t; });
+	return it - index.begin();
+}
+
 size_t CallList::missedCalls(time_t since) {
-	size_t missedCalls = 0;
-	for (auto ce : callListMissed) {
-		// track number of new missed calls
-		if (ce.timestamp > since) {
-			if (ce.matchesFilter())
-				missedCalls++;
-		} else {
-			break; // no older calls will match the missed-calls condition
+	boost::shared_lock<boost::shared_mutex> lock(dataMutex);
+	// the MSN filter may have changed since the last reload
+	if (missedFilter != gConfig->getMsnFilter()) {
+		lock.unlock();
+		{
+			boost::unique_lock<boost::shared_mutex> writeLock(dataMutex);
+			countMissedCalls();
 		}
+		lock.lock();
 	}
-	return missedCalls;
+	// track number of new missed calls
+	return missedFilterCount.back() - missedFilterCount[findTime(CallEntry::MISSED, since, true)];
+}
+
+size_t CallList::missedCallsByMsn(const std::string &localNumber) const {
+	boost::shared_lock<boost::shared_mutex> lock(dataMutex);
+	StringPool::id_t id;
+	if (!entries->getPool().find(localNumber, id))
+		return 0;
+	auto it = missedCallsPerMsn.find(id);
+	return it == missedCallsPerMsn.end() ? 0 : it->second;
+}
+
+std::vector<CallEntry *> CallList::callsBetween(time_t from, time_t to, CallEntry::eCallType type) {
+	boost::shared_lock<boost::shared_mutex> lock(dataMutex);
+	std::vector<CallEntry *> result;
+	if (type >= CallEntry::TYPES_COUNT || from >= to)
+		return result;
+	size_t start = findTime(type, from);
+	size_t stop  = findTime(type, to);
+	result.reserve(stop - start);
+	for (size_t pos = start; pos < stop; pos++)
+		result.push_back(materialize(timeIndex[type][pos]));
+	return result;
 }
 
 void CallList::sort(CallEntry::eElements element, bool ascending) {
-	CallEntrySort ces(element, ascending);
-	std::sort(begin(callListAll), end(callListAll), ces); //TODO: other lists?
+	boost::unique_lock<boost::shared_mutex> lock(dataMutex);
+	// forget sort orders of a previous call list
+	if (sortCacheVersion != version) {
+		sortCache.clear();
+		sortCacheVersion = version;
+	}
+	auto it = sortCache.find(std::make_pair(element, ascending));
+	if (it == sortCache.end()) {
+		sSortOrder order;
+		std::vector<size_t> &all = order.callLists[CallEntry::ALL];
+		// always start from the order sent by the Fritz!Box to get reproducible results
+		all.resize(entries->size());
+		std::iota(all.begin(), all.end(), 0);
+		std::stable_sort(all.begin(), all.end(), CallEntrySort(*entries, element, ascending));
+		// derive the views of the other types from the sorted list of all calls
+		for (size_t pos : all)
+			if (entries->getType(pos) > CallEntry::ALL && entries->getType(pos) < CallEntry::TYPES_COUNT)
+				order.callLists[entries->getType(pos)].push_back(pos);
+		it = sortCache.insert(std::make_pair(std::make_pair(element, ascending), order)).first;
+	}
+	for (size_t type = 0; type < CallEntry::TYPES_COUNT; type++)
+		callLists[type] = it->second.callLists[type];
+}
+
+long long CallList::ParseDuration(const std::string &duration) {
+	// duration: h:mm
+	size_t colon = duration.find(':');
+	if (colon == std::string::npos)
+		return atoi(duration.c_str()) * 60;
+	return (atoll(duration.c_str()) * 60 + atoi(&duration[colon + 1])) * 60;
+}
+
+std::string CallList::FormatDuration(long long seconds) {
+	long long minutes = seconds / 60;
+	std::stringstream duration;
+	duration << minutes / 60 << ':' << std::setfill('0') << std::setw(2) << minutes % 60;
+	return duration.str();
 }
 
 bool CallEntry::matchesFilter() {
+	return MatchesFilter(localNumber);
+}
+
+bool CallEntry::MatchesFilter(const std::string &localNumber) {
 	// entries are filtered according to the MSN filter)
 	if ( Tools::MatchesMsnFilter(localNumber))
 		return true;
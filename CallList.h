@@ -22,13 +22,24 @@
 #ifndef CALLLIST_H
 #define CALLLIST_H
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <thread>
+#include <boost/thread/shared_mutex.hpp>
 
 namespace fritz{
 
+class CallArchive;
 class CallList;
+class CallStatistics;
 
 class CallEntry {
 public:
@@ -36,7 +47,8 @@ public:
 		ALL      = 0,
 		INCOMING = 1,
 		MISSED   = 2,
-		OUTGOING = 3
+		OUTGOING = 3,
+		TYPES_COUNT
 	};
 	enum eElements {
 		ELEM_TYPE,
@@ -56,22 +68,238 @@ public:
 	std::string localNumber;
 	std::string duration;
 	time_t      timestamp;
+	bool        provisional = false;  // created from call monitor events, not yet confirmed by the Fritz!Box
 	bool matchesFilter();
 	bool matchesRemoteNumber(std::string number);
+	/**
+	 * Checks if a call on the given local number passes the MSN filter.
+	 * @param the local number as reported by the Fritz!Box
+	 * @return true, if the call matches the MSN filter
+	 */
+	static bool MatchesFilter(const std::string &localNumber);
+};
+
+/**
+ * Deduplicating storage for strings.
+ * Each distinct string is stored once and referenced by a small integer id.
+ */
+class StringPool {
+public:
+	typedef uint32_t id_t;
+private:
+	struct sHash {
+		size_t operator()(const std::string *s) const { return std::hash<std::string>()(*s); }
+	};
+	struct sEqual {
+		bool operator()(const std::string *a, const std::string *b) const { return *a == *b; }
+	};
+	// a deque does not move its elements on growth, so ids can point into it
+	std::deque<std::string> strings;
+	std::unordered_map<const std::string *, id_t, sHash, sEqual> ids;
+public:
+	StringPool() = default;
+	StringPool(const StringPool &) = delete;
+	StringPool &operator=(const StringPool &) = delete;
+	StringPool(StringPool &&) = default;
+	StringPool &operator=(StringPool &&) = default;
+	/**
+	 * Adds a string to the pool, if not already contained.
+	 * @param the string
+	 * @return the id of the string
+	 */
+	id_t intern(const std::string &s);
+	/**
+	 * Looks up a string without adding it.
+	 * @param the string
+	 * @param set to the id of the string, if found
+	 * @return true, if the string is contained in the pool
+	 */
+	bool find(const std::string &s, id_t &id) const;
+	const std::string &get(id_t id) const { return strings[id]; }
+	size_t size() const { return strings.size(); }
+};
+
+/**
+ * Compact column-wise storage of call entries.
+ * Timestamps, durations and types are stored as integers, all text is
+ * stored as ids into a StringPool, as names and numbers repeat heavily.
+ */
+class CallStore {
+private:
+	StringPool pool;
+	std::vector<time_t>   timestamps;
+	std::vector<uint32_t> durations;
+	std::vector<uint8_t>  types;
+	std::vector<StringPool::id_t> dates;
+	std::vector<StringPool::id_t> times;
+	std::vector<StringPool::id_t> remoteNames;
+	std::vector<StringPool::id_t> remoteNumbers;
+	std::vector<StringPool::id_t> localNames;
+	std::vector<StringPool::id_t> localNumbers;
+	std::vector<bool>     provisionals;
+public:
+	/**
+	 * Appends an entry to the store.
+	 * @param the entry
+	 * @return the position of the new entry
+	 */
+	size_t add(const CallEntry &ce);
+	/**
+	 * Creates a CallEntry object out of the stored columns.
+	 * @param the position of the entry
+	 * @return the entry
+	 */
+	CallEntry get(size_t pos) const;
+	size_t size() const                                   { return types.size(); }
+	void swap(CallStore &other);
+	const StringPool &getPool() const                     { return pool; }
+	time_t getTimestamp(size_t pos) const                 { return timestamps[pos]; }
+	uint32_t getDuration(size_t pos) const                { return durations[pos]; }
+	CallEntry::eCallType getType(size_t pos) const        { return (CallEntry::eCallType) types[pos]; }
+	StringPool::id_t getRemoteName(size_t pos) const      { return remoteNames[pos]; }
+	StringPool::id_t getRemoteNumber(size_t pos) const    { return remoteNumbers[pos]; }
+	StringPool::id_t getLocalName(size_t pos) const       { return localNames[pos]; }
+	StringPool::id_t getLocalNumber(size_t pos) const     { return localNumbers[pos]; }
+	bool isProvisional(size_t pos) const                  { return provisionals[pos]; }
+	const std::string &getString(StringPool::id_t id) const { return pool.get(id); }
 };
 
 class CallList {
 private:
 	std::thread *thread;
-	std::vector<CallEntry> callListIn;
-	std::vector<CallEntry> callListMissed;
-	std::vector<CallEntry> callListOut;
-	std::vector<CallEntry> callListAll;
+	std::mutex reloadMutex;                    // serializes starting reload threads
+	/**
+	 * Reloads requested by reloadLater(), run by delayThread.
+	 */
+	std::thread *delayThread;
+	std::mutex delayMutex;
+	std::condition_variable delayChanged;
+	std::chrono::steady_clock::time_point reloadDue;  // epoch, if no reload is pending
+	bool delayStop;
+	void runDelayedReloads();
+	/**
+	 * Guards entries and everything derived from it. install() and sort() lock it
+	 * exclusively, readers take a shared lock.
+	 */
+	mutable boost::shared_mutex dataMutex;
+	/**
+	 * All call entries in the order sent by the Fritz!Box.
+	 * An installed store is never modified, each update installs a new one.
+	 * Views and indexes refer to its entries by position.
+	 */
+	std::shared_ptr<const CallStore> entries;
+	/**
+	 * CallEntry objects handed out by retrieveEntry() and callsBetween(),
+	 * created on first access.
+	 */
+	std::vector<std::unique_ptr<CallEntry>> materialized;
+	std::mutex materializeMutex;               // readers create entries concurrently
+	CallEntry *materialize(size_t pos);
+	/**
+	 * Entries handed out before an update that was not requested by reload(),
+	 * e.g., by the call monitor. They are kept until the list fetched by the next
+	 * reload() is installed.
+	 */
+	std::vector<std::unique_ptr<CallEntry>> retired;
+	bool releaseRetired;                       // set by reload()
+	/**
+	 * Starts a reload thread.
+	 */
+	void startReload();
+	/**
+	 * Per call type views on entries, as returned by retrieveEntry().
+	 * Sorting only reorders these views.
+	 */
+	std::vector<size_t> callLists[CallEntry::TYPES_COUNT];
+	/**
+	 * Per call type positions in entries, ordered by ascending timestamp.
+	 */
+	std::vector<size_t> timeIndex[CallEntry::TYPES_COUNT];
+	/**
+	 * Number of missed calls per local number, maintained while parsing.
+	 */
+	std::unordered_map<StringPool::id_t, size_t> missedCallsPerMsn;
+	/**
+	 * missedFilterCount[i] is the number of entries matching the MSN filter
+	 * among the first i entries of timeIndex[CallEntry::MISSED].
+	 */
+	std::vector<size_t> missedFilterCount;
+	/**
+	 * The MSN filter that was used to compute missedFilterCount.
+	 */
+	std::vector<std::string> missedFilter;
+	/**
+	 * Per type views for one sort order, see sort().
+	 */
+	struct sSortOrder {
+		std::vector<size_t> callLists[CallEntry::TYPES_COUNT];
+	};
+	/**
+	 * Sort orders computed for the current call list, by element and direction.
+	 */
+	std::map<std::pair<CallEntry::eElements, bool>, sSortOrder> sortCache;
+	size_t sortCacheVersion;
+	size_t version;
+	/**
+	 * Statistics on all calls seen since the creation of this object.
+	 */
+	CallStatistics *statistics;
+	/**
+	 * Timestamp of the newest entry added to statistics.
+	 */
+	time_t statisticsWatermark;
+	/**
+	 * Number of entries added per key at statisticsWatermark. The Fritz!Box reports
+	 * minutes only, so equal entries at the watermark may be distinct calls.
+	 */
+	std::unordered_map<std::string, size_t> statisticsAtWatermark;
+	void updateStatistics();
+	/**
+	 * Persistent archive of all calls, if a config dir is set.
+	 */
+	CallArchive *archive;
+	/**
+	 * Entries added by addProvisional(), newest first, and the time they were added.
+	 * They are shown in front of the entries fetched from the Fritz!Box until a fetched
+	 * entry confirms them or PROVISIONAL_TIMEOUT has passed.
+	 */
+	struct sProvisional {
+		CallEntry entry;
+		time_t added;
+	};
+	std::vector<sProvisional> provisionalEntries;
+	static const time_t PROVISIONAL_TIMEOUT = 600;
+	/**
+	 * Serializes reloads and the addition of provisional entries.
+	 */
+	std::mutex updateMutex;
+	/**
+	 * Builds views and indexes for the given entries and makes them the current call list.
+	 * Must be called with updateMutex held.
+	 */
+	void install(CallStore &callList);
+	/**
+	 * Parses the csv call list sent by the Fritz!Box.
+	 */
+	void parse(const std::string &msg, CallStore &callList);
+	/**
+	 * Hash of the last call list sent by the Fritz!Box, to skip parsing if it did not change.
+	 */
+	uint64_t contentHash;
 	time_t lastCall;
 	time_t lastMissedCall;
 	bool valid;
 	static CallList *me;
     CallList();
+	/**
+	 * Must be called with dataMutex held exclusively.
+	 */
+	void countMissedCalls();
+	/**
+	 * Returns the position of the first entry in timeIndex[type] with a timestamp
+	 * not less than (or greater than, if upper is true) the given time.
+	 */
+	size_t findTime(CallEntry::eCallType type, time_t time, bool upper = false) const;
 public:
 	static CallList *GetCallList(bool create = true);
 	/**
@@ -85,19 +313,101 @@ public:
 	static void DeleteCallList();
     virtual ~CallList();
 	void run();
+	/**
+	 * Fetches the call list from the Fritz!Box in a separate thread.
+	 * Entries returned by retrieveEntry() and callsBetween() before this call
+	 * are freed when the new list is installed.
+	 */
 	void reload();
+	/**
+	 * Adds an entry for a call that just ended, without fetching the call list.
+	 * The entry is marked provisional and replaced by the entry of the Fritz!Box
+	 * once a later reload contains it. Statistics and the archive only contain
+	 * entries fetched from the Fritz!Box.
+	 * This is called from the Listener's threads, entries handed out before stay
+	 * valid until the next call of reload().
+	 * @param the entry, e.g., created by CallSessionTracker
+	 */
+	void addProvisional(const CallEntry &ce);
+	/**
+	 * Reloads the call list after the given delay, e.g., when the Fritz!Box has
+	 * written the entry of a call that just ended. Requests made while a reload
+	 * is pending are served by that reload.
+	 * @param the delay
+	 */
+	void reloadLater(std::chrono::seconds delay);
 	bool isValid() { return valid; }
+	/**
+	 * Returns the version of the call list, which is incremented on each reload.
+	 * @return the version of the call list
+	 */
+	size_t getVersion() const { boost::shared_lock<boost::shared_mutex> lock(dataMutex); return version; }
+	/**
+	 * Returns the compact storage of all entries.
+	 * Reading entries from here avoids creating CallEntry objects.
+	 * The store is not modified, updates of the call list install a new one.
+	 * @return the store, entries are in the order sent by the Fritz!Box
+	 */
+	std::shared_ptr<const CallStore> getStore() const { boost::shared_lock<boost::shared_mutex> lock(dataMutex); return entries; }
+	/**
+	 * Returns statistics on all calls.
+	 * New calls are added on each reload, calls that are no longer reported
+	 * by the Fritz!Box are kept.
+	 * @return the statistics
+	 */
+	const CallStatistics &getStatistics() const { return *statistics; }
+	/**
+	 * Returns the archive of all calls ever received from the Fritz!Box.
+	 * New calls are merged into the archive on each reload. The archive is
+	 * stored in the config dir, see Config::SetupConfigDir().
+	 * @return the archive or nullptr, if no config dir is set
+	 */
+	const CallArchive *getArchive() const { return archive; }
 	CallEntry *retrieveEntry(CallEntry::eCallType type, size_t id);
 	size_t getSize(CallEntry::eCallType type);
+	/**
+	 * Returns the number of missed calls newer than the given time, that match
+	 * the MSN filter. The index is binary searched, no entries are scanned.
+	 * @param only calls with timestamp > since are counted
+	 * @return the number of missed calls
+	 */
 	size_t missedCalls(time_t since);
-	time_t getLastCall() { return lastCall; }
-	time_t getLastMissedCall() { return lastMissedCall; }
+	/**
+	 * Returns the number of missed calls on the given local number.
+	 * @param the local number as reported by the Fritz!Box
+	 * @return the number of missed calls
+	 */
+	size_t missedCallsByMsn(const std::string &localNumber) const;
+	/**
+	 * Returns all calls of the given type in the time range [from, to).
+	 * @param start of the time range (inclusive)
+	 * @param end of the time range (exclusive)
+	 * @param the type of calls to return
+	 * @return the matching entries, ordered by ascending timestamp
+	 */
+	std::vector<CallEntry *> callsBetween(time_t from, time_t to, CallEntry::eCallType type = CallEntry::ALL);
+	time_t getLastCall() const { boost::shared_lock<boost::shared_mutex> lock(dataMutex); return lastCall; }
+	time_t getLastMissedCall() const { boost::shared_lock<boost::shared_mutex> lock(dataMutex); return lastMissedCall; }
 	/**
 	 * Sorts the calllist's entries by the given element and in given order.
+	 * All per type lists are sorted. Sort orders are cached until the next reload,
+	 * so switching back to a previous sort order is cheap.
 	 * @param the element used for sorting
 	 * @param true if sort order is ascending, false otherwise
 	 */
 	void sort(CallEntry::eElements element = CallEntry::ELEM_DATE, bool ascending = true);
+	/**
+	 * Converts a call duration as given by the Fritz!Box to seconds.
+	 * @param the duration in format h:mm
+	 * @return the duration in seconds
+	 */
+	static long long ParseDuration(const std::string &duration);
+	/**
+	 * Converts a call duration to the format used by the Fritz!Box.
+	 * @param the duration in seconds
+	 * @return the duration in format h:mm
+	 */
+	static std::string FormatDuration(long long seconds);
 
 };
 
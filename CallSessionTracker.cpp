@@ -0,0 +1,155 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "CallSessionTracker.h"
+
+namespace fritz {
+
+CallSessionTracker::CallSessionTracker(size_t capacity)
+: count{0} {
+	size_t size = 4;
+	while (size < capacity)
+		size <<= 1;
+	slots.resize(size);
+}
+
+size_t CallSessionTracker::home(size_t box, int connId) const {
+	// Fibonacci hashing spreads consecutive connection ids, the box id is mixed in before
+	return (size_t) ((((uint32_t) connId + (uint32_t) box * 0x10001u) * 2654435769u) >> 16) & (slots.size() - 1);
+}
+
+size_t CallSessionTracker::findSlot(size_t box, int connId) const {
+	size_t mask = slots.size() - 1;
+	size_t slot = home(box, connId);
+	while (slots[slot].used && (slots[slot].session.connId != connId || slots[slot].session.box != box))
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+void CallSessionTracker::grow() {
+	std::vector<sSlot> old(slots.size() * 2);
+	old.swap(slots);
+	for (sSlot &s : old)
+		if (s.used) {
+			size_t slot = findSlot(s.session.box, s.session.connId);
+			slots[slot].used = true;
+			std::swap(slots[slot].session, s.session);
+		}
+}
+
+void CallSessionTracker::erase(size_t slot) {
+	// shift following entries back, so that lookups need no tombstones
+	size_t mask = slots.size() - 1;
+	size_t next = (slot + 1) & mask;
+	while (slots[next].used) {
+		size_t wanted = home(slots[next].session.box, slots[next].session.connId);
+		// move the entry if its home is not within (slot, next]
+		if (((next - wanted) & mask) >= ((next - slot) & mask)) {
+			std::swap(slots[slot].session, slots[next].session);
+			slot = next;
+		}
+		next = (next + 1) & mask;
+	}
+	slots[slot].used = false;
+	slots[slot].session = CallSession();
+	count--;
+}
+
+void CallSessionTracker::begin(const CallSession &session) {
+	std::lock_guard<std::mutex> lock(mutex);
+	// keep the load factor below 1/2
+	if ((count + 1) * 2 > slots.size())
+		grow();
+	size_t slot = findSlot(session.box, session.connId);
+	if (!slots[slot].used) {
+		slots[slot].used = true;
+		count++;
+	}
+	slots[slot].session = session;
+}
+
+bool CallSessionTracker::connect(int connId, time_t time, size_t box) {
+	std::lock_guard<std::mutex> lock(mutex);
+	sSlot &s = slots[findSlot(box, connId)];
+	if (!s.used)
+		return false;
+	s.session.connected   = true;
+	s.session.connectTime = time;
+	return true;
+}
+
+bool CallSessionTracker::resolve(int connId, const std::string &remoteName, size_t box) {
+	std::lock_guard<std::mutex> lock(mutex);
+	sSlot &s = slots[findSlot(box, connId)];
+	if (!s.used)
+		return false;
+	s.session.remoteName = remoteName;
+	return true;
+}
+
+bool CallSessionTracker::end(int connId, long long duration, CallEntry &entry, size_t box) {
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t slot = findSlot(box, connId);
+	if (!slots[slot].used)
+		return false;
+	entry = ToCallEntry(slots[slot].session, duration);
+	erase(slot);
+	return true;
+}
+
+bool CallSessionTracker::contains(int connId, size_t box) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return slots[findSlot(box, connId)].used;
+}
+
+size_t CallSessionTracker::size() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return count;
+}
+
+CallEntry CallSessionTracker::ToCallEntry(const CallSession &session, long long duration) {
+	CallEntry ce;
+	if (session.outgoing)
+		ce.type = CallEntry::OUTGOING;
+	else
+		ce.type = session.connected ? CallEntry::INCOMING : CallEntry::MISSED;
+	tm tmCallTime;
+	localtime_r(&session.startTime, &tmCallTime);
+	char buffer[16];
+	strftime(buffer, sizeof(buffer), "%d.%m.%y", &tmCallTime);
+	ce.date = buffer;
+	strftime(buffer, sizeof(buffer), "%H:%M", &tmCallTime);
+	ce.time = buffer;
+	// same conversion as done when parsing the call list of the Fritz!Box
+	tmCallTime.tm_sec   = 0;
+	tmCallTime.tm_isdst = 0;
+	ce.timestamp = mktime(&tmCallTime);
+	ce.remoteNumber = session.remoteNumber;
+	ce.remoteName   = session.remoteName.size() ? session.remoteName : session.remoteNumber;
+	ce.localName    = session.medium;
+	ce.localNumber  = session.localNumber;
+	// the Fritz!Box rounds started minutes up
+	ce.duration     = CallList::FormatDuration(session.connected ? (duration + 59) / 60 * 60 : 0);
+	ce.provisional  = true;
+	return ce;
+}
+
+}
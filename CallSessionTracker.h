@@ -0,0 +1,121 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef CALLSESSIONTRACKER_H
+#define CALLSESSIONTRACKER_H
+
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CallList.h"
+
+namespace fritz {
+
+/**
+ * A call in progress, as seen by the call monitor.
+ */
+class CallSession {
+public:
+	size_t box;                  // id of the box, see Listener::AddBox()
+	int connId;
+	bool outgoing;
+	bool connected;
+	time_t startTime;            // time of the CALL or RING event
+	time_t connectTime;          // time of the CONNECT event, 0 if not connected
+	std::string remoteNumber;
+	std::string remoteName;      // the result of the reverse lookup
+	std::string localNumber;
+	std::string medium;
+	CallSession() : box{0}, connId{0}, outgoing{false}, connected{false}, startTime{0}, connectTime{0} {}
+};
+
+/**
+ * Follows the calls in progress by their box and connection id and turns them
+ * into call list entries when they end.
+ * The sessions are kept in a flat hash map with open addressing, as there are
+ * only few calls in progress at a time. All methods are thread safe.
+ */
+class CallSessionTracker {
+private:
+	struct sSlot {
+		bool used;
+		CallSession session;
+		sSlot() : used{false} {}
+	};
+	std::vector<sSlot> slots;        // size is a power of two
+	size_t count;
+	mutable std::mutex mutex;
+	size_t home(size_t box, int connId) const;
+	/**
+	 * Returns the slot of the given connection or the free slot where it belongs.
+	 */
+	size_t findSlot(size_t box, int connId) const;
+	void grow();
+	void erase(size_t slot);
+public:
+	CallSessionTracker(size_t capacity = 16);
+	/**
+	 * Starts a session on CALL or RING. An existing session with the same box and id is replaced.
+	 * @param the new session
+	 */
+	void begin(const CallSession &session);
+	/**
+	 * Marks a session as connected on CONNECT.
+	 * @param the connection id
+	 * @param the time of the event
+	 * @param the id of the box
+	 * @return false, if there is no such session
+	 */
+	bool connect(int connId, time_t time, size_t box = 0);
+	/**
+	 * Updates the remote name of a session, after a late reverse lookup.
+	 * @param the connection id
+	 * @param the name
+	 * @param the id of the box
+	 * @return false, if there is no such session
+	 */
+	bool resolve(int connId, const std::string &remoteName, size_t box = 0);
+	/**
+	 * Ends a session on DISCONNECT and creates the call list entry.
+	 * @param the connection id
+	 * @param the duration of the call in seconds, as sent with the event
+	 * @param set to the entry describing the call
+	 * @param the id of the box
+	 * @return false, if there is no such session
+	 */
+	bool end(int connId, long long duration, CallEntry &entry, size_t box = 0);
+	bool contains(int connId, size_t box = 0) const;
+	size_t size() const;
+	/**
+	 * Creates the call list entry for a session, formatted like the ones sent by the Fritz!Box.
+	 * @param the session
+	 * @param the duration of the call in seconds
+	 * @return the entry
+	 */
+	static CallEntry ToCallEntry(const CallSession &session, long long duration);
+};
+
+}
+
+#endif /* CALLSESSIONTRACKER_H */
@@ -0,0 +1,147 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "CallStatistics.h"
+
+#include <cstdlib>
+
+#include "Tools.h"
+
+namespace fritz {
+
+CallStatistics::CallStatistics(size_t topCount)
+: topCount{topCount} {
+	clear();
+}
+
+void CallStatistics::clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t type = 0; type < CallEntry::TYPES_COUNT; type++)
+		calls[type] = 0;
+	for (size_t hour = 0; hour < 24; hour++)
+		callsPerHour[hour] = 0;
+	talkTime = 0;
+	numbers.clear();
+	topCallers.clear();
+}
+
+void CallStatistics::ingest(const CallEntry &ce) {
+	long long duration = CallList::ParseDuration(ce.duration);
+	// time: hh:mm
+	size_t hour = atoi(ce.time.c_str());
+	std::string number = ce.remoteNumber.size() ? Tools::NormalizeNumber(ce.remoteNumber) : "";
+
+	std::lock_guard<std::mutex> lock(mutex);
+	calls[CallEntry::ALL]++;
+	if (ce.type > CallEntry::ALL && ce.type < CallEntry::TYPES_COUNT)
+		calls[ce.type]++;
+	if (hour < 24)
+		callsPerHour[hour]++;
+	if (ce.type != CallEntry::MISSED)
+		talkTime += duration;
+	// calls with suppressed number are not tracked per number
+	if (number.empty())
+		return;
+	auto it = numbers.find(number);
+	if (it == numbers.end())
+		it = numbers.insert(std::make_pair(number, sNumberStatistics{0, 0, 0, 0})).first;
+	sNumberStatistics &ns = it->second;
+	ns.calls++;
+	if (ce.type == CallEntry::MISSED)
+		ns.missedCalls++;
+	else
+		ns.talkTime += duration;
+	if (ns.lastCall < ce.timestamp)
+		ns.lastCall = ce.timestamp;
+	updateTopCallers(number, ns.calls);
+}
+
+void CallStatistics::updateTopCallers(const std::string &number, size_t count) {
+	size_t pos = 0;
+	while (pos < topCallers.size() && topCallers[pos].first != number)
+		pos++;
+	if (pos == topCallers.size()) {
+		// not yet in the list, count is one more than before, so it may replace the last one
+		if (topCallers.size() < topCount)
+			topCallers.push_back(std::make_pair(number, count));
+		else if (topCount && topCallers.back().second < count)
+			topCallers.back() = std::make_pair(number, count);
+		else
+			return;
+		pos = topCallers.size() - 1;
+	} else {
+		topCallers[pos].second = count;
+	}
+	// keep the list ordered
+	while (pos > 0 && topCallers[pos-1].second < topCallers[pos].second) {
+		std::swap(topCallers[pos-1], topCallers[pos]);
+		pos--;
+	}
+}
+
+size_t CallStatistics::getCalls(CallEntry::eCallType type) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return type < CallEntry::TYPES_COUNT ? calls[type] : 0;
+}
+
+long long CallStatistics::getTalkTime() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return talkTime;
+}
+
+double CallStatistics::getMissedCallRate() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t incoming = calls[CallEntry::INCOMING] + calls[CallEntry::MISSED];
+	return incoming ? (double) calls[CallEntry::MISSED] / incoming : 0.0;
+}
+
+size_t CallStatistics::getCallsPerHour(size_t hour) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return hour < 24 ? callsPerHour[hour] : 0;
+}
+
+size_t CallStatistics::getBusiestHour() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t busiest = 0;
+	for (size_t hour = 1; hour < 24; hour++)
+		if (callsPerHour[hour] > callsPerHour[busiest])
+			busiest = hour;
+	return busiest;
+}
+
+bool CallStatistics::getNumberStatistics(const std::string &number, sNumberStatistics &statistics) const {
+	if (number.empty())
+		return false;
+	std::string normalized = Tools::NormalizeNumber(number);
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = numbers.find(normalized);
+	if (it == numbers.end())
+		return false;
+	statistics = it->second;
+	return true;
+}
+
+std::vector<std::pair<std::string, size_t>> CallStatistics::getTopCallers() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return topCallers;
+}
+
+}
@@ -0,0 +1,119 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef CALLSTATISTICS_H
+#define CALLSTATISTICS_H
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "CallList.h"
+
+namespace fritz {
+
+/**
+ * Statistics on calls, maintained incrementally.
+ * Each call is added once using ingest(), all statistics are updated on the
+ * fly, so reading them does not require walking the call list.
+ */
+class CallStatistics {
+public:
+	struct sNumberStatistics {
+		size_t calls;                               // number of calls from and to this number
+		size_t missedCalls;                         // number of missed calls from this number
+		long long talkTime;                         // accumulated call duration in seconds
+		time_t lastCall;                            // time of the most recent call
+	};
+private:
+	mutable std::mutex mutex;
+	size_t topCount;
+	size_t calls[CallEntry::TYPES_COUNT];
+	size_t callsPerHour[24];
+	long long talkTime;
+	std::unordered_map<std::string, sNumberStatistics> numbers;
+	/**
+	 * The numbers with the most calls, ordered by descending call count.
+	 * As counts only grow, this list is exact and updated in O(topCount).
+	 */
+	std::vector<std::pair<std::string, size_t>> topCallers;
+	void updateTopCallers(const std::string &number, size_t count);
+public:
+	/**
+	 * Constructs an empty statistics object.
+	 * @param the number of callers tracked by getTopCallers()
+	 */
+	explicit CallStatistics(size_t topCount = 10);
+	/**
+	 * Adds a call to the statistics.
+	 * @param the call entry
+	 */
+	void ingest(const CallEntry &ce);
+	/**
+	 * Resets all statistics.
+	 */
+	void clear();
+	/**
+	 * Returns the number of calls of the given type.
+	 * @param the call type, CallEntry::ALL returns the total number of calls
+	 * @return the number of calls
+	 */
+	size_t getCalls(CallEntry::eCallType type = CallEntry::ALL) const;
+	/**
+	 * Returns the accumulated duration of all incoming and outgoing calls.
+	 * @return the talk time in seconds
+	 */
+	long long getTalkTime() const;
+	/**
+	 * Returns the share of missed calls among all incoming calls.
+	 * @return the missed call rate between 0 and 1
+	 */
+	double getMissedCallRate() const;
+	/**
+	 * Returns the number of calls started in the given hour of the day.
+	 * @param the hour, 0 to 23
+	 * @return the number of calls
+	 */
+	size_t getCallsPerHour(size_t hour) const;
+	/**
+	 * Returns the hour of the day with the most calls.
+	 * @return the hour, 0 to 23
+	 */
+	size_t getBusiestHour() const;
+	/**
+	 * Returns the statistics for a single number.
+	 * @param the remote number
+	 * @param set to the statistics of this number, if available
+	 * @return true, if calls from or to this number are known
+	 */
+	bool getNumberStatistics(const std::string &number, sNumberStatistics &statistics) const;
+	/**
+	 * Returns the remote numbers with the most calls.
+	 * @return pairs of normalized number and call count, ordered by descending call count
+	 */
+	std::vector<std::pair<std::string, size_t>> getTopCallers() const;
+};
+
+}
+
+#endif /* CALLSTATISTICS_H */
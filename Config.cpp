@@ -24,6 +24,7 @@
 #include "CallList.h"
 #include "FonbookManager.h"
 #include "Listener.h"
+#include "SessionManager.h"
 #include <liblog++/Log.h>
 #include "Tools.h"
 
@@ -33,6 +34,8 @@ Config* gConfig = nullptr;
 
 void Config::Setup(std::string hostname, std::string username, std::string password, bool logPersonalInfo) {
 
+	// the session belongs to the previous box
+	SessionManager::DeleteSessionManager();
 	if (gConfig)
 		delete gConfig;
     gConfig = new Config( hostname, username, password);
@@ -67,9 +70,13 @@ bool Config::Init(bool *locationSettingsDetected, std::string *countryCode, std:
 }
 
 bool Config::Shutdown() {
+	// stop waiting for retries first, threads joined below might be waiting
+	if (gConfig)
+		gConfig->shutdownToken.cancel();
 	fritz::Listener::DeleteListener();
 	fritz::FonbookManager::DeleteFonbookManager();
 	fritz::CallList::DeleteCallList();
+	fritz::SessionManager::DeleteSessionManager();
 	if (gConfig) {
 		delete gConfig;
 		gConfig = nullptr;
@@ -91,6 +98,26 @@ void Config::SetupMsnFilter( std::vector <std::string> vMsn) {
 		gConfig->mConfig.msn = vMsn;
 }
 
+void Config::SetupListenerIdleTimeout( unsigned int idleTimeout) {
+	if (gConfig)
+		gConfig->mConfig.listenerIdleTimeout = idleTimeout;
+}
+
+void Config::SetupMaxBoxRequests( unsigned int maxRequests) {
+	if (gConfig)
+		gConfig->mConfig.maxBoxRequests = maxRequests;
+}
+
+void Config::SetupRetryPolicy(const RetryPolicy &policy) {
+	if (gConfig)
+		gConfig->mConfig.retryPolicy = policy;
+}
+
+void Config::SetupCompression(bool compression) {
+	if (gConfig)
+		gConfig->mConfig.compression = compression;
+}
+
 void Config::SetupConfigDir(std::string dir)
 {
 	if (gConfig)
@@ -103,6 +130,10 @@ Config::Config( std::string url, std::string username, std::string password) {
 	mConfig.password     	= password;
 	mConfig.uiPort       	= 80;
 	mConfig.listenerPort    = 1012;
+	mConfig.listenerIdleTimeout = 0;
+	mConfig.maxBoxRequests  = 2;
+	mConfig.retryPolicy     = RetryPolicy(std::chrono::seconds(RETRY_DELAY), std::chrono::seconds(3600));
+	mConfig.compression     = false;
 	mConfig.upnpPort        = 49000;
 	mConfig.loginType       = UNKNOWN;
 	mConfig.lastRequestTime = 0;
@@ -111,6 +142,7 @@ Config::Config( std::string url, std::string username, std::string password) {
 }
 
 Config::~Config() {
+	shutdownToken.cancel();
 }
 
 }
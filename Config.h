@@ -28,6 +28,7 @@
 #include <vector>
 
 #include "FritzClient.h"
+#include "RetryScheduler.h"
 
 namespace fritz {
 
@@ -55,6 +56,10 @@ private:
 		int uiPort;						                // the port of the fritz box web interface
 		int upnpPort;									// the port of the UPNP server of the fritz box
 		int listenerPort;					            // the port of the fritz box call monitor
+		unsigned int listenerIdleTimeout;               // seconds without data from the call monitor before reconnecting, 0 to disable
+		unsigned int maxBoxRequests;                    // maximum number of concurrent requests to the web interface
+		RetryPolicy retryPolicy;                        // when to retry failed requests to the web interface
+		bool compression;                               // request compressed responses from the web interface
         std::string username;                           // fritz!box web interface username, if applicable
 		std::string password;               			// fritz!box web interface password
 		time_t lastRequestTime;                         // with eLoginType::SID: time of last request sent to fritz box
@@ -69,6 +74,8 @@ private:
 		std::string activeFonbook;						// currently selected Fonbook
 		bool logPersonalInfo;							// log sensitive information like passwords, phone numbers, ...
 	} mConfig;
+	std::mutex sessionMutex;                            // guards the members changed by FritzClient: lang, lastRequestTime, loginType, sid
+	CancellationToken shutdownToken;                    // cancels pending retries on Shutdown()
 
     Config( std::string url, std::string username, std::string password );
 
@@ -96,6 +103,34 @@ public:
 	 * @param the list of MSNs to filter on
 	 */
 	void static SetupMsnFilter( std::vector <std::string> vMsn );
+	/**
+	 * Enables the idle watchdog of the listener.
+	 * The call monitor connection is re-established if no data was received for the given time.
+	 * Dead connections are detected by TCP keepalive anyway, this is a last resort for
+	 * connections that stay open but stop delivering data. Default is no watchdog.
+	 * @param seconds without data, 0 disables the watchdog
+	 */
+	void static SetupListenerIdleTimeout( unsigned int idleTimeout );
+	/**
+	 * Limits the number of requests sent to the web interface of the Fritz!Box at the same time.
+	 * Further requests wait for a free slot. Default is 2.
+	 * @param the maximum number of concurrent requests, 0 for no limit
+	 */
+	void static SetupMaxBoxRequests( unsigned int maxRequests );
+	/**
+	 * Sets up how failed requests to the web interface are retried.
+	 * Default is to retry without limit, starting after RETRY_DELAY seconds and doubling
+	 * the delay up to one hour. Pending retries are canceled by Shutdown().
+	 * @param the retry policy
+	 */
+	void static SetupRetryPolicy( const RetryPolicy &policy );
+	/**
+	 * Sets up whether responses of the web interface are requested with gzip or deflate
+	 * compression. This saves bandwidth with large call lists and phone books on slow
+	 * links, but costs CPU time on the box. Default is false.
+	 * @param true, to request compressed responses
+	 */
+	void static SetupCompression( bool compression );
 	/**
 	 * Sets up a directory for arbitrary data storage.
 	 * This is currently used by local fonbook to persist the fonbook entries to a file.
@@ -118,20 +153,25 @@ public:
 	bool static Shutdown();
 
 	std::string &getConfigDir( )                      { return mConfig.configDir; }
-	std::string &getLang( )                           { return mConfig.lang; }
-	void setLang( std::string l )                     { mConfig.lang = l; }
+	std::string getLang( )                            { std::lock_guard<std::mutex> lock(sessionMutex); return mConfig.lang; }
+	void setLang( std::string l )                     { std::lock_guard<std::mutex> lock(sessionMutex); mConfig.lang = l; }
 	std::string &getUrl( )                            { return mConfig.url; }
 	int getUiPort( )				                  { return mConfig.uiPort; }
 	int getListenerPort( )				              { return mConfig.listenerPort; }
+	unsigned int getListenerIdleTimeout( )            { return mConfig.listenerIdleTimeout; }
+	unsigned int getMaxBoxRequests( )                 { return mConfig.maxBoxRequests; }
+	const RetryPolicy &getRetryPolicy( )              { return mConfig.retryPolicy; }
+	bool useCompression( )                            { return mConfig.compression; }
+	CancellationToken &getShutdownToken( )            { return shutdownToken; }
 	int getUpnpPort( )                                { return mConfig.upnpPort; }
 	std::string &getPassword( )                       { return mConfig.password; }
     std::string &getUsername( )                       { return mConfig.username; }
-	eLoginType getLoginType( )                        { return mConfig.loginType; }
-	void setLoginType(eLoginType type)                { mConfig.loginType = type; }
-	time_t getLastRequestTime()                       { return mConfig.lastRequestTime; }
-	void updateLastRequestTime()                      { mConfig.lastRequestTime = time(nullptr); }
-	std::string &getSid( )                            { return mConfig.sid; }
-	void setSid(std::string sid)                      { mConfig.sid = sid; }
+	eLoginType getLoginType( )                        { std::lock_guard<std::mutex> lock(sessionMutex); return mConfig.loginType; }
+	void setLoginType(eLoginType type)                { std::lock_guard<std::mutex> lock(sessionMutex); mConfig.loginType = type; }
+	time_t getLastRequestTime()                       { std::lock_guard<std::mutex> lock(sessionMutex); return mConfig.lastRequestTime; }
+	void updateLastRequestTime()                      { std::lock_guard<std::mutex> lock(sessionMutex); mConfig.lastRequestTime = time(nullptr); }
+	std::string getSid( )                             { std::lock_guard<std::mutex> lock(sessionMutex); return mConfig.sid; }
+	void setSid(std::string sid)                      { std::lock_guard<std::mutex> lock(sessionMutex); mConfig.sid = sid; }
 	std::string &getCountryCode( )        	          { return mConfig.countryCode; }
 	void setCountryCode( std::string cc )             { mConfig.countryCode = cc; }
 	std::string &getRegionCode( )                     { return mConfig.regionCode; }
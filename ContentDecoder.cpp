@@ -0,0 +1,94 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "ContentDecoder.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace fritz {
+
+bool ContentDecoder::IsSupported(const std::string &encoding) {
+	return encoding == "gzip" || encoding == "x-gzip" || encoding == "deflate";
+}
+
+ContentDecoder::ContentDecoder(const std::string &encoding, const HttpConnection::sink_t &sink)
+: sink{sink}, output(16384), raw{false}, started{false}, ended{false} {
+	if (!IsSupported(encoding))
+		throw std::runtime_error("unsupported content encoding " + encoding);
+	// + 32 detects gzip and zlib headers automatically
+	init(MAX_WBITS + 32);
+}
+
+ContentDecoder::~ContentDecoder() {
+	inflateEnd(&stream);
+}
+
+void ContentDecoder::init(int windowBits) {
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit2(&stream, windowBits) != Z_OK)
+		throw std::runtime_error("could not initialize zlib");
+}
+
+bool ContentDecoder::decode(const char *data, size_t length) {
+	stream.next_in  = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+	stream.avail_in = length;
+	while (stream.avail_in > 0 && !ended) {
+		stream.next_out  = reinterpret_cast<Bytef *>(output.data());
+		stream.avail_out = output.size();
+		int result = inflate(&stream, Z_NO_FLUSH);
+		if (result == Z_DATA_ERROR && !raw && !started)
+			return false;
+		if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+			throw std::runtime_error(std::string("corrupt compressed body: ") + (stream.msg ? stream.msg : "unknown error"));
+		size_t produced = output.size() - stream.avail_out;
+		if (produced) {
+			started = true;
+			sink(output.data(), produced);
+		}
+		ended = result == Z_STREAM_END;
+		if (result == Z_BUF_ERROR && produced == 0)
+			break;
+	}
+	return true;
+}
+
+void ContentDecoder::write(const char *data, size_t length) {
+	// kept until the header is checked, to start again if it turns out to be raw deflate
+	if (!raw && !started)
+		received.append(data, length);
+	if (!decode(data, length)) {
+		// "deflate" without the zlib header
+		inflateEnd(&stream);
+		raw = true;
+		init(-MAX_WBITS);
+		decode(received.data(), received.size());
+	}
+	if (started)
+		std::string().swap(received);
+}
+
+void ContentDecoder::finish() {
+	if (!ended)
+		throw std::runtime_error("compressed body ended early");
+}
+
+}
@@ -0,0 +1,77 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef CONTENTDECODER_H
+#define CONTENTDECODER_H
+
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "HttpConnection.h"
+
+namespace fritz {
+
+/**
+ * Decompresses an HTTP body with Content-Encoding gzip or deflate piece by piece,
+ * passing the decompressed data on to a sink.
+ */
+class ContentDecoder {
+private:
+	HttpConnection::sink_t sink;
+	z_stream stream;
+	std::vector<char> output;
+	std::string received;            // input, until the first output was produced
+	bool raw;                        // deflate data without zlib header, as sent by some servers
+	bool started;                    // output was produced
+	bool ended;
+	void init(int windowBits);
+	/**
+	 * @return false, if the data has no valid zlib or gzip header
+	 */
+	bool decode(const char *data, size_t length);
+public:
+	/**
+	 * @param the content encoding, gzip, x-gzip or deflate
+	 * @param the receiver of the decompressed data
+	 * @throws std::runtime_error if the encoding is not supported
+	 */
+	ContentDecoder(const std::string &encoding, const HttpConnection::sink_t &sink);
+	virtual ~ContentDecoder();
+	/**
+	 * Decompresses the next piece of the body.
+	 * @throws std::runtime_error if the data is corrupt
+	 */
+	void write(const char *data, size_t length);
+	/**
+	 * Checks that the complete body was received.
+	 * @throws std::runtime_error if the body ended early
+	 */
+	void finish();
+	/**
+	 * Returns whether the given content encoding can be decoded.
+	 */
+	static bool IsSupported(const std::string &encoding);
+};
+
+}
+
+#endif /* CONTENTDECODER_H */
@@ -199,6 +199,12 @@ public:
 	 * @return resolved name and type or the number, if unsuccessful
 	 */
 	virtual sResolveResult resolveToName(std::string number);
+	/**
+	 * Resolves the number given to the corresponding name without costly lookups, e.g., via HTTP.
+	 * @param number to resolve
+	 * @return resolved name and type or the number, if unsuccessful
+	 */
+	virtual sResolveResult resolveToNameLocally(std::string number) { return resolveToName(number); }
 	/**
 	 * Returns a specific telephonebook entry.
 	 * @param id unique identifier of the requested entry
@@ -26,6 +26,7 @@
 
 #include "Config.h"
 #include "FritzFonbook.h"
+#include "LatencyHistogram.h"
 #include "LocalFonbook.h"
 #include "Nummerzoeker.h"
 #include "OertlichesFonbook.h"
@@ -152,7 +153,9 @@ void FonbookManager::nextFonbook() {
 Fonbook::sResolveResult FonbookManager::resolveToName(std::string number) {
 	sResolveResult result(number);
 	for (auto id  : gConfig->getFonbookIDs()) {
+		uint64_t start = PipelineLatency::Now();
 		result = fonbooks[id]->resolveToName(number);
+		PipelineLatency::Get().recordFonbook(id, PipelineLatency::Now() - start);
 		DBG("ResolveToName: " << id << " " << (gConfig->logPersonalInfo() ? result.name : HIDDEN));
 		if (result.successful)
 			return result;
@@ -160,6 +163,16 @@ Fonbook::sResolveResult FonbookManager::resolveToName(std::string number) {
 	return result;
 }
 
+Fonbook::sResolveResult FonbookManager::resolveToNameLocally(std::string number) {
+	sResolveResult result(number);
+	for (auto id  : gConfig->getFonbookIDs()) {
+		result = fonbooks[id]->resolveToNameLocally(number);
+		if (result.successful)
+			return result;
+	}
+	return result;
+}
+
 Fonbook *FonbookManager::getActiveFonbook() const {
 	if (activeFonbookPos == std::string::npos) {
 		return nullptr;
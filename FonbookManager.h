@@ -76,6 +76,12 @@ public:
 	 * @return resolved name and type or the number, if unsuccessful
 	 */
 	sResolveResult resolveToName(std::string number) override;
+	/**
+	 * Resolves the number given to the corresponding name, skipping costly lookups.
+	 * @param number to resolve
+	 * @return resolved name and type or the number, if unsuccessful
+	 */
+	sResolveResult resolveToNameLocally(std::string number) override;
 	/**
 	 * Returns a specific telephonebook entry.
 	 * @param id unique identifier of the requested entry
@@ -21,225 +21,59 @@
 
 #include "FritzClient.h"
 
-#include <cstring>
-#include <iomanip>
-#include <gcrypt.h>
-
 #include "Config.h"
+#include "RetryScheduler.h"
+#include "SessionManager.h"
 #include "Tools.h"
 #include <liblog++/Log.h>
 #include <libconv++/CharsetConverter.h>
 
-#define RETRY_BEGIN                                  \
-    	unsigned int retry_delay = RETRY_DELAY / 2;  \
-		bool dataRead = false;                       \
-		do {  				                         \
-			try {                                    \
-				validPassword = login();                             \
-				retry_delay = retry_delay > 1800 ? 3600 : retry_delay * 2;
-
-#define RETRY_END																							\
-			dataRead = true;                                                                                \
-		} catch (std::runtime_error &re) {																\
-			ERR("Exception in connection to " << gConfig->getUrl() << " - " << re.what());								\
-			ERR("waiting " << retry_delay << " seconds before retrying");	\
-			sleep(retry_delay); /* delay a possible retry */												\
-		}																									\
-	} while (!dataRead);
-
 namespace fritz {
 
-std::mutex* FritzClient::mutex = new std::mutex();
+std::mutex FritzClient::langMutex;
 
 FritzClient::FritzClient()
-: httpClient{gConfig->getUrl(), gConfig->getUiPort()} {
+: session{SessionManager::GetSessionManager()}, httpClient{gConfig->getUrl(), gConfig->getUiPort(), gConfig->getMaxBoxRequests()},
+  cancellation{gConfig->getShutdownToken()} {
 	validPassword = false;
-	mutex->lock();
-	// init libgcrypt
-	gcry_check_version (nullptr);
-    // disable secure memory
-    gcry_control (GCRYCTL_DISABLE_SECMEM, 0);
-    gcry_control (GCRYCTL_INITIALIZATION_FINISHED, 0);
+	httpClient.setCompression(gConfig->useCompression());
     // init HttpClient
     soapClient = new network::SoapClient(gConfig->getUrl(), gConfig->getUpnpPort());
 }
 
 FritzClient::~FritzClient() {
-	mutex->unlock();
-}
-
-std::string FritzClient::calculateLoginResponse(std::string challenge) {
-	std::string challengePwd = challenge + '-' + gConfig->getPassword();
-	// the box needs an md5 sum of the string "challenge-password"
-	// to make things worse, it needs this in UTF-16LE character set
-	// last but not least, for "compatibility" reasons (*LOL*) we have to replace
-	// every char > "0xFF 0x00" with "0x2e 0x00"
-	convert::CharsetConverter conv("", "UTF-16LE");
-	char challengePwdConv[challengePwd.length()*2];
-	memcpy(challengePwdConv, conv.convert(challengePwd).c_str(), challengePwd.length()*2);
-	for (size_t pos=1; pos < challengePwd.length()*2; pos+= 2)
-		if (challengePwdConv[pos] != 0x00) {
-			challengePwdConv[pos] = 0x00;
-			challengePwdConv[pos-1] = 0x2e;
-		}
-	unsigned char hash[16];
-	gcry_md_hash_buffer(GCRY_MD_MD5, hash, (const char*)challengePwdConv, challengePwd.length()*2);
-	std::stringstream response;
-	response << challenge << '-';
-	for (size_t pos=0; pos < 16; pos++)
-		response << std::hex << std::setfill('0') << std::setw(2) << (unsigned int)hash[pos];
-	return response.str();
-}
-
-std::string FritzClient::urlEncode(const std::string &s_input) {
-	std::string result;
-	std::string s;
-	std::string hex = "0123456789abcdef";
-	convert::CharsetConverter conv("", "ISO-8859-15");
-	s = conv.convert(s_input);
-	for (unsigned int i=0; i<s.length(); i++) {
-		if( ('a' <= s[i] && s[i] <= 'z')
-				|| ('A' <= s[i] && s[i] <= 'Z')
-				|| ('0' <= s[i] && s[i] <= '9') ) {
-			result += s[i];
-		} else {
-			result += '%';
-			result += hex[(unsigned char) s[i] >> 4];
-			result += hex[(unsigned char) s[i] & 0x0f];
-		}
-	}
-	return result;
+	delete soapClient;
 }
 
 bool FritzClient::login() {
-	// when using SIDs, a new login is only needed if the last request was more than 5 minutes ago
-	if ((gConfig->getLoginType() == Config::SID || gConfig->getLoginType() == Config::LUA) && (time(nullptr) - gConfig->getLastRequestTime() < 300)) {
-		return true;
-	}
-
-	// detect type of login once
-	std::string sXml; // sXml is used twice!
-	if (gConfig->getLoginType() == Config::UNKNOWN || gConfig->getLoginType() == Config::SID || gConfig->getLoginType() == Config::LUA) {
-		// detect if this Fritz!Box uses SIDs
-		DBG("requesting login_sid.lua from Fritz!Box.");
-		// might return 404 with older fw-versions, our httpClient throws a SockeException for this, catched here
-		try {
-		  sXml = httpClient.get("/login_sid.lua", {{"sid", gConfig->getSid()}});
-		} catch (std::runtime_error &re) {}
-		if (sXml.find("<Rights") != std::string::npos)
-			gConfig->setLoginType(Config::LUA);
-		else {
-			DBG("requesting login_sid.xml from Fritz!Box.");
-			sXml = httpClient.get("/cgi-bin/webcm", {{"getpage", "../html/login_sid.xml"}});
-			if (sXml.find("<iswriteaccess>") != std::string::npos)
-				gConfig->setLoginType(Config::SID);
-			else
-				gConfig->setLoginType(Config::PASSWORD);
-		}
-	}
-
-	if (gConfig->getLoginType() == Config::SID || gConfig->getLoginType() == Config::LUA) {
-		std::stringstream loginPath;
-		if (gConfig->getLoginType() == Config::LUA) {
-			loginPath << "/login_sid.lua";
-		} else {
-			loginPath << "/cgi-bin/webcm";
-		}
-		// check if no password is needed (SID is directly available)
-		size_t sidStart = sXml.find("<SID>");
-		if (sidStart == std::string::npos) {
-			ERR("Error - Expected field <SID> not found in login_sid.xml or login_sid.lua.");
-			return false;
-		}
-		sidStart += 5;
-		std::string sid = sXml.substr(sidStart, 16);
-		if (sid.compare("0000000000000000") != 0) {
-			// save SID
-			DBG("SID is still valid - all ok.");
-			gConfig->setSid(sid);
-			gConfig->updateLastRequestTime();
-			return true;
-		} else {
-			DBG("We need to log in.");
-			// generate response out of challenge and password
-			size_t challengeStart = sXml.find("<Challenge>");
-			if (challengeStart == std::string::npos) {
-				ERR("Error - Expected <Challenge> not found in login_sid.xml or login_sid.lua.");
-				return false;
-			}
-			challengeStart += 11;
-			size_t challengeStop = sXml.find("<", challengeStart);
-            std::string challenge = sXml.substr(challengeStart, challengeStop - challengeStart);
-            std::string response = calculateLoginResponse(challenge);
-            // send response to box
-			std::string sMsg;
-
-			network::HttpClient::param_t postdata;
-			if (gConfig->getLoginType() == Config::SID)
-				postdata = {{"login:command/response", response},
-				            {"getpage", "../html/de/menus/menu2.html"}};
-			else
-                postdata = {{"username", gConfig->getUsername()}, {"response", response }};
-
-            DBG("Sending login request "
-             << ( gConfig->getUsername().size() ? "for user " : "" )
-             << gConfig->getUsername() << "...");
+	return session->login();
+}
 
-            sMsg = httpClient.post(loginPath.str(), postdata);
-			size_t sidStart, sidStop;
-			if (gConfig->getLoginType() == Config::SID) {
-				sidStart = sMsg.find("name=\"sid\"");
-				if (sidStart == std::string::npos) {
-					ERR("Error - Expected sid field not found.");
-					return false;
-				}
-				sidStart = sMsg.find("value=\"", sidStart + 10) + 7;
-				sidStop = sMsg.find("\"", sidStart);
-			} else {
-				sidStart = sMsg.find("<SID>");
-				if (sidStart == std::string::npos) {
-					ERR("Error - Expected sid field not found.");
-					return false;
-				}
-				sidStart += 5;
-				sidStop = sMsg.find("</SID>");
-			}
-			// save SID
-			gConfig->setSid(sMsg.substr(sidStart, sidStop-sidStart));
-			if (gConfig->getSid().compare("0000000000000000") != 0) {
-				DBG("login successful.");
-				gConfig->updateLastRequestTime();
-				return true;
-			} else {
-				ERR("login failed, check your password settings!.");
-				return false;
+std::string FritzClient::retry(std::function<std::string()> request) {
+	// all attempts run in this thread, so request may refer to the locals of the caller
+	try {
+		return RetryScheduler::Get().retry<std::string>([this, request]() {
+			validPassword = login();
+			try {
+				return request();
+			} catch (HttpError &he) {
+				// the box does not accept the SID anymore, log in again with the next attempt
+				if (he.getStatus() == 403)
+					session->invalidate();
+				throw;
 			}
-		}
-	}
-	if (gConfig->getLoginType() == Config::PASSWORD) {
-		DBG("logging into fritz box using old scheme without SIDs.");
-		// no password, no login
-		if ( gConfig->getPassword().length() == 0)
-			return true; //TODO: check if box really doesn't need a password
-
-		std::string sMsg;
-
-		sMsg = httpClient.post("/cgi-bin/webcm",
-				               {{"login:command/password", urlEncode(gConfig->getPassword())}});
-
-		// determine if login was successful
-		if (sMsg.find("class=\"errorMessage\"") != std::string::npos) {
-			ERR("login failed, check your password settings.");
-			return false;
-		}
-		DBG("login successful.");
-		return true;
+		}, gConfig->getRetryPolicy(), cancellation, "connection to " + gConfig->getUrl());
+	} catch (std::runtime_error &re) {
+		ERR("request to " << gConfig->getUrl() << " failed - " << re.what());
+		return "";
 	}
-	return false;
 }
 
 std::string FritzClient::getLang() {
 	if ( gConfig && gConfig->getLang().size() == 0) {
+		std::lock_guard<std::mutex> lock(langMutex);
+		if (gConfig->getLang().size())
+			return gConfig->getLang();
 		std::vector<std::string> langs;
 		langs.push_back("en");
 		langs.push_back("de");
@@ -253,6 +87,7 @@ std::string FritzClient::getLang() {
 					});
 			if (sMsg.find("<html>") != std::string::npos) {
 				gConfig->setLang(lang);
+				session->getProfile().setLang(lang);
 				DBG("interface language is " << gConfig->getLang().c_str());
 				return gConfig->getLang();
 			}
@@ -271,7 +106,7 @@ bool FritzClient::initCall(std::string &number) {
 		return false;
 	try {
 		INF("sending call init request " << (gConfig->logPersonalInfo() ? number.c_str() : HIDDEN));
-		network::HttpClient::param_t params =
+		PooledHttpClient::param_t params =
 		{
 	      { "getpage", "../html/" + getLang() + "/menus/menu2.html" },
 		  { "var%3Apagename", "fonbuch" },
@@ -288,17 +123,41 @@ bool FritzClient::initCall(std::string &number) {
 	return true;
 }
 
+bool FritzClient::requestLua(std::function<bool()> request) {
+	if (!request()) {
+		// most likely the login page, log in again right away
+		DBG("unexpected answer, renewing session...");
+		session->invalidate();
+		validPassword = login();
+		if (!validPassword || !request())
+			return false;
+	}
+	session->touch();
+	return true;
+}
+
 std::string FritzClient::requestLocationSettings() {
 	std::string msg;
+	BoxProfile &profile = session->getProfile();
 
-	RETRY_BEGIN {
-		if (gConfig->getSid().size()) {
+	return retry([&]() -> std::string {
+		bool luaFailed = false;
+		if (gConfig->getSid().size() && profile.getSupport(BoxProfile::LOCATION_SETTINGS_LUA) != BoxProfile::UNSUPPORTED) {
 			DBG("Looking up Phone Settings (using lua)...");
 			try {
-				msg = httpClient.get("/fon_num/sip_option.lua", {{"sid", gConfig->getSid()}});
-			} catch (std::runtime_error &re) {}
-			if (msg.find("<!-- pagename:/fon_num/sip_option.lua-->") != std::string::npos)
-				return msg;
+				if (requestLua([&]() {
+					msg = httpClient.get("/fon_num/sip_option.lua", {{"sid", gConfig->getSid()}});
+					return msg.find("<!-- pagename:/fon_num/sip_option.lua-->") != std::string::npos;
+				})) {
+					profile.setSupport(BoxProfile::LOCATION_SETTINGS_LUA, BoxProfile::SUPPORTED);
+					return msg;
+				}
+			} catch (HttpError &he) {
+				// only a missing page tells that the box has no lua interface
+				if (he.getStatus() != 404)
+					throw;
+				luaFailed = true;
+			}
 			DBG("failed.");
 		}
 
@@ -311,21 +170,35 @@ std::string FritzClient::requestLocationSettings() {
 						{ "var%3Amenu", "fon" },
 						{ "sid", gConfig->getSid() },
 				});
-	} RETRY_END
-	return msg;
+		// the box answered, so lua is not available indeed
+		if (luaFailed)
+			profile.setSupport(BoxProfile::LOCATION_SETTINGS_LUA, BoxProfile::UNSUPPORTED);
+		return msg;
+	});
 }
 
 std::string FritzClient::requestSipSettings() {
 	std::string msg;
+	BoxProfile &profile = session->getProfile();
 
-	RETRY_BEGIN {
-		if (gConfig->getSid().size()) {
+	return retry([&]() -> std::string {
+		bool luaFailed = false;
+		if (gConfig->getSid().size() && profile.getSupport(BoxProfile::SIP_SETTINGS_LUA) != BoxProfile::UNSUPPORTED) {
 			DBG("Looking up SIP Settings (using lua)...");
 			try {
-				msg = httpClient.get("/fon_num/fon_num_list.lua", {{"sid", gConfig->getSid()}});
-			} catch (std::runtime_error &re) {}
-			if (msg.find("<!-- pagename:/fon_num/fon_num_list.lua-->") != std::string::npos)
-				return msg;
+				if (requestLua([&]() {
+					msg = httpClient.get("/fon_num/fon_num_list.lua", {{"sid", gConfig->getSid()}});
+					return msg.find("<!-- pagename:/fon_num/fon_num_list.lua-->") != std::string::npos;
+				})) {
+					profile.setSupport(BoxProfile::SIP_SETTINGS_LUA, BoxProfile::SUPPORTED);
+					return msg;
+				}
+			} catch (HttpError &he) {
+				// only a missing page tells that the box has no lua interface
+				if (he.getStatus() != 404)
+					throw;
+				luaFailed = true;
+			}
 			DBG("failed.");
 		}
 
@@ -338,18 +211,96 @@ std::string FritzClient::requestSipSettings() {
 						{ "var%3Amenu", "fon" },
 						{ "sid", gConfig->getSid() },
 				});
-	} RETRY_END
-	return msg;
+		if (luaFailed)
+			profile.setSupport(BoxProfile::SIP_SETTINGS_LUA, BoxProfile::UNSUPPORTED);
+		return msg;
+	});
 }
 
+/**
+ * Passes a response body on to a sink, as soon as its beginning is known to contain a marker.
+ * Bodies without the marker in the first WINDOW bytes are dropped.
+ */
+class MarkedSink {
+private:
+	static const size_t WINDOW = 1024;
+	std::string marker;
+	const FritzClient::sink_t &sink;
+	std::string start;       // beginning of the body, until the marker is found
+	bool decided;
+	bool found;
+public:
+	MarkedSink(const std::string &marker, const FritzClient::sink_t &sink)
+	: marker{marker}, sink(sink), decided{false}, found{false} { }
+	void operator()(const char *data, size_t length) {
+		if (decided) {
+			if (found)
+				sink(data, length);
+			return;
+		}
+		start.append(data, length);
+		found = start.find(marker) != std::string::npos;
+		decided = found || start.size() >= WINDOW;
+		if (found)
+			sink(start.data(), start.size());
+	}
+	/**
+	 * @return whether the marker was found, so the body is passed on
+	 */
+	bool isFound() const { return found; }
+};
+
 std::string FritzClient::requestCallList () {
-	std::string msg = "";
-	std::string csv = "";
-	RETRY_BEGIN {
-		// now, process call list
+	std::string csv;
+	streamCallList([&csv](const char *data, size_t length) {
+		if (data)
+			csv.append(data, length);
+		else
+			csv.clear();
+	});
+	return csv;
+}
+
+bool FritzClient::streamCallList(const sink_t &sink) {
+	BoxProfile &profile = session->getProfile();
+	bool attempted = false;
+	bool received = false;
+	retry([&]() -> std::string {
+		// a previous attempt may have passed parts of the body
+		if (attempted)
+			sink(nullptr, 0);
+		attempted = true;
+		// new method to request call list (FW >= xx.05.50?)
+		bool luaFailed = false;
+		if (profile.getSupport(BoxProfile::CALL_LIST_LUA) != BoxProfile::UNSUPPORTED) {
+			try {
+				DBG("sending callList request (using lua)...");
+				if (requestLua([&]() {
+					MarkedSink csvSink("Typ;Datum;Name;", sink);
+					httpClient.getStream("/fon_num/foncalls_list.lua",
+							{
+									{ "csv", "" },
+									{ "sid", gConfig->getSid() },
+							}, std::ref(csvSink));
+					return csvSink.isFound();
+				})) {
+					profile.setSupport(BoxProfile::CALL_LIST_LUA, BoxProfile::SUPPORTED);
+					received = true;
+					return "";
+				}
+			} catch (HttpError &he) {
+				// only a missing page tells that the box has no lua interface,
+				// other errors and broken transfers are retried
+				if (he.getStatus() != 404)
+					throw;
+				luaFailed = true;
+			}
+		}
+
+		// old method, parsing url to csv from the call list page
 		DBG("sending callList update request.");
 		// force an update of the fritz!box csv list and wait until all data is received
-		msg = httpClient.get("/cgi-bin/webcm",
+		std::string msg = httpClient.get("/cgi-bin/webcm",
 				{
 						{ "getpage", "../html/" + getLang() + "/menus/menu2.html" },
 						{ "var%3Alang", getLang() },
@@ -357,20 +308,8 @@ std::string FritzClient::requestCallList () {
 						{ "var%3Amenu", "fon" },
 						{ "sid", gConfig->getSid() },
 				});
-		// new method to request call list (FW >= xx.05.50?)
-		try {
-			DBG("sending callList request (using lua)...");
-			csv = httpClient.get("/fon_num/foncalls_list.lua",
-					{
-							{ "csv", "" },
-							{ "sid", gConfig->getSid() },
-					});
-			if (csv.find("Typ;Datum;Name;") != std::string::npos) {
-				return csv;
-			}
-		} catch (std::runtime_error &re) {}
-
-		// old method, parsing url to csv from page above
+		if (luaFailed)
+			profile.setSupport(BoxProfile::CALL_LIST_LUA, BoxProfile::UNSUPPORTED);
 
 		// get the URL of the CSV-File-Export
 		unsigned int urlPos   = msg.find(".csv");
@@ -379,25 +318,47 @@ std::string FritzClient::requestCallList () {
 		std::string csvUrl    = msg.substr(urlStart, urlStop-urlStart);
 		// retrieve csv list
 		DBG("sending callList request (using webcm)...");
-		csv = httpClient.get("/cgi-bin/webcm",
+		// convert answer to current SystemCodeSet (we assume, Fritz!Box sends its answer in latin15),
+		// a single byte charset can be converted piece by piece
+		convert::CharsetConverter conv("ISO-8859-15");
+		httpClient.getStream("/cgi-bin/webcm",
 				{
 						{ "getpage", csvUrl },
 						{ "sid", gConfig->getSid() },
+				}, [&conv, &sink](const char *data, size_t length) {
+					std::string converted = conv.convert(std::string(data, length));
+					sink(converted.data(), converted.size());
 				});
-
-		// convert answer to current SystemCodeSet (we assume, Fritz!Box sends its answer in latin15)
-		convert::CharsetConverter conv("ISO-8859-15");
-		csv = conv.convert(csv);
-	} RETRY_END
-	return csv;
+		received = true;
+		return "";
+	});
+	return received;
 }
 
 std::string FritzClient::requestFonbook () {
 	std::string msg;
-	// new method, returns an XML
-	RETRY_BEGIN {
-		if (gConfig->getSid().length()) {
-			network::HttpClient::param_t postdata =
+	streamFonbook([&msg](const char *data, size_t length) {
+		if (data)
+			msg.append(data, length);
+		else
+			msg.clear();
+	});
+	return msg;
+}
+
+bool FritzClient::streamFonbook(const sink_t &sink) {
+	BoxProfile &profile = session->getProfile();
+	bool attempted = false;
+	bool received = false;
+	retry([&]() -> std::string {
+		// a previous attempt may have passed parts of the body
+		if (attempted)
+			sink(nullptr, 0);
+		attempted = true;
+		// new method, returns an XML
+		bool xmlFailed = false;
+		if (gConfig->getSid().length() && profile.getSupport(BoxProfile::FONBOOK_XML) != BoxProfile::UNSUPPORTED) {
+			PooledHttpClient::param_t postdata =
 			{
 					{ "sid", gConfig->getSid() },
 					{ "PhonebookId", "0" },
@@ -406,40 +367,57 @@ std::string FritzClient::requestFonbook () {
 			};
 			DBG("sending fonbook XML request.");
 			try {
-				msg = httpClient.postMIME("/cgi-bin/firmwarecfg", postdata);
-			} catch (std::runtime_error &re) {}
-			if (msg.find("<phonebooks>") != std::string::npos) {
-				return msg;
+				if (requestLua([&]() {
+					// the SID may have changed
+					postdata["sid"] = gConfig->getSid();
+					MarkedSink xmlSink("<phonebooks>", sink);
+					httpClient.postMIMEStream("/cgi-bin/firmwarecfg", postdata, std::ref(xmlSink));
+					return xmlSink.isFound();
+				})) {
+					profile.setSupport(BoxProfile::FONBOOK_XML, BoxProfile::SUPPORTED);
+					received = true;
+					return "";
+				}
+			} catch (HttpError &he) {
+				// only a missing page tells that the box has no XML export,
+				// other errors and broken transfers are retried
+				if (he.getStatus() != 404)
+					throw;
+				xmlFailed = true;
 			}
 		}
 
 	// use old fashioned website (for old FW versions)
 		DBG("sending fonbook HTML request.");
-		msg = httpClient.get("/cgi-bin/webcm",
+		httpClient.getStream("/cgi-bin/webcm",
 				{
 						{ "getpage", "../html/" + getLang() + "/menus/menu2.html" },
 						{ "var%3Alang", getLang() },
 						{ "var%3Apagename", "fonbuch" },
 						{ "var%3Amenu", "fon" },
 						{ "sid", gConfig->getSid() },
-				});
-	} RETRY_END
-
-	return msg;
+				}, sink);
+		if (xmlFailed)
+			profile.setSupport(BoxProfile::FONBOOK_XML, BoxProfile::UNSUPPORTED);
+		received = true;
+		return "";
+	});
+	return received;
 }
 
 void FritzClient::writeFonbook(std::string xmlData) {
 	std::string msg;
 	DBG("Saving XML Fonbook to FB...");
-	RETRY_BEGIN {
-		network::HttpClient::param_t postdata =
+	retry([&]() -> std::string {
+		PooledHttpClient::param_t postdata =
 		{
 				{ "sid", gConfig->getSid() },
 				{ "PhonebookId", "0" },
 				{ "PhonebookImportFile\"; filename=\"FRITZ.Box_Telefonbuch.xml", xmlData }
 		};
 		msg = httpClient.postMIME("/cgi-bin/firmwarecfg", postdata);
-	} RETRY_END
+		return msg;
+	});
 }
 
 
@@ -496,5 +474,4 @@ std::string FritzClient::getCurrentIP() {
 	return "";
 }
 
-//TODO: update lastRequestTime with any request
 }
@@ -23,31 +23,69 @@
 #define FRITZCLIENT_H
 
 #include <cstdlib>
+#include <functional>
+#include <memory>
 #include <mutex>
 
 #include <libnet++/SoapClient.h>
-#include <libnet++/HttpClient.h>
+
+#include "HttpConnectionPool.h"
+#include "RetryScheduler.h"
 
 namespace fritz {
 
+class SessionManager;
+
 class FritzClient {
 private:
-	static std::mutex *mutex;
-    std::string calculateLoginResponse(std::string challenge);
-	std::string urlEncode(const std::string &s);
+	static std::mutex langMutex;          // one language detection at a time
 	bool login();
+	/**
+	 * Logs in and runs request, which is retried as defined by Config::SetupRetryPolicy().
+	 * @return the result of request, an empty string if the retries were given up or canceled
+	 */
+	std::string retry(std::function<std::string()> request);
+	/**
+	 * Runs a request to a lua page. If the page is not in the answer, the box most likely
+	 * did not accept the SID anymore, so it logs in again and repeats the request once.
+	 * @param request, returns whether the answer contained the expected page
+	 * @return false, if the page was missing in both answers
+	 */
+	bool requestLua(std::function<bool()> request);
 	std::string getLang();
 	bool validPassword;
-	network::HttpClient httpClient;
+	std::shared_ptr<SessionManager> session;   // kept while this client exists, even if replaced meanwhile
+	PooledHttpClient httpClient;
+	CancellationToken cancellation;
 	network::SoapClient *soapClient;
 public:
 	FritzClient ();
 	virtual ~FritzClient();
+	/**
+	 * Sets the token that cancels retries of this client, default is the shutdown token of gConfig.
+	 */
+	void setCancellationToken(const CancellationToken &token) { cancellation = token; }
 	virtual bool initCall(std::string &number);
 	virtual std::string requestLocationSettings();
 	virtual std::string requestSipSettings();
+	/**
+	 * Receives the body of a response in pieces as they arrive. If a request is retried,
+	 * the body starts again after a call with data == nullptr. The sink is always called
+	 * in the thread calling the stream method, also for retries.
+	 */
+	typedef std::function<void(const char *data, size_t length)> sink_t;
 	virtual std::string requestCallList();
+	/**
+	 * Passes the call list to sink while it is received, instead of returning it as a whole.
+	 * @return false, if the request failed and retries were given up or canceled
+	 */
+	virtual bool streamCallList(const sink_t &sink);
 	virtual std::string requestFonbook();
+	/**
+	 * Passes the phone book to sink while it is received, instead of returning it as a whole.
+	 * @return false, if the request failed and retries were given up or canceled
+	 */
+	virtual bool streamFonbook(const sink_t &sink);
 	virtual void writeFonbook(std::string xmlData);
 	virtual bool hasValidPassword() { return validPassword; }
 	virtual bool reconnectISP();
@@ -65,4 +103,4 @@ public:
 
 }
 
-#endif /* FRITZCLIENT_H_ */
+#endif /* FRITZCLIENT_H */
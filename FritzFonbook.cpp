@@ -34,12 +34,14 @@
 namespace fritz {
 
 FritzFonbook::FritzFonbook()
-:XmlFonbook(I18N_NOOP("Fritz!Box phone book"), "FRITZ", true), thread{nullptr}
+:XmlFonbook(I18N_NOOP("Fritz!Box phone book"), "FRITZ", true), thread{nullptr}, contentHash{0}, pollThread{nullptr}, pollStop{false},
+ minPollInterval{0}, maxPollInterval{0}, pollInterval{0}
 {
 	setInitialized(false);
 }
 
 FritzFonbook::~FritzFonbook() {
+	stopPolling();
 	if (thread) {
 		thread->join();
 		delete thread;
@@ -53,12 +55,41 @@ bool FritzFonbook::initialize() {
 
 void FritzFonbook::run() {
 	DBG("FritzFonbook thread started");
-	setInitialized(false);
-	clear();
+	update(gConfig->getShutdownToken());
+	DBG("FritzFonbook thread ended");
+}
 
+bool FritzFonbook::update(const CancellationToken &token) {
+	std::lock_guard<std::mutex> lock(updateMutex);
+	// the phone book is hashed while it is received
 	FritzClient *fc = gConfig->fritzClientFactory->create();
-	std::string msg = fc->requestFonbook();
+	fc->setCancellationToken(token);
+	std::string msg;
+	ContentHasher hasher;
+	bool received = fc->streamFonbook([&msg, &hasher](const char *data, size_t length) {
+		if (!data) {
+			// the request is repeated, the phone book starts again
+			msg.clear();
+			hasher = ContentHasher();
+			return;
+		}
+		msg.append(data, length);
+		hasher.update(data, length);
+	});
 	delete fc;
+	if (!received) {
+		// the request failed or was canceled, keep the current entries
+		return false;
+	}
+
+	// periodic reloads mostly return the same data, keep the parsed entries then
+	uint64_t hash = hasher.digest();
+	if (isInitialized() && !isModified() && hash == contentHash) {
+		DBG("FritzFonbook unchanged");
+		return false;
+	}
+	setInitialized(false);
+	clear();
 
 	if (msg.find("<?xml") == std::string::npos)
 		parseHtmlFonbook(&msg);
@@ -67,10 +98,53 @@ void FritzFonbook::run() {
 		setWriteable(); // we can write xml back to the FB
 	}
 
+	contentHash = hash;
 	setInitialized(true);
 
 	sort(FonbookEntry::ELEM_NAME, true);
-	DBG("FritzFonbook thread ended");
+	return true;
+}
+
+void FritzFonbook::startPolling(std::chrono::milliseconds minInterval, std::chrono::milliseconds maxInterval) {
+	stopPolling();
+	minPollInterval = minInterval;
+	maxPollInterval = std::max(minInterval, maxInterval);
+	pollInterval    = minInterval;
+	pollStop        = false;
+	pollToken       = gConfig->getShutdownToken().createChild();
+	pollThread = new std::thread(&FritzFonbook::poll, this);
+}
+
+void FritzFonbook::stopPolling() {
+	if (!pollThread)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(pollMutex);
+		pollStop = true;
+	}
+	// the poller might wait for a retry
+	pollToken.cancel();
+	pollWakeup.notify_all();
+	pollThread->join();
+	delete pollThread;
+	pollThread = nullptr;
+}
+
+std::chrono::milliseconds FritzFonbook::getPollInterval() {
+	std::lock_guard<std::mutex> lock(pollMutex);
+	return pollInterval;
+}
+
+void FritzFonbook::poll() {
+	std::unique_lock<std::mutex> lock(pollMutex);
+	while (!pollWakeup.wait_for(lock, pollInterval, [this]() { return pollStop; })) {
+		lock.unlock();
+		bool changed = update(pollToken);
+		lock.lock();
+		// poll less often while nothing changes
+		pollInterval = changed ? minPollInterval : std::min(pollInterval * 2, maxPollInterval);
+		DBG("FritzFonbook " << (changed ? "changed" : "unchanged") << ", next check in " << pollInterval.count() / 1000.0 << "s");
+	}
 }
 
 void FritzFonbook::parseHtmlFonbook(std::string *msg) {
@@ -22,9 +22,14 @@
 #ifndef FRITZFONBOOK_H
 #define FRITZFONBOOK_H
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
 #include <string>
 #include <thread>
 
+#include "RetryScheduler.h"
 #include "XmlFonbook.h"
 
 namespace fritz{
@@ -33,14 +38,53 @@ class FritzFonbook : public XmlFonbook {
 			friend class FonbookManager;
 private:
 	std::thread *thread;
+	uint64_t contentHash;    // of the last phone book parsed
+	std::mutex updateMutex;  // serializes updates by reload() and polling
+	std::thread *pollThread;
+	std::mutex pollMutex;
+	std::condition_variable pollWakeup;
+	bool pollStop;
+	CancellationToken pollToken;   // cancels retries of the poller, in addition to the shutdown token
+	std::chrono::milliseconds minPollInterval;
+	std::chrono::milliseconds maxPollInterval;
+	std::chrono::milliseconds pollInterval;
 	FritzFonbook();
 	void parseHtmlFonbook(std::string *msg);
 	void write() override;
+	/**
+	 * Fetches the phone book and parses it, if it changed.
+	 * @param cancels retries of the request
+	 * @return true, if the phone book changed
+	 */
+	bool update(const CancellationToken &token);
+	void poll();
 public:
 	virtual ~FritzFonbook();
 	bool initialize() override;
 	void run();
 	void reload() override;
+	/**
+	 * Keeps the phone book up to date, instead of calling reload() periodically.
+	 * The phone book is fetched every minInterval. Each time it did not change, the
+	 * interval is doubled up to maxInterval, a change resets it to minInterval.
+	 * This is plain polling, there is no cheap change marker: the web interface has no
+	 * request telling whether the phone book changed, and the TR-064 phone book service
+	 * needs authenticated SOAP requests, which network::SoapClient does not support.
+	 * So each check downloads the whole export. Changes are detected by a hash of the
+	 * content, an unchanged phone book is not parsed again.
+	 * @param the interval after a change
+	 * @param the maximum interval
+	 */
+	void startPolling(std::chrono::milliseconds minInterval = std::chrono::minutes(1),
+	                  std::chrono::milliseconds maxInterval = std::chrono::minutes(30));
+	/**
+	 * Stops polling, a pending retry of the poller is canceled.
+	 */
+	void stopPolling();
+	/**
+	 * Returns the current interval, until the phone book is fetched next.
+	 */
+	std::chrono::milliseconds getPollInterval();
 };
 
 }
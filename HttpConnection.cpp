@@ -0,0 +1,290 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "HttpConnection.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <liblog++/Log.h>
+
+namespace fritz {
+
+HttpConnection::HttpConnection(const std::string &host, int port, int timeout)
+: host{host}, port{port}, timeout{timeout}, fd{-1}, buffer(16384), bufferStart{0}, bufferEnd{0}, reusable{false}, requests{0}, lastUsed{0} {
+}
+
+HttpConnection::~HttpConnection() {
+	close();
+}
+
+void HttpConnection::close() {
+	if (fd >= 0) {
+		::close(fd);
+		fd = -1;
+	}
+	bufferStart = bufferEnd = 0;
+	reusable = false;
+	requests = 0;
+}
+
+void HttpConnection::connect() {
+	addrinfo hints = {};
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo *result;
+	int r = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result);
+	if (r != 0)
+		throw std::runtime_error("could not resolve " + host + ": " + gai_strerror(r));
+	fd = socket(result->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		freeaddrinfo(result);
+		throw std::runtime_error(std::string{"could not create socket: "} + strerror(errno));
+	}
+	r = ::connect(fd, result->ai_addr, result->ai_addrlen);
+	freeaddrinfo(result);
+	if (r < 0 && errno == EINPROGRESS) {
+		pollfd pfd = { fd, POLLOUT, 0 };
+		r = poll(&pfd, 1, timeout * 1000);
+		int error = 0;
+		socklen_t length = sizeof(error);
+		if (r == 0)
+			error = ETIMEDOUT;
+		else if (r > 0 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0)
+			error = errno;
+		else if (r < 0)
+			error = errno;
+		errno = error;
+		r = error ? -1 : 0;
+	}
+	if (r < 0) {
+		std::string message = "could not connect to " + host + ":" + std::to_string(port) + ": " + strerror(errno);
+		close();
+		throw std::runtime_error(message);
+	}
+	// the remaining operations are blocking with a timeout
+	int flags = fcntl(fd, F_GETFL);
+	fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+	timeval tv = { timeout, 0 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	DBG("connected to " << host << ":" << port);
+}
+
+void HttpConnection::sendAll(const std::string &data) {
+	size_t sent = 0;
+	while (sent < data.size()) {
+		ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			throw std::runtime_error(std::string{"could not send to "} + host + ": " + strerror(errno));
+		sent += n;
+	}
+}
+
+bool HttpConnection::fill() {
+	if (bufferStart == bufferEnd)
+		bufferStart = bufferEnd = 0;
+	if (bufferEnd == buffer.size()) {
+		if (bufferStart > 0) {
+			memmove(buffer.data(), buffer.data() + bufferStart, bufferEnd - bufferStart);
+			bufferEnd -= bufferStart;
+			bufferStart = 0;
+		} else {
+			buffer.resize(buffer.size() * 2);
+		}
+	}
+	while (true) {
+		ssize_t n = recv(fd, buffer.data() + bufferEnd, buffer.size() - bufferEnd, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			throw std::runtime_error(std::string{"could not receive from "} + host + ": " +
+			                         (errno == EAGAIN || errno == EWOULDBLOCK ? "timeout" : strerror(errno)));
+		bufferEnd += n;
+		return n > 0;
+	}
+}
+
+std::string HttpConnection::readLine() {
+	size_t searched = 0;            // bytes after bufferStart known to contain no line break
+	while (true) {
+		char *start = buffer.data() + bufferStart;
+		char *newline = static_cast<char *>(memchr(start + searched, '\n', bufferEnd - bufferStart - searched));
+		if (newline) {
+			size_t length = newline - start;
+			bufferStart += length + 1;
+			if (length && start[length - 1] == '\r')
+				length--;
+			return std::string(start, length);
+		}
+		searched = bufferEnd - bufferStart;
+		if (searched > 65536)
+			throw std::runtime_error("header line too long from " + host);
+		if (!fill())
+			throw std::runtime_error("connection closed by " + host);
+	}
+}
+
+void HttpConnection::readHead(sHttpResponseHead &head) {
+	std::string line;
+	// skip interim responses, e.g., 100 Continue
+	do {
+		line = readLine();
+		if (line.compare(0, 5, "HTTP/") != 0)
+			throw std::runtime_error("invalid response from " + host + ": " + line.substr(0, 40));
+		size_t space = line.find(' ');
+		head.status = space == std::string::npos ? 0 : atoi(line.c_str() + space + 1);
+		// HTTP/1.0 servers close the connection unless asked otherwise
+		reusable = line.compare(0, 8, "HTTP/1.0") != 0;
+		head.headers.clear();
+		while (!(line = readLine()).empty()) {
+			size_t colon = line.find(':');
+			if (colon == std::string::npos)
+				continue;
+			std::string name = line.substr(0, colon);
+			for (char &c : name)
+				c = tolower(c);
+			size_t value = line.find_first_not_of(" \t", colon + 1);
+			head.headers[name] = value == std::string::npos ? "" : line.substr(value);
+		}
+	} while (head.status >= 100 && head.status < 200);
+	auto connection = head.headers.find("connection");
+	if (connection != head.headers.end()) {
+		std::string value = connection->second;
+		for (char &c : value)
+			c = tolower(c);
+		if (value.find("close") != std::string::npos)
+			reusable = false;
+		else if (value.find("keep-alive") != std::string::npos)
+			reusable = true;
+	}
+}
+
+void HttpConnection::readBody(size_t length, const sink_t &sink) {
+	while (length > 0) {
+		if (bufferStart == bufferEnd && !fill())
+			throw std::runtime_error("connection closed by " + host + " before end of body");
+		size_t available = std::min(length, bufferEnd - bufferStart);
+		sink(buffer.data() + bufferStart, available);
+		bufferStart += available;
+		length -= available;
+	}
+}
+
+void HttpConnection::readChunkedBody(const sink_t &sink) {
+	while (true) {
+		std::string line = readLine();
+		size_t chunkSize = strtoul(line.c_str(), nullptr, 16);
+		if (chunkSize == 0)
+			break;
+		readBody(chunkSize, sink);
+		readLine();
+	}
+	// skip trailer
+	while (!readLine().empty())
+		;
+}
+
+void HttpConnection::readBodyUntilClose(const sink_t &sink) {
+	reusable = false;
+	do {
+		if (bufferEnd > bufferStart)
+			sink(buffer.data() + bufferStart, bufferEnd - bufferStart);
+		bufferStart = bufferEnd = 0;
+	} while (fill());
+}
+
+void HttpConnection::receive(const std::string &method, sHttpResponseHead &head, const sink_t &sink) {
+	readHead(head);
+	if (method == "HEAD" || head.status == 204 || head.status == 304)
+		return;
+	auto transferEncoding = head.headers.find("transfer-encoding");
+	auto contentLength = head.headers.find("content-length");
+	if (transferEncoding != head.headers.end() && transferEncoding->second.find("chunked") != std::string::npos)
+		readChunkedBody(sink);
+	else if (contentLength != head.headers.end())
+		readBody(strtoull(contentLength->second.c_str(), nullptr, 10), sink);
+	else
+		readBodyUntilClose(sink);
+}
+
+void HttpConnection::request(const std::string &method, const std::string &path, const header_t &headers, const std::string &body,
+                             sHttpResponseHead &head, const sink_t &sink) {
+	std::string message;
+	message.reserve(256 + body.size());
+	message.append(method).append(" ").append(path).append(" HTTP/1.1\r\n");
+	message.append("Host: ").append(host);
+	if (port != 80)
+		message.append(":").append(std::to_string(port));
+	message.append("\r\nConnection: keep-alive\r\n");
+	for (auto &header : headers)
+		message.append(header.first).append(": ").append(header.second).append("\r\n");
+	if (body.size() || method == "POST")
+		message.append("Content-Length: ").append(std::to_string(body.size())).append("\r\n");
+	message.append("\r\n").append(body);
+
+	// only requests without side effects may be sent twice
+	bool idempotent = method == "GET" || method == "HEAD";
+	for (int attempt = 0; ; attempt++) {
+		bool reused = fd >= 0 && requests > 0;
+		bool responseStarted = false;
+		try {
+			if (fd < 0)
+				connect();
+			sendAll(message);
+			// a closed keep-alive connection shows up as EOF before the first byte of the response
+			if (bufferStart == bufferEnd && !fill())
+				throw std::runtime_error("connection closed by " + host);
+			responseStarted = true;
+			receive(method, head, sink);
+			requests++;
+			lastUsed = time(nullptr);
+			if (!reusable)
+				close();
+			return;
+		} catch (std::runtime_error &re) {
+			close();
+			if (!reused || responseStarted || attempt > 0 || !idempotent)
+				throw;
+			DBG("reused connection to " << host << " failed, reconnecting: " << re.what());
+		}
+	}
+}
+
+bool HttpConnection::isHealthy() {
+	if (!isReusable() || bufferStart != bufferEnd)
+		return false;
+	// an idle connection must not be readable, this would be EOF, an error or unexpected data
+	pollfd pfd = { fd, POLLIN, 0 };
+	return poll(&pfd, 1, 0) == 0;
+}
+
+}
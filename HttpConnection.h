@@ -0,0 +1,112 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef HTTPCONNECTION_H
+#define HTTPCONNECTION_H
+
+#include <ctime>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fritz {
+
+/**
+ * Status and header of an HTTP response. Header names are in lower case.
+ */
+struct sHttpResponseHead {
+	int status;
+	std::map<std::string, std::string> headers;
+	sHttpResponseHead() : status{0} {}
+};
+
+/**
+ * A persistent HTTP/1.1 connection to one host.
+ * The connection is established on the first request and kept open between
+ * requests unless the server closes it. Requests are sent one after the other,
+ * an object must not be used by more than one thread at a time.
+ */
+class HttpConnection {
+public:
+	typedef std::map<std::string, std::string> header_t;
+	/**
+	 * Receives the body of a response in pieces as they arrive.
+	 */
+	typedef std::function<void(const char *data, size_t length)> sink_t;
+private:
+	std::string host;
+	int port;
+	int timeout;
+	int fd;
+	std::vector<char> buffer;        // received data not consumed yet, between bufferStart and bufferEnd
+	size_t bufferStart;
+	size_t bufferEnd;
+	bool reusable;
+	unsigned int requests;           // requests completed on the current socket
+	time_t lastUsed;
+	void connect();
+	void sendAll(const std::string &data);
+	bool fill();
+	std::string readLine();
+	void readHead(sHttpResponseHead &head);
+	void readBody(size_t length, const sink_t &sink);
+	void readChunkedBody(const sink_t &sink);
+	void readBodyUntilClose(const sink_t &sink);
+	void receive(const std::string &method, sHttpResponseHead &head, const sink_t &sink);
+public:
+	/**
+	 * @param the host name or address
+	 * @param the port
+	 * @param the timeout for connecting, sending and receiving in seconds
+	 */
+	HttpConnection(const std::string &host, int port, int timeout = 30);
+	virtual ~HttpConnection();
+	/**
+	 * Sends a request and passes the body of the response to the sink. If a GET or HEAD
+	 * request fails on a reused connection, which the server may have closed meanwhile, it is
+	 * repeated once on a new connection. Other requests, e.g., POST, are not repeated, as the
+	 * server may have processed them before closing the connection.
+	 * @param the method, e.g., GET
+	 * @param the path including the query
+	 * @param additional header lines, Host, Content-Length and Connection are set by this method
+	 * @param the body, may be empty
+	 * @param status and header of the response
+	 * @param the receiver of the body
+	 * @throws std::runtime_error if the connection fails, the connection is closed in this case
+	 */
+	void request(const std::string &method, const std::string &path, const header_t &headers, const std::string &body,
+	             sHttpResponseHead &head, const sink_t &sink);
+	void close();
+	/**
+	 * Returns whether the connection can be used for another request, i.e., it is open,
+	 * the server did not ask to close it and no data or EOF is pending.
+	 */
+	bool isHealthy();
+	bool isReusable() const { return reusable && fd >= 0; }
+	const std::string &getHost() const { return host; }
+	int getPort() const { return port; }
+	time_t getLastUsed() const { return lastUsed; }
+};
+
+}
+
+#endif /* HTTPCONNECTION_H */
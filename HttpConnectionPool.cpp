@@ -0,0 +1,208 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "HttpConnectionPool.h"
+
+#include <memory>
+#include <stdexcept>
+
+#include <liblog++/Log.h>
+
+#include "ContentDecoder.h"
+
+namespace fritz {
+
+HttpConnectionPool &HttpConnectionPool::Get() {
+	static HttpConnectionPool pool;
+	return pool;
+}
+
+HttpConnectionPool::~HttpConnectionPool() {
+	clear();
+}
+
+void HttpConnectionPool::evict(time_t now) {
+	for (auto &host : idle) {
+		std::vector<HttpConnection *> &connections = host.second;
+		for (size_t pos = 0; pos < connections.size(); ) {
+			if (now - connections[pos]->getLastUsed() > IDLE_TIMEOUT || !connections[pos]->isHealthy()) {
+				delete connections[pos];
+				connections.erase(connections.begin() + pos);
+				metrics.evicted++;
+				metrics.idle--;
+			} else {
+				pos++;
+			}
+		}
+	}
+}
+
+HttpConnection *HttpConnectionPool::lease(const std::string &host, int port, size_t maxLeased) {
+	std::string key = host + ":" + std::to_string(port);
+	std::unique_lock<std::mutex> lock(mutex);
+	size_t &count = leased[key];
+	connectionReleased.wait(lock, [&count, maxLeased]() { return maxLeased == 0 || count < maxLeased; });
+	count++;
+	evict(time(nullptr));
+	std::vector<HttpConnection *> &connections = idle[key];
+	if (connections.size()) {
+		HttpConnection *connection = connections.back();
+		connections.pop_back();
+		metrics.reused++;
+		metrics.idle--;
+		return connection;
+	}
+	metrics.created++;
+	return new HttpConnection(host, port);
+}
+
+void HttpConnectionPool::release(HttpConnection *connection) {
+	std::string key = connection->getHost() + ":" + std::to_string(connection->getPort());
+	std::lock_guard<std::mutex> lock(mutex);
+	leased[key]--;
+	connectionReleased.notify_all();
+	std::vector<HttpConnection *> &connections = idle[key];
+	if (!connection->isReusable() || connections.size() >= MAX_IDLE_PER_HOST) {
+		delete connection;
+		return;
+	}
+	connections.push_back(connection);
+	metrics.idle++;
+}
+
+void HttpConnectionPool::clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto &host : idle)
+		for (HttpConnection *connection : host.second)
+			delete connection;
+	idle.clear();
+	metrics.idle = 0;
+}
+
+sHttpPoolMetrics HttpConnectionPool::getMetrics() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return metrics;
+}
+
+PooledHttpClient::PooledHttpClient(const std::string &host, int port, size_t maxConnections)
+: host{host}, port{port}, maxConnections{maxConnections}, compression{false} {
+}
+
+void PooledHttpClient::request(const std::string &method, const std::string &path, const header_t &headers, const std::string &body,
+                               const HttpConnection::sink_t &sink) {
+	sHttpResponseHead head;
+	header_t requestHeaders = headers;
+	if (compression)
+		requestHeaders["Accept-Encoding"] = "gzip, deflate";
+	std::unique_ptr<ContentDecoder> decoder;
+	HttpConnection *connection = HttpConnectionPool::Get().lease(host, port, maxConnections);
+	try {
+		// the head is known before the first piece of the body
+		connection->request(method, path, requestHeaders, body, head, [&head, &sink, &decoder](const char *data, size_t length) {
+			if (head.status >= 400)
+				return;
+			if (!decoder) {
+				auto encoding = head.headers.find("content-encoding");
+				if (encoding == head.headers.end() || !ContentDecoder::IsSupported(encoding->second)) {
+					sink(data, length);
+					return;
+				}
+				decoder.reset(new ContentDecoder(encoding->second, sink));
+			}
+			decoder->write(data, length);
+		});
+	} catch (std::runtime_error &re) {
+		// the connection is closed already, so it is not pooled again
+		HttpConnectionPool::Get().release(connection);
+		throw;
+	}
+	HttpConnectionPool::Get().release(connection);
+	if (decoder)
+		decoder->finish();
+	if (head.status >= 400)
+		throw HttpError(head.status, path);
+}
+
+std::string PooledHttpClient::request(const std::string &method, const std::string &path, const header_t &headers, const std::string &body) {
+	std::string result;
+	request(method, path, headers, body, [&result](const char *data, size_t length) {
+		result.append(data, length);
+	});
+	return result;
+}
+
+std::string PooledHttpClient::GetTarget(const std::string &path, const param_t &params) {
+	std::string target = path;
+	char separator = target.find('?') == std::string::npos ? '?' : '&';
+	for (auto &param : params) {
+		target.append(1, separator).append(param.first).append("=").append(param.second);
+		separator = '&';
+	}
+	return target;
+}
+
+std::string PooledHttpClient::GetMIMEBody(const param_t &params, header_t &headers) {
+	const std::string boundary = "----libfritz++boundary7d93b2a1c0";
+	std::string body;
+	for (auto &param : params) {
+		// the name is used as given, callers append e.g. a file name this way
+		body.append("--").append(boundary).append("\r\n");
+		body.append("Content-Disposition: form-data; name=\"").append(param.first).append("\"\r\n\r\n");
+		body.append(param.second).append("\r\n");
+	}
+	body.append("--").append(boundary).append("--\r\n");
+	headers["Content-Type"] = "multipart/form-data; boundary=" + boundary;
+	return body;
+}
+
+std::string PooledHttpClient::get(const std::string &path, const param_t &params, const header_t &headers) {
+	return request("GET", GetTarget(path, params), headers, "");
+}
+
+std::string PooledHttpClient::post(const std::string &path, const param_t &params, const header_t &headers) {
+	std::string body;
+	for (auto &param : params) {
+		if (body.size())
+			body.append("&");
+		body.append(param.first).append("=").append(param.second);
+	}
+	header_t postHeaders = headers;
+	postHeaders["Content-Type"] = "application/x-www-form-urlencoded";
+	return request("POST", path, postHeaders, body);
+}
+
+std::string PooledHttpClient::postMIME(const std::string &path, const param_t &params, const header_t &headers) {
+	header_t postHeaders = headers;
+	std::string body = GetMIMEBody(params, postHeaders);
+	return request("POST", path, postHeaders, body);
+}
+
+void PooledHttpClient::getStream(const std::string &path, const param_t &params, const HttpConnection::sink_t &sink, const header_t &headers) {
+	request("GET", GetTarget(path, params), headers, "", sink);
+}
+
+void PooledHttpClient::postMIMEStream(const std::string &path, const param_t &params, const HttpConnection::sink_t &sink, const header_t &headers) {
+	header_t postHeaders = headers;
+	std::string body = GetMIMEBody(params, postHeaders);
+	request("POST", path, postHeaders, body, sink);
+}
+
+}
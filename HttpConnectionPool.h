@@ -0,0 +1,147 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef HTTPCONNECTIONPOOL_H
+#define HTTPCONNECTIONPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "HttpConnection.h"
+
+namespace fritz {
+
+/**
+ * Counters of the HttpConnectionPool.
+ */
+struct sHttpPoolMetrics {
+	uint64_t created = 0;            // connections created because no idle one was available
+	uint64_t reused = 0;             // leases served by an idle connection
+	uint64_t evicted = 0;            // idle connections closed as they were broken or idle too long
+	size_t idle = 0;                 // connections currently idle
+};
+
+/**
+ * Process wide pool of persistent HTTP connections, by host and port.
+ * Before an idle connection is handed out, it is checked that the server did not
+ * close it meanwhile. Connections idle for longer than IDLE_TIMEOUT are closed.
+ */
+class HttpConnectionPool {
+private:
+	static const size_t MAX_IDLE_PER_HOST = 4;
+	static const time_t IDLE_TIMEOUT = 15;      // seconds, the Fritz!Box closes idle connections itself after a while
+	std::mutex mutex;
+	std::map<std::string, std::vector<HttpConnection *>> idle;   // by host:port, most recently used last
+	std::map<std::string, size_t> leased;                        // by host:port
+	std::condition_variable connectionReleased;
+	sHttpPoolMetrics metrics;
+	HttpConnectionPool() { }
+	void evict(time_t now);
+public:
+	static HttpConnectionPool &Get();
+	virtual ~HttpConnectionPool();
+	/**
+	 * Returns a connection to the given host, which has to be passed to release() afterwards.
+	 * @param the host
+	 * @param the port
+	 * @param the maximum number of connections leased to this host at the same time, the call
+	 * waits until another one is released if the limit is reached, 0 for no limit
+	 */
+	HttpConnection *lease(const std::string &host, int port, size_t maxLeased = 0);
+	/**
+	 * Returns a connection to the pool, it is deleted if it can not be reused.
+	 */
+	void release(HttpConnection *connection);
+	/**
+	 * Closes all idle connections.
+	 */
+	void clear();
+	sHttpPoolMetrics getMetrics();
+};
+
+/**
+ * Thrown by PooledHttpClient if the server answers with an error status.
+ */
+class HttpError : public std::runtime_error {
+private:
+	int status;
+public:
+	HttpError(int status, const std::string &path)
+	: std::runtime_error("HTTP error " + std::to_string(status) + " for " + path), status{status} { }
+	int getStatus() const { return status; }
+};
+
+/**
+ * HTTP client using connections of the HttpConnectionPool.
+ * The interface follows network::HttpClient, parameters are passed to the
+ * server as given, without encoding.
+ */
+class PooledHttpClient {
+public:
+	typedef std::map<std::string, std::string> param_t;
+	typedef std::map<std::string, std::string> header_t;
+private:
+	std::string host;
+	int port;
+	size_t maxConnections;
+	bool compression;
+	void request(const std::string &method, const std::string &path, const header_t &headers, const std::string &body,
+	             const HttpConnection::sink_t &sink);
+	std::string request(const std::string &method, const std::string &path, const header_t &headers, const std::string &body);
+	static std::string GetTarget(const std::string &path, const param_t &params);
+	static std::string GetMIMEBody(const param_t &params, header_t &headers);
+public:
+	/**
+	 * @param the host
+	 * @param the port
+	 * @param the maximum number of concurrent requests to this host by all clients using the same limit, 0 for no limit
+	 */
+	PooledHttpClient(const std::string &host, int port = 80, size_t maxConnections = 0);
+	/**
+	 * Asks the server to compress responses with gzip or deflate. Compressed bodies
+	 * are decompressed while they arrive, callers always get the plain body.
+	 */
+	void setCompression(bool compression) { this->compression = compression; }
+	/**
+	 * The following methods return the body of the response.
+	 * @throws std::runtime_error if the connection fails, HttpError if the server answers with an error status
+	 */
+	std::string get(const std::string &path, const param_t &params = param_t(), const header_t &headers = header_t());
+	std::string post(const std::string &path, const param_t &params, const header_t &headers = header_t());
+	std::string postMIME(const std::string &path, const param_t &params, const header_t &headers = header_t());
+	/**
+	 * The following methods pass the body of the response to sink in pieces as they arrive.
+	 * The body of an error status is not passed.
+	 * @throws std::runtime_error if the connection fails, HttpError if the server answers with an error status
+	 */
+	void getStream(const std::string &path, const param_t &params, const HttpConnection::sink_t &sink, const header_t &headers = header_t());
+	void postMIMEStream(const std::string &path, const param_t &params, const HttpConnection::sink_t &sink, const header_t &headers = header_t());
+};
+
+}
+
+#endif /* HTTPCONNECTIONPOOL_H */
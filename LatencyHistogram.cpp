@@ -0,0 +1,107 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+
+namespace fritz {
+
+uint64_t sHistogramSnapshot::percentile(double p) const {
+	uint64_t rank = (uint64_t) (p * count);
+	uint64_t seen = 0;
+	for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+		seen += buckets[bucket];
+		if (seen > rank || (seen == count && seen > 0))
+			return bucket == 0 ? 0 : std::min<uint64_t>(max, (1ULL << bucket) - 1);
+	}
+	return max;
+}
+
+LatencyHistogram::LatencyHistogram() {
+	reset();
+}
+
+void LatencyHistogram::record(uint64_t value) {
+	size_t bucket = value ? 64 - __builtin_clzll(value) : 0;
+	if (bucket >= sHistogramSnapshot::BUCKETS)
+		bucket = sHistogramSnapshot::BUCKETS - 1;
+	buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(value, std::memory_order_relaxed);
+	uint64_t current = max.load(std::memory_order_relaxed);
+	while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+		;
+}
+
+sHistogramSnapshot LatencyHistogram::snapshot() const {
+	sHistogramSnapshot s;
+	for (size_t bucket = 0; bucket < sHistogramSnapshot::BUCKETS; bucket++)
+		s.buckets[bucket] = buckets[bucket].load(std::memory_order_relaxed);
+	s.count = count.load(std::memory_order_relaxed);
+	s.sum   = sum.load(std::memory_order_relaxed);
+	s.max   = max.load(std::memory_order_relaxed);
+	return s;
+}
+
+void LatencyHistogram::reset() {
+	for (size_t bucket = 0; bucket < sHistogramSnapshot::BUCKETS; bucket++)
+		buckets[bucket] = 0;
+	count = 0;
+	sum   = 0;
+	max   = 0;
+}
+
+PipelineLatency &PipelineLatency::Get() {
+	static PipelineLatency latency;
+	return latency;
+}
+
+const char *PipelineLatency::GetStageName(eStage stage) {
+	static const char *names[STAGES_COUNT] = {
+		"socketRead", "decode", "queue", "msnFilter", "resolve", "sipNames", "handler", "total", "boxToLibrary"
+	};
+	return stage < STAGES_COUNT ? names[stage] : "";
+}
+
+void PipelineLatency::recordFonbook(const std::string &techId, uint64_t value) {
+	std::lock_guard<std::mutex> lock(fonbookMutex);
+	fonbooks[techId].record(value);
+}
+
+PipelineLatency::snapshot_t PipelineLatency::snapshot() {
+	snapshot_t result;
+	for (size_t stage = 0; stage < STAGES_COUNT; stage++)
+		result[GetStageName((eStage) stage)] = stages[stage].snapshot();
+	std::lock_guard<std::mutex> lock(fonbookMutex);
+	for (auto &fonbook : fonbooks)
+		result["resolve:" + fonbook.first] = fonbook.second.snapshot();
+	return result;
+}
+
+void PipelineLatency::reset() {
+	for (size_t stage = 0; stage < STAGES_COUNT; stage++)
+		stages[stage].reset();
+	std::lock_guard<std::mutex> lock(fonbookMutex);
+	fonbooks.clear();
+}
+
+}
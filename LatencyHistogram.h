@@ -0,0 +1,122 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace fritz {
+
+/**
+ * A copy of the counters of a LatencyHistogram.
+ */
+struct sHistogramSnapshot {
+	static const size_t BUCKETS = 40;
+	uint64_t buckets[BUCKETS];   // bucket i counts values in [2^(i-1), 2^i), bucket 0 counts 0
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	sHistogramSnapshot() : buckets{}, count{0}, sum{0}, max{0} {}
+	/**
+	 * Returns an upper bound of the given percentile, accurate up to a factor of two.
+	 * @param the percentile, e.g., 0.99
+	 * @return the upper bound of the bucket containing the percentile
+	 */
+	uint64_t percentile(double p) const;
+	uint64_t mean() const { return count ? sum / count : 0; }
+};
+
+/**
+ * Histogram of latencies with power of two buckets.
+ * Recording is lock-free and takes a few atomic increments, so it can be
+ * used on every event.
+ */
+class LatencyHistogram {
+private:
+	std::atomic<uint64_t> buckets[sHistogramSnapshot::BUCKETS];
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> max;
+public:
+	LatencyHistogram();
+	void record(uint64_t value);
+	sHistogramSnapshot snapshot() const;
+	void reset();
+};
+
+/**
+ * Latencies of the stages of the call event pipeline, from reading a line of the
+ * call monitor to the return of the EventHandler. All values are in microseconds,
+ * except BOX_TO_LIBRARY, which is in milliseconds and has a resolution of one
+ * second, as the Fritz!Box sends its time without fractions.
+ */
+class PipelineLatency {
+public:
+	enum eStage {
+		SOCKET_READ,             // reading from the socket, per read
+		DECODE,                  // decoding a line
+		QUEUE,                   // from receiving a line until a dispatch worker picks it up
+		MSN_FILTER,
+		RESOLVE,                 // reverse lookup in all phone books
+		SIP_NAMES,               // mapping the medium to the SIP provider name
+		HANDLER,                 // the call of the EventHandler
+		TOTAL,                   // from receiving a line until the EventHandler returned
+		BOX_TO_LIBRARY,          // from the time stamp of the Fritz!Box until the line was received
+		STAGES_COUNT
+	};
+	typedef std::map<std::string, sHistogramSnapshot> snapshot_t;
+private:
+	LatencyHistogram stages[STAGES_COUNT];
+	std::mutex fonbookMutex;
+	std::map<std::string, LatencyHistogram> fonbooks;
+	PipelineLatency() { }
+public:
+	static PipelineLatency &Get();
+	/**
+	 * Returns a monotonic time stamp in microseconds, to be used with record().
+	 */
+	static uint64_t Now() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	static const char *GetStageName(eStage stage);
+	void record(eStage stage, uint64_t value) { stages[stage].record(value); }
+	/**
+	 * Records the time a phone book needed for resolveToName().
+	 * @param the technical id of the phone book
+	 * @param the time in microseconds
+	 */
+	void recordFonbook(const std::string &techId, uint64_t value);
+	/**
+	 * Returns copies of all histograms, by stage name. Phone books are listed as "resolve:<techId>".
+	 */
+	snapshot_t snapshot();
+	void reset();
+};
+
+}
+
+#endif /* LATENCYHISTOGRAM_H */
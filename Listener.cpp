@@ -29,39 +29,97 @@
 #include "CallList.h"
 #include "Config.h"
 #include "FonbookManager.h"
+#include "LatencyHistogram.h"
+#include "MonitorDecoder.h"
 #include "Tools.h"
-#include <libnet++/TcpClient.h>
 #include <liblog++/Log.h>
 
 namespace fritz{
 
+void EventHandler::handleEvent(const CallEventPtr &event) {
+	switch (event->type) {
+	case CallEvent::CALL:
+		handleCall(event->outgoing, event->connId, event->remoteNumber, event->remoteName, event->remoteType, event->localParty, event->medium, event->mediumName);
+		break;
+	case CallEvent::CONNECT:
+		handleConnect(event->connId);
+		break;
+	case CallEvent::DISCONNECT:
+		handleDisconnect(event->connId, event->duration);
+		break;
+	default:
+		break;
+	}
+}
+
+void EventHandler::handleCall(bool outgoing __attribute__((unused)), int connId __attribute__((unused)), std::string remoteNumber __attribute__((unused)),
+		std::string remoteName __attribute__((unused)), fritz::FonbookEntry::eType remoteType __attribute__((unused)), std::string localParty __attribute__((unused)),
+		std::string medium __attribute__((unused)), std::string mediumName __attribute__((unused))) {}
+
+void EventHandler::handleConnect(int connId __attribute__((unused))) {}
+
+void EventHandler::handleDisconnect(int connId __attribute__((unused)), std::string duration __attribute__((unused))) {}
+
+void ResolvingEventHandler::handleEvent(const CallEventPtr &event) {
+	if (event->type == CallEvent::RESOLVED)
+		handleCallResolved(event->connId, event->remoteName, event->remoteType);
+	else
+		EventHandler::handleEvent(event);
+}
+
+void ResolvingEventHandler::handleCallResolved(int connId __attribute__((unused)), std::string remoteName __attribute__((unused)),
+		fritz::FonbookEntry::eType remoteType __attribute__((unused))) {}
+
 Listener *Listener::me = nullptr;
+std::mutex Listener::subscriptionMutex;
+std::map<size_t, std::shared_ptr<Subscription>> Listener::subscriptions;
+size_t Listener::nextSubscription = 0;
+const unsigned int Listener::CONFIRM_RELOAD_DELAY;
 
 Listener::Listener(EventHandler *event)
+: droppedEvents{0}, dispatchStop{false}, lookupStop{false}
 {
 	this->event = event;
-	thread = new std::thread(&Listener::run, this);
-	threadNativeHandle = thread->native_handle();
-	thread->detach();
+	resolvingEvent = dynamic_cast<ResolvingEventHandler *>(event);
+	for (size_t i = 0; i < LOOKUP_THREADS; i++)
+		lookupThreads.push_back(new std::thread(&Listener::runLookups, this));
+	for (size_t i = 0; i < DISPATCH_WORKERS; i++) {
+		sDispatchQueue *queue = new sDispatchQueue();
+		queue->thread = new std::thread(&Listener::runDispatcher, this, queue);
+		dispatchQueues.push_back(queue);
+	}
+	sMonitorTimeouts timeouts;
+	timeouts.idleTimeout = gConfig->getListenerIdleTimeout();
+	engine = new MonitorEngine(RETRY_DELAY, 3600, timeouts);
+	// added first, so it gets the id 0
+	engine->addBox(gConfig->getUrl(), gConfig->getListenerPort(), this);
 }
 
 Listener::~Listener()
 {
-	if (thread) {
-		cancelThread();
-		int r = pthread_cancel(threadNativeHandle);
-		if (r != 0)
-			ERR(std::string{"could not cancel thread: "} + strerror(r));
+	delete engine;
+	// let the workers finish the events already read, including those waiting for a lookup
+	dispatchStop = true;
+	for (sDispatchQueue *queue : dispatchQueues) {
+		{
+			std::lock_guard<std::mutex> lock(queue->mutex);
+			queue->wakeup.notify_one();
+		}
+		queue->thread->join();
+		delete queue->thread;
+		delete queue;
+	}
+	{
+		std::lock_guard<std::mutex> lock(lookupMutex);
+		lookupStop = true;
+		lookupWakeup.notify_all();
+	}
+	for (std::thread *thread : lookupThreads) {
+		thread->join();
 		delete thread;
 	}
 }
 
-void Listener::cancelThread() {
-	cancelRequested = true;
-	if (tcpClientPtr)
-		tcpClientPtr->expireStreamNow();
-}
-
 void Listener::CreateListener(EventHandler *event) {
 	EventHandler *oldEvent = me ? me->event : nullptr;
 	DeleteListener();
@@ -79,150 +137,351 @@ void Listener::DeleteListener() {
 	}
 }
 
-void Listener::handleNewCall(bool outgoing, int connId, std::string remoteNumber, std::string localParty, std::string medium) {
-	if ( Tools::MatchesMsnFilter(localParty) ) {
-		// do reverse lookup
-		Fonbook::sResolveResult result = FonbookManager::GetFonbook()->resolveToName(remoteNumber);
+bool Listener::GetMonitorMetrics(sMonitorMetrics &metrics) {
+	if (!me)
+		return false;
+	metrics = me->engine->getMetrics();
+	metrics.droppedEvents = me->droppedEvents;
+	return true;
+}
+
+bool Listener::GetMonitorMetrics(size_t box, sMonitorMetrics &metrics) {
+	if (!me)
+		return false;
+	return me->engine->getMetrics(box, metrics);
+}
+
+bool Listener::AddBox(const std::string &host, int port, size_t &box) {
+	if (!me)
+		return false;
+	box = me->engine->addBox(host, port, me);
+	return true;
+}
+
+bool Listener::RemoveBox(size_t box) {
+	if (!me)
+		return false;
+	me->engine->removeBox(box);
+	return true;
+}
+
+size_t Listener::Subscribe(EventHandler *handler, Subscription::eOverflowPolicy policy, size_t capacity) {
+	std::lock_guard<std::mutex> lock(subscriptionMutex);
+	size_t id = nextSubscription++;
+	subscriptions[id] = std::make_shared<Subscription>(handler, policy, capacity);
+	return id;
+}
+
+void Listener::Unsubscribe(size_t id) {
+	std::shared_ptr<Subscription> subscription;
+	{
+		std::lock_guard<std::mutex> lock(subscriptionMutex);
+		auto it = subscriptions.find(id);
+		if (it == subscriptions.end())
+			return;
+		subscription = it->second;
+		subscriptions.erase(it);
+	}
+	// stop outside the lock, a dispatch worker may wait for this subscription
+	subscription->stop();
+}
+
+bool Listener::GetSubscriptionMetrics(size_t id, sSubscriptionMetrics &metrics) {
+	std::lock_guard<std::mutex> lock(subscriptionMutex);
+	auto it = subscriptions.find(id);
+	if (it == subscriptions.end())
+		return false;
+	metrics = it->second->getMetrics();
+	return true;
+}
+
+void Listener::handleNewCall(bool outgoing, const MonitorEvent &monitorEvent, std::string &&remoteNumber, std::string &&localParty, std::string &&medium) {
+	PipelineLatency &latency = PipelineLatency::Get();
+	uint64_t start = PipelineLatency::Now();
+	bool matches = Tools::MatchesMsnFilter(localParty);
+	latency.record(PipelineLatency::MSN_FILTER, PipelineLatency::Now() - start);
+	if ( matches ) {
+		size_t box = monitorEvent.box;
+		int connId = monitorEvent.connId;
+		uint64_t receiveTime = monitorEvent.receiveTime;
 		// resolve SIP names
+		start = PipelineLatency::Now();
 		std::string mediumName;
 		if (medium.find("SIP")           != std::string::npos &&
 				gConfig->getSipNames().size() > (size_t)atoi(&medium[3]))
 			mediumName = gConfig->getSipNames()[atoi(&medium[3])];
 		else
 			mediumName = medium;
-		// notify application
-		if (event) event->handleCall(outgoing, connId, remoteNumber, result.name, result.type, localParty, medium, mediumName);
-		activeConnections.push_back(connId);
+		latency.record(PipelineLatency::SIP_NAMES, PipelineLatency::Now() - start);
+		CallSession session;
+		session.box          = box;
+		session.connId       = connId;
+		session.outgoing     = outgoing;
+		session.startTime    = monitorEvent.boxTime ? monitorEvent.boxTime : time(nullptr);
+		session.remoteNumber = remoteNumber;
+		session.localNumber  = localParty;
+		session.medium       = mediumName;
+		// the strings of the monitor event are not needed anymore
+		std::shared_ptr<CallEvent> callEvent = std::make_shared<CallEvent>(CallEvent::CALL, connId, box);
+		callEvent->outgoing     = outgoing;
+		callEvent->remoteNumber = std::move(remoteNumber);
+		callEvent->localParty   = std::move(localParty);
+		callEvent->medium       = std::move(medium);
+		callEvent->mediumName   = std::move(mediumName);
+		auto notifyCall = [this, session, callEvent, receiveTime](Fonbook::sResolveResult &result) mutable {
+			session.remoteName    = result.successful ? result.name : "";
+			sessions.begin(session);
+			callEvent->remoteName = std::move(result.name);
+			callEvent->remoteType = result.type;
+			uint64_t start = PipelineLatency::Now();
+			notify(callEvent);
+			recordHandled(receiveTime, start);
+		};
+		if (!resolvingEvent) {
+			// the application needs the name with the call, so notify it when the lookup is done
+			resolveLater(monitorEvent, callEvent->remoteNumber, notifyCall);
+			return;
+		}
+		// applications that can handle a late result get notified before remote lookups
+		start = PipelineLatency::Now();
+		Fonbook::sResolveResult result = FonbookManager::GetFonbook()->resolveToNameLocally(callEvent->remoteNumber);
+		latency.record(PipelineLatency::RESOLVE, PipelineLatency::Now() - start);
+		bool successful = result.successful;
+		notifyCall(result);
+		if (!successful)
+			resolveLater(monitorEvent, callEvent->remoteNumber, [this, box, connId](Fonbook::sResolveResult &result) {
+				if (result.successful) {
+					sessions.resolve(connId, result.name, box);
+					std::shared_ptr<CallEvent> resolvedEvent = std::make_shared<CallEvent>(CallEvent::RESOLVED, connId, box);
+					resolvedEvent->remoteName = std::move(result.name);
+					resolvedEvent->remoteType = result.type;
+					notify(resolvedEvent);
+				}
+			});
 	}
 }
 
-void Listener::handleConnect(int connId) {
-	// only notify application if this connection is part of activeConnections
-	bool notify = false;
-	for (std::vector<int>::iterator it = activeConnections.begin(); it < activeConnections.end(); ++it) {
-		if (*it == connId) {
-			notify = true;
-			break;
-		}
+void Listener::resolveLater(const MonitorEvent &monitorEvent, const std::string &number, std::function<void(Fonbook::sResolveResult &)> done) {
+	size_t box = monitorEvent.box;
+	int connId = monitorEvent.connId;
+	sDispatchQueue *queue = queueOf(box, connId);
+	// hold back later events of this connection until the result is applied
+	queue->deferred[std::make_pair(box, connId)];
+	std::lock_guard<std::mutex> lock(lookupMutex);
+	lookups.push_back([this, queue, box, connId, number, done]() {
+		uint64_t start = PipelineLatency::Now();
+		Fonbook::sResolveResult result = FonbookManager::GetFonbook()->resolveToName(number);
+		PipelineLatency::Get().record(PipelineLatency::RESOLVE, PipelineLatency::Now() - start);
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		queue->completions.push_back([this, queue, box, connId, result, done]() mutable {
+			done(result);
+			resume(queue, box, connId);
+		});
+		queue->wakeup.notify_one();
+	});
+	lookupWakeup.notify_one();
+}
+
+void Listener::resume(sDispatchQueue *queue, size_t box, int connId) {
+	auto it = queue->deferred.find(std::make_pair(box, connId));
+	if (it == queue->deferred.end())
+		return;
+	std::deque<MonitorEvent> events;
+	events.swap(it->second);
+	queue->deferred.erase(it);
+	// an event may start another lookup, process() holds back the remaining ones then
+	while (!events.empty()) {
+		process(queue, events.front());
+		events.pop_front();
 	}
-	if (notify)
-		if (event) event->handleConnect(connId);
 }
 
-void Listener::handleDisconnect(int connId, std::string duration) {
-	// only notify application if this connection is part of activeConnections
-	bool notify = false;
-	for (std::vector<int>::iterator it = activeConnections.begin(); it < activeConnections.end(); ++it) {
-		if (*it == connId) {
-			activeConnections.erase(it);
-			notify = true;
-			break;
+void Listener::handleConnect(const MonitorEvent &monitorEvent) {
+	// only notify application if this connection is tracked
+	if (sessions.connect(monitorEvent.connId, monitorEvent.boxTime, monitorEvent.box)) {
+		uint64_t start = PipelineLatency::Now();
+		notify(std::make_shared<CallEvent>(CallEvent::CONNECT, monitorEvent.connId, monitorEvent.box));
+		recordHandled(monitorEvent.receiveTime, start);
+	}
+}
+
+void Listener::handleDisconnect(const MonitorEvent &monitorEvent, std::string &&duration) {
+	// only notify application if this connection is tracked
+	CallEntry ce;
+	if (sessions.end(monitorEvent.connId, atoll(duration.c_str()), ce, monitorEvent.box)) {
+		std::shared_ptr<CallEvent> callEvent = std::make_shared<CallEvent>(CallEvent::DISCONNECT, monitorEvent.connId, monitorEvent.box);
+		callEvent->duration = std::move(duration);
+		uint64_t start = PipelineLatency::Now();
+		notify(callEvent);
+		recordHandled(monitorEvent.receiveTime, start);
+		// the call list is the one of the box given to Config
+		CallList *callList = monitorEvent.box == 0 ? CallList::GetCallList(false) : nullptr;
+		if (callList) {
+			// show the call right away, the entry of the Fritz!Box replaces it on a later reload;
+			// the box needs a moment to write it, so reloading right away would not find it
+			callList->addProvisional(ce);
+			callList->reloadLater(std::chrono::seconds(CONFIRM_RELOAD_DELAY));
 		}
 	}
-	if (notify) {
-		if (event) event->handleDisconnect(connId, duration);
-		// force reload of callList
-		CallList *callList = CallList::GetCallList(false);
-		if (callList)
-			callList->reload();
-	}
-}
-
-void Listener::run() {
-	DBG("Listener thread started");
-	unsigned int retry_delay = RETRY_DELAY / 2;
-	while (!cancelRequested) {
-		try {
-			retry_delay = retry_delay > 1800 ? 3600 : retry_delay * 2;
-			network::TcpClient tcpClient(gConfig->getUrl(), gConfig->getListenerPort());
-			tcpClientPtr = &tcpClient;
-			while (!cancelRequested) {
-				DBG("Waiting for a message.");
-
-				std::string line = tcpClient.readLine();
-				if (cancelRequested)
-					break;
-
-				if (gConfig->logPersonalInfo())
-					DBG("Got message " << line);
-
-				// split line into tokens
-				std::string date  = Tools::Tokenize(line, ';', 0);
-				std::string type  = Tools::Tokenize(line, ';', 1);
-				int connId        = atoi(Tools::Tokenize(line, ';', 2).c_str());
-				std::string partA = Tools::Tokenize(line, ';', 3);
-				std::string partB = Tools::Tokenize(line, ';', 4);
-				std::string partC = Tools::Tokenize(line, ';', 5);
-				std::string partD = Tools::Tokenize(line, ';', 6);
+}
+
+void Listener::notify(const CallEventPtr &callEvent) {
+	std::vector<std::shared_ptr<Subscription>> current;
+	{
+		std::lock_guard<std::mutex> lock(subscriptionMutex);
+		for (auto &subscription : subscriptions)
+			current.push_back(subscription.second);
+	}
+	for (auto &subscription : current)
+		subscription->push(callEvent);
+	if (event) {
+		std::lock_guard<std::mutex> lock(eventMutex);
+		event->handleEvent(callEvent);
+	}
+}
+
+void Listener::recordHandled(uint64_t receiveTime, uint64_t handlerStart) {
+	uint64_t now = PipelineLatency::Now();
+	PipelineLatency::Get().record(PipelineLatency::HANDLER, now - handlerStart);
+	// events injected without passing the engine carry no receive time
+	if (receiveTime)
+		PipelineLatency::Get().record(PipelineLatency::TOTAL, now - receiveTime);
+}
+
+void Listener::process(sDispatchQueue *queue, MonitorEvent &monitorEvent) {
+	auto it = queue->deferred.find(std::make_pair(monitorEvent.box, monitorEvent.connId));
+	if (it != queue->deferred.end())
+		it->second.push_back(std::move(monitorEvent));
+	else
+		handleEvent(monitorEvent);
+}
+
+void Listener::handleEvent(MonitorEvent &monitorEvent) {
+	std::string &partA = monitorEvent.partA;
+	std::string &partB = monitorEvent.partB;
+	std::string &partC = monitorEvent.partC;
+	std::string &partD = monitorEvent.partD;
 
 #if 0 // some strings sent from the FB, made available to xgettext
-					I18N_NOOP("POTS");
-					I18N_NOOP("ISDN");
+		I18N_NOOP("POTS");
+		I18N_NOOP("ISDN");
 #endif
 
-				if (type.compare("CALL") == 0) {
-					// partA => box port
-					// partB => caller Id (local)
-					// partC => called Id (remote)
-					// partD => medium (POTS, SIP[1-9], ISDN, ...)
-					DBG("CALL " << ", " << partA
-							    << ", " << (gConfig->logPersonalInfo() ? partB : HIDDEN)
-		                        << ", " << (gConfig->logPersonalInfo() ? partC : HIDDEN)
-		                        << ", " << partD);
-
-					// an '#' can be appended to outgoing calls by the phone, so delete it
-					if (partC[partC.length()-1] == '#')
-						partC = partC.substr(0, partC.length()-1);
-
-					handleNewCall(true, connId, partC, partB, partD);
-
-				} else if (type.compare("RING") == 0) {
-					// partA => caller Id (remote)
-					// partB => called Id (local)
-					// partC => medium (POTS, SIP[1-9], ISDN, ...)
-					DBG("RING " << ", " << (gConfig->logPersonalInfo() ? partA : HIDDEN)
-							    << ", " << (gConfig->logPersonalInfo() ? partB : HIDDEN)
-		                        << ", " << partC);
-
-					handleNewCall(false, connId, partA, partB, partC);
-
-				} else if (type.compare("CONNECT") == 0) {
-					// partA => box port
-					// partB => local/remote Id
-					DBG("CONNECT " << ", " << partA
-							       << ", " << (gConfig->logPersonalInfo() ? partB : HIDDEN));
-
-					handleConnect(connId);
-
-				} else if (type.compare("DISCONNECT") == 0) {
-					// partA => call duration
-					DBG("DISCONNECT " << ", " << partA );
-
-					handleDisconnect(connId, partA);
-
-				} else {
-					DBG("Got unknown message " << line);
-					throw this;
-				}
-				retry_delay = RETRY_DELAY;
-			}
-		} catch(std::runtime_error &re) {
-			ERR("Exception - " << re.what());
-			// TODO: Detect reason for exception
-			//if (se.getSocketError() == ost::Socket::errConnectRefused)
-			ERR("Make sure to enable the Fritz!Box call monitor by dialing #96*5* once.");
-		} catch (Listener *listener) {
-			ERR("Exception unknown data received.");
+	switch (monitorEvent.type) {
+	case MonitorEvent::CALL:
+		// partA => box port
+		// partB => caller Id (local)
+		// partC => called Id (remote)
+		// partD => medium (POTS, SIP[1-9], ISDN, ...)
+		DBG("CALL " << ", " << partA
+				    << ", " << (gConfig->logPersonalInfo() ? partB : HIDDEN)
+                        << ", " << (gConfig->logPersonalInfo() ? partC : HIDDEN)
+                        << ", " << partD);
+
+		// an '#' can be appended to outgoing calls by the phone, so delete it
+		if (partC.size() && partC[partC.length()-1] == '#')
+			partC.erase(partC.length()-1);
+
+		handleNewCall(true, monitorEvent, std::move(partC), std::move(partB), std::move(partD));
+		break;
+
+	case MonitorEvent::RING:
+		// partA => caller Id (remote)
+		// partB => called Id (local)
+		// partC => medium (POTS, SIP[1-9], ISDN, ...)
+		DBG("RING " << ", " << (gConfig->logPersonalInfo() ? partA : HIDDEN)
+				    << ", " << (gConfig->logPersonalInfo() ? partB : HIDDEN)
+                        << ", " << partC);
+
+		handleNewCall(false, monitorEvent, std::move(partA), std::move(partB), std::move(partC));
+		break;
+
+	case MonitorEvent::CONNECT:
+		// partA => box port
+		// partB => local/remote Id
+		DBG("CONNECT " << ", " << partA
+				       << ", " << (gConfig->logPersonalInfo() ? partB : HIDDEN));
+
+		handleConnect(monitorEvent);
+		break;
+
+	case MonitorEvent::DISCONNECT:
+		// partA => call duration
+		DBG("DISCONNECT " << ", " << partA );
+
+		handleDisconnect(monitorEvent, std::move(partA));
+		break;
+
+	default:
+		break;
+	}
+}
+
+void Listener::handleMonitorEvent(size_t box, MonitorEvent &monitorEvent) {
+	monitorEvent.box = box;
+	dispatch(monitorEvent);
+}
+
+Listener::sDispatchQueue *Listener::queueOf(size_t box, int connId) const {
+	return dispatchQueues[(box + (unsigned int) connId) % dispatchQueues.size()];
+}
+
+void Listener::dispatch(MonitorEvent &monitorEvent) {
+	sDispatchQueue *queue = queueOf(monitorEvent.box, monitorEvent.connId);
+	if (!queue->ring.push(monitorEvent)) {
+		// the engine thread must not wait, it serves the keepalive and timers of all boxes
+		droppedEvents++;
+		ERR("dispatch queue full, dropped event of connection " << monitorEvent.connId << " of box " << monitorEvent.box);
+		return;
+	}
+	// pairs with the fence in runDispatcher(), either the worker sees the event or we see it waiting
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (queue->waiting) {
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		queue->wakeup.notify_one();
+	}
+}
+
+void Listener::runDispatcher(sDispatchQueue *queue) {
+	MonitorEvent monitorEvent;
+	while (true) {
+		if (queue->ring.pop(monitorEvent)) {
+			if (monitorEvent.receiveTime)
+				PipelineLatency::Get().record(PipelineLatency::QUEUE, PipelineLatency::Now() - monitorEvent.receiveTime);
+			process(queue, monitorEvent);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(queue->mutex);
+		if (!queue->completions.empty()) {
+			std::function<void()> completion = std::move(queue->completions.front());
+			queue->completions.pop_front();
+			lock.unlock();
+			completion();
+			continue;
 		}
-		tcpClientPtr = nullptr;
-		if (cancelRequested)
+		// on shutdown, wait for the lookups of held back connections
+		if (dispatchStop && queue->deferred.empty())
+			break;
+		queue->waiting = true;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (queue->ring.empty() && !(dispatchStop && queue->deferred.empty()))
+			queue->wakeup.wait_for(lock, std::chrono::seconds(1));
+		queue->waiting = false;
+	}
+}
+
+void Listener::runLookups() {
+	std::unique_lock<std::mutex> lock(lookupMutex);
+	while (true) {
+		lookupWakeup.wait(lock, [this]() { return !lookups.empty() || lookupStop; });
+		if (lookups.empty())
 			break;
-		ERR("waiting " << retry_delay << " seconds before retrying");
-		unsigned int retry_delay_counter = retry_delay;
-		while (--retry_delay_counter && !cancelRequested) // delay the retry
-			std::this_thread::sleep_for(std::chrono::seconds(1));
+		std::function<void()> lookup = std::move(lookups.front());
+		lookups.pop_front();
+		lock.unlock();
+		lookup();
+		lock.lock();
 	}
-	DBG("Listener thread ended");
 }
 
 }
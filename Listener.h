@@ -22,13 +22,24 @@
 #ifndef FRITZLISTENER_H
 #define FRITZLISTENER_H
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
-#include <libnet++/TcpClient.h>
 
 
+#include "CallSessionTracker.h"
 #include "Fonbook.h"
+#include "MonitorDecoder.h"
+#include "MonitorEngine.h"
+#include "SpscRing.h"
+#include "Subscription.h"
 
 namespace fritz{
 
@@ -41,31 +52,139 @@ public:
 	std::string medium;
 };
 
+/**
+ * A call event as passed to EventHandler::handleEvent().
+ * The event is created once by the Listener and not modified afterwards, so
+ * it can be shared without copying its strings.
+ */
+struct CallEvent {
+	enum eType {
+		CALL,                    // a new incoming or outgoing call
+		RESOLVED,                // a late result of the reverse lookup, see ResolvingEventHandler
+		CONNECT,
+		DISCONNECT,
+	};
+	eType type;
+	size_t box;                           // 0 for the box given to Config, see Listener::AddBox()
+	int connId;
+	bool outgoing;                        // CALL only
+	std::string remoteNumber;             // CALL only
+	std::string remoteName;               // CALL, RESOLVED
+	fritz::FonbookEntry::eType remoteType;// CALL, RESOLVED
+	std::string localParty;               // CALL only
+	std::string medium;                   // CALL only
+	std::string mediumName;               // CALL only
+	std::string duration;                 // DISCONNECT only
+	CallEvent(eType type, int connId, size_t box = 0) : type{type}, box{box}, connId{connId}, outgoing{false}, remoteType{FonbookEntry::TYPE_NONE} {}
+};
+typedef std::shared_ptr<const CallEvent> CallEventPtr;
+
+/**
+ * Receives the call events of the Listener.
+ * The methods of the handler given to Listener::CreateListener() are called one at a
+ * time, but not always from the same thread, as events are dispatched by several worker
+ * threads. A slow handler delays all events. Handlers added by Listener::Subscribe() are
+ * called from the own thread of their subscription.
+ */
 class EventHandler {
 
 public:
 	EventHandler() { }
 	virtual ~EventHandler() { }
 
-	virtual void handleCall(bool outgoing, int connId, std::string remoteNumber, std::string remoteName, fritz::FonbookEntry::eType remoteType, std::string localParty, std::string medium, std::string mediumName) = 0;
-	virtual void handleConnect(int connId) = 0;
-	virtual void handleDisconnect(int connId, std::string duration) = 0;
+	/**
+	 * Called for each call event. The default implementation calls handleCall(),
+	 * handleConnect() and handleDisconnect(), so applications implement either this
+	 * method or the specific ones. Applications monitoring several boxes implement
+	 * this method, the specific ones do not tell the box.
+	 * @param the event, which may be kept beyond the call
+	 */
+	virtual void handleEvent(const CallEventPtr &event);
+	virtual void handleCall(bool outgoing, int connId, std::string remoteNumber, std::string remoteName, fritz::FonbookEntry::eType remoteType, std::string localParty, std::string medium, std::string mediumName);
+	virtual void handleConnect(int connId);
+	virtual void handleDisconnect(int connId, std::string duration);
+};
+
+/**
+ * Event handler for applications that want to be notified of a call before the
+ * reverse lookup has finished.
+ * handleCall() is called right away with the result of local phonebooks. If this result is
+ * not successful, handleCallResolved() follows when a costly lookup, e.g., via HTTP, found a name.
+ * For a connection, handleCallResolved() is always called before handleConnect(), later
+ * events of that connection are held back until the lookup finished.
+ * Applications implementing handleEvent() get a CallEvent::RESOLVED event instead.
+ */
+class ResolvingEventHandler : public EventHandler {
+
+public:
+	virtual void handleEvent(const CallEventPtr &event) override;
+	virtual void handleCallResolved(int connId, std::string remoteName, fritz::FonbookEntry::eType remoteType);
 };
 
-class Listener {
+class Listener : private MonitorSink {
 private:
-	bool cancelRequested = false;
+	/**
+	 * Events are handled by a pool of dispatch workers, so that a slow reverse lookup
+	 * does not delay reading from the call monitor. All events of a connection are
+	 * handled by the same worker, which keeps them in order. The thread of the engine
+	 * never waits for a worker, events that do not fit into a full queue are dropped
+	 * and counted in sMonitorMetrics::droppedEvents.
+	 */
+	static const size_t DISPATCH_WORKERS = 4;
+	static const size_t DISPATCH_QUEUE_SIZE = 256;
+	/**
+	 * Remote lookups run on a pool of lookup threads, so that a slow lookup does not
+	 * delay the other connections of a worker. The result is posted back to the worker
+	 * of the connection, which holds back later events of that connection until then.
+	 */
+	static const size_t LOOKUP_THREADS = 4;
+	/**
+	 * Seconds after a call ended until the call list is reloaded, to confirm its provisional entry.
+	 */
+	static const unsigned int CONFIRM_RELOAD_DELAY = 10;
+	struct sDispatchQueue {
+		SpscRing<MonitorEvent> ring;
+		std::mutex mutex;                  // guards completions, used for waking up the worker
+		std::condition_variable wakeup;
+		std::atomic<bool> waiting;         // the worker waits for events
+		std::thread *thread;
+		std::deque<std::function<void()>> completions;                // finished lookups, applied by the worker
+		std::map<std::pair<size_t, int>, std::deque<MonitorEvent>> deferred;   // events of connections waiting for a lookup, by box and id, worker only
+		sDispatchQueue() : ring{DISPATCH_QUEUE_SIZE}, waiting{false}, thread{nullptr} {}
+	};
+	std::atomic<uint64_t> droppedEvents;
 	static Listener *me;
 	EventHandler *event;
-	std::vector<int> activeConnections;
-	std::thread *thread;
-	pthread_t threadNativeHandle;
-	network::TcpClient *tcpClientPtr = nullptr;
+	std::mutex eventMutex;                 // the workers call event one at a time
+	ResolvingEventHandler *resolvingEvent;
+	CallSessionTracker sessions;
+	std::vector<sDispatchQueue *> dispatchQueues;
+	std::atomic<bool> dispatchStop;
+	std::mutex lookupMutex;
+	std::condition_variable lookupWakeup;
+	std::deque<std::function<void()>> lookups;
+	std::vector<std::thread *> lookupThreads;
+	bool lookupStop;
+	MonitorEngine *engine;
+	// subscriptions are independent of the listener instance, they survive CreateListener()
+	static std::mutex subscriptionMutex;
+	static std::map<size_t, std::shared_ptr<Subscription>> subscriptions;
+	static size_t nextSubscription;
 	Listener(EventHandler *event);
-	void handleNewCall(bool outgoing, int connId, std::string remoteNumber, std::string localParty, std::string medium);
-	void handleConnect(int connId);
-	void handleDisconnect(int connId, std::string duration);
-	void cancelThread();
+	void handleNewCall(bool outgoing, const MonitorEvent &monitorEvent, std::string &&remoteNumber, std::string &&localParty, std::string &&medium);
+	void handleConnect(const MonitorEvent &monitorEvent);
+	void handleDisconnect(const MonitorEvent &monitorEvent, std::string &&duration);
+	void notify(const CallEventPtr &callEvent);
+	void recordHandled(uint64_t receiveTime, uint64_t handlerStart);
+	void resolveLater(const MonitorEvent &monitorEvent, const std::string &number, std::function<void(Fonbook::sResolveResult &)> done);
+	void resume(sDispatchQueue *queue, size_t box, int connId);
+	void process(sDispatchQueue *queue, MonitorEvent &monitorEvent);
+	void handleEvent(MonitorEvent &monitorEvent);
+	void dispatch(MonitorEvent &monitorEvent);
+	sDispatchQueue *queueOf(size_t box, int connId) const;
+	void runDispatcher(sDispatchQueue *queue);
+	void runLookups();
+	void handleMonitorEvent(size_t box, MonitorEvent &monitorEvent) override;
 public:
 	/**
 	 * Activate listener support.
@@ -77,8 +196,63 @@ public:
 	 */
 	static void CreateListener(EventHandler *event = nullptr);
 	static void DeleteListener();
+	/**
+	 * Returns the counters of the call monitor connection, e.g., the number of dead
+	 * connections detected, the time needed to re-establish them and the number of
+	 * events dropped as the dispatch workers fell behind.
+	 * @param the counters
+	 * @return false, if there is no listener
+	 */
+	static bool GetMonitorMetrics(sMonitorMetrics &metrics);
+	/**
+	 * Returns the counters of the call monitor connection of one box.
+	 * @param the id of the box, 0 for the box given to Config
+	 * @param the counters, without droppedEvents
+	 * @return false, if there is no listener or no such box
+	 */
+	static bool GetMonitorMetrics(size_t box, sMonitorMetrics &metrics);
+	/**
+	 * Monitors a further Fritz!Box with the same listener. Its events are passed to the same
+	 * handlers, CallEvent::box tells them apart. Only calls of the box given to Config are
+	 * added to the CallList. The boxes are removed by DeleteListener() and CreateListener().
+	 * @param host name or address of the box
+	 * @param the call monitor port of the box
+	 * @param set to the id of the box, as found in CallEvent::box
+	 * @return false, if there is no listener
+	 */
+	static bool AddBox(const std::string &host, int port, size_t &box);
+	/**
+	 * Stops monitoring a box added by AddBox(). Events already received are still passed on.
+	 * @param the id of the box
+	 * @return false, if there is no listener
+	 */
+	static bool RemoveBox(size_t box);
+	/**
+	 * Adds an additional EventHandler, e.g., for logging. Each subscriber gets the
+	 * call events via handleEvent() from an own queue and thread, so that a slow
+	 * subscriber does not delay others, unless it uses Subscription::BLOCK.
+	 * Late lookup results (CallEvent::RESOLVED) are only generated if the EventHandler
+	 * given to CreateListener() is a ResolvingEventHandler.
+	 * @param the handler, has to exist until Unsubscribe() returns
+	 * @param what happens to new events if the handler falls behind
+	 * @param the maximum number of queued events
+	 * @return the id of the subscription
+	 */
+	static size_t Subscribe(EventHandler *handler, Subscription::eOverflowPolicy policy = Subscription::DROP_OLDEST, size_t capacity = 256);
+	/**
+	 * Removes a subscription. Waits for a running call of the handler, queued events are discarded.
+	 * It may be called by the handler of the subscription itself, it does not wait then.
+	 * @param the id returned by Subscribe()
+	 */
+	static void Unsubscribe(size_t id);
+	/**
+	 * Returns the counters of a subscription, e.g., its queue depth.
+	 * @param the id returned by Subscribe()
+	 * @param the counters
+	 * @return false, if there is no such subscription
+	 */
+	static bool GetSubscriptionMetrics(size_t id, sSubscriptionMetrics &metrics);
 	virtual ~Listener();
-	void run();
 };
 
 }
@@ -39,18 +39,26 @@ bool LookupFonbook::initialize() {
 
 Fonbook::sResolveResult LookupFonbook::resolveToName(std::string number) {
 	// First, try to get a cached result
-	sResolveResult resolve = Fonbook::resolveToName(number);
+	sResolveResult resolve = resolveToNameLocally(number);
 	// Second, to lookup (e.g., via HTTP)
 	if (! resolve.successful) {
 		resolve = lookup(number);
 		// cache result despite it was successful
 		FonbookEntry fe(resolve.name, false);
 		fe.addNumber(number, resolve.type, "", "", 0);
-		addFonbookEntry(fe);
+		boost::unique_lock<boost::shared_mutex> lock(cacheMutex);
+		// another thread may have looked up the same number in the meantime
+		if (! Fonbook::resolveToName(number).successful)
+			addFonbookEntry(fe);
 	}
 	return resolve;
 }
 
+Fonbook::sResolveResult LookupFonbook::resolveToNameLocally(std::string number) {
+	boost::shared_lock<boost::shared_mutex> lock(cacheMutex);
+	return Fonbook::resolveToName(number);
+}
+
 Fonbook::sResolveResult LookupFonbook::lookup(std::string number) const {
 	sResolveResult result(number);
 	return result;
@@ -22,11 +22,18 @@
 #ifndef LOOKUPFONBOOK_H_
 #define LOOKUPFONBOOK_H_
 
+#include <boost/thread/shared_mutex.hpp>
+
 #include "Fonbook.h"
 
 namespace fritz {
 
 class LookupFonbook: public Fonbook {
+private:
+	/**
+	 * Guards the cache of previous lookups, lookups run in several threads at the same time.
+	 */
+	mutable boost::shared_mutex cacheMutex;
 public:
 	LookupFonbook(std::string title, std::string techId, bool writeable = false);
 	virtual ~LookupFonbook();
@@ -42,6 +49,12 @@ public:
 	 * @return resolved name and type or the number, if unsuccessful
 	 */
 	sResolveResult resolveToName(std::string number) override;
+	/**
+	 * Resolves the number using results of previous lookups only.
+	 * @param number to resolve
+	 * @return resolved name and type or the number, if unsuccessful
+	 */
+	sResolveResult resolveToNameLocally(std::string number) override;
 	/**
 	 * Resolves number doing a (costly) lookup
 	 * @param number to resolve
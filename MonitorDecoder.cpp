@@ -0,0 +1,101 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "MonitorDecoder.h"
+
+#include <cstring>
+
+namespace fritz {
+
+static MonitorEvent::eType DecodeType(const char *type, size_t length) {
+	// the length and first character identify the type, the remainder is verified
+	switch (length) {
+	case 4:
+		if (type[0] == 'C')
+			return memcmp(type, "CALL", 4) == 0 ? MonitorEvent::CALL : MonitorEvent::UNKNOWN;
+		if (type[0] == 'R')
+			return memcmp(type, "RING", 4) == 0 ? MonitorEvent::RING : MonitorEvent::UNKNOWN;
+		return MonitorEvent::UNKNOWN;
+	case 7:
+		return memcmp(type, "CONNECT", 7) == 0 ? MonitorEvent::CONNECT : MonitorEvent::UNKNOWN;
+	case 10:
+		return memcmp(type, "DISCONNECT", 10) == 0 ? MonitorEvent::DISCONNECT : MonitorEvent::UNKNOWN;
+	default:
+		return MonitorEvent::UNKNOWN;
+	}
+}
+
+static int ParseInt(const char *digits, size_t length) {
+	int value = 0;
+	for (size_t pos = 0; pos < length && digits[pos] >= '0' && digits[pos] <= '9'; pos++)
+		value = value * 10 + (digits[pos] - '0');
+	return value;
+}
+
+time_t MonitorDecoder::ParseTime(const char *date, size_t length) {
+	//       01234567890123456
+	// date: dd.mm.yy hh:mm:ss
+	if (length < 17)
+		return 0;
+	tm tmTime;
+	tmTime.tm_mday  = ParseInt(date,      2);
+	tmTime.tm_mon   = ParseInt(date +  3, 2) - 1;
+	tmTime.tm_year  = ParseInt(date +  6, 2) + 100;
+	tmTime.tm_hour  = ParseInt(date +  9, 2);
+	tmTime.tm_min   = ParseInt(date + 12, 2);
+	tmTime.tm_sec   = ParseInt(date + 15, 2);
+	tmTime.tm_isdst = -1;
+	return mktime(&tmTime);
+}
+
+bool MonitorDecoder::Decode(const std::string &line, MonitorEvent &event) {
+	return Decode(line.data(), line.size(), event);
+}
+
+bool MonitorDecoder::Decode(const char *line, size_t lineLength, MonitorEvent &event) {
+	// split line into fields in a single pass
+	const size_t FIELDS = 7;
+	const char *start[FIELDS];
+	size_t length[FIELDS];
+	const char *pos = line;
+	const char *end = pos + lineLength;
+	while (end > pos && (end[-1] == '\r' || end[-1] == '\n'))
+		end--;
+	for (size_t field = 0; field < FIELDS; field++) {
+		const char *stop = pos < end ? static_cast<const char *>(memchr(pos, ';', end - pos)) : nullptr;
+		if (!stop)
+			stop = end;
+		start[field]  = pos;
+		length[field] = stop - pos;
+		pos = stop < end ? stop + 1 : end;
+	}
+
+	event.type    = DecodeType(start[1], length[1]);
+	event.boxTime = ParseTime(start[0], length[0]);
+	event.connId  = ParseInt(start[2], length[2]);
+	event.partA.assign(start[3], length[3]);
+	event.partB.assign(start[4], length[4]);
+	event.partC.assign(start[5], length[5]);
+	event.partD.assign(start[6], length[6]);
+	return event.type != MonitorEvent::UNKNOWN;
+}
+
+}
@@ -0,0 +1,87 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef MONITORDECODER_H
+#define MONITORDECODER_H
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+namespace fritz {
+
+/**
+ * A line received from the Fritz!Box call monitor.
+ * Objects of this class are meant to be reused for subsequent lines, so that
+ * decoding does not allocate memory once the strings have grown large enough.
+ */
+class MonitorEvent {
+public:
+	enum eType {
+		UNKNOWN,
+		CALL,
+		RING,
+		CONNECT,
+		DISCONNECT
+	};
+	eType type;
+	time_t boxTime;                  // time stamp sent by the Fritz!Box
+	int connId;                      // connection id, unique while a call is active
+	std::string partA;               // meaning of the parts depends on the type, see Listener::run()
+	std::string partB;
+	std::string partC;
+	std::string partD;
+	uint64_t receiveTime;            // monotonic time in microseconds the line was received, see PipelineLatency::Now()
+	size_t box;                      // id of the box that sent the event, set by the Listener
+	MonitorEvent() : type{UNKNOWN}, boxTime{0}, connId{0}, receiveTime{0}, box{0} {}
+};
+
+class MonitorDecoder {
+public:
+	/**
+	 * Decodes a line sent by the Fritz!Box call monitor.
+	 * The line is scanned once, fields are copied into the reused event object.
+	 * Format: date;type;connId;partA;partB;partC;partD;
+	 * @param the line
+	 * @param the event to fill
+	 * @return true, if the line has a known type
+	 */
+	static bool Decode(const std::string &line, MonitorEvent &event);
+	/**
+	 * Decodes a line sent by the Fritz!Box call monitor, e.g., from a receive buffer.
+	 * @param the first character of the line
+	 * @param the length of the line
+	 * @param the event to fill
+	 * @return true, if the line has a known type
+	 */
+	static bool Decode(const char *line, size_t length, MonitorEvent &event);
+	/**
+	 * Parses the date field of a call monitor line.
+	 * @param the date in format dd.mm.yy hh:mm:ss
+	 * @param the length of the date field
+	 * @return the time or 0, if the date is invalid
+	 */
+	static time_t ParseTime(const char *date, size_t length);
+};
+
+}
+
+#endif /* MONITORDECODER_H */
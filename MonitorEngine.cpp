@@ -0,0 +1,528 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "MonitorEngine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Config.h"
+#include "LatencyHistogram.h"
+#include <liblog++/Log.h>
+
+namespace fritz {
+
+static const uint64_t WAKEUP_EVENT   = UINT64_MAX;
+static const uint64_t RESOLVED_EVENT = UINT64_MAX - 1;
+
+/**
+ * getaddrinfo() blocks, possibly for many seconds, so it runs in threads of its own.
+ * The threads are detached, a lookup in progress does not delay deleting the engine.
+ */
+struct MonitorEngine::sResolver {
+	struct sRequest {
+		size_t id;
+		uint64_t number;
+		std::string host;
+		int port;
+	};
+	struct sResult {
+		size_t id;
+		uint64_t number;
+		int error;
+		addrinfo *address;
+	};
+	std::mutex mutex;
+	std::condition_variable requestAdded;
+	std::deque<sRequest> requests;
+	std::vector<sResult> results;
+	bool stopRequested = false;
+	int eventFd;                    // signals new results to the engine
+
+	sResolver() : eventFd{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)} { }
+	~sResolver() {
+		for (sResult &result : results)
+			if (result.address)
+				freeaddrinfo(result.address);
+		close(eventFd);
+	}
+	static void Run(std::shared_ptr<sResolver> resolver) {
+		std::unique_lock<std::mutex> lock(resolver->mutex);
+		while (true) {
+			resolver->requestAdded.wait(lock, [&]{ return resolver->stopRequested || resolver->requests.size(); });
+			if (resolver->stopRequested)
+				return;
+			sRequest request = resolver->requests.front();
+			resolver->requests.pop_front();
+			lock.unlock();
+			addrinfo hints = {};
+			hints.ai_socktype = SOCK_STREAM;
+			sResult result{request.id, request.number, 0, nullptr};
+			result.error = getaddrinfo(request.host.c_str(), std::to_string(request.port).c_str(), &hints, &result.address);
+			lock.lock();
+			resolver->results.push_back(result);
+			uint64_t one = 1;
+			if (write(resolver->eventFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+				ERR(std::string{"could not signal resolved address: "} + strerror(errno));
+		}
+	}
+};
+
+MonitorEngine::MonitorEngine(unsigned int retryDelay, unsigned int maxRetryDelay, sMonitorTimeouts timeouts)
+: resolver{std::make_shared<sResolver>()}, commandsRequested{0}, commandsProcessed{0}, boxCount{0},
+  retryDelay{retryDelay ? retryDelay : 1}, maxRetryDelay{maxRetryDelay}, timeouts(timeouts), stopRequested{false},
+  randomGenerator{std::random_device{}()}
+{
+	currentTick = now() / TICK;
+	epollFd  = epoll_create1(EPOLL_CLOEXEC);
+	wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.u64 = WAKEUP_EVENT;
+	epoll_event resolvedEv = {};
+	resolvedEv.events = EPOLLIN;
+	resolvedEv.data.u64 = RESOLVED_EVENT;
+	if (epollFd < 0 || wakeupFd < 0 || resolver->eventFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &ev) < 0 ||
+			epoll_ctl(epollFd, EPOLL_CTL_ADD, resolver->eventFd, &resolvedEv) < 0)
+		ERR(std::string{"could not set up event loop: "} + strerror(errno));
+	for (size_t i = 0; i < RESOLVER_THREADS; i++)
+		std::thread(&sResolver::Run, resolver).detach();
+	thread = new std::thread(&MonitorEngine::run, this);
+}
+
+MonitorEngine::~MonitorEngine() {
+	stopRequested = true;
+	wakeup();
+	thread->join();
+	delete thread;
+	commandsDone.notify_all();
+	{
+		// the resolver threads end after their current lookup
+		std::lock_guard<std::mutex> lock(resolver->mutex);
+		resolver->stopRequested = true;
+		resolver->requestAdded.notify_all();
+	}
+	for (size_t id = 0; id < boxes.size(); id++) {
+		closeBox(id, false);
+		delete boxes[id];
+	}
+	for (sBox *box : addedBoxes)
+		delete box;
+	close(wakeupFd);
+	close(epollFd);
+}
+
+uint64_t MonitorEngine::now() const {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void MonitorEngine::wakeup() {
+	uint64_t one = 1;
+	if (write(wakeupFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		ERR(std::string{"could not wake up event loop: "} + strerror(errno));
+}
+
+size_t MonitorEngine::addBox(std::string host, int port, MonitorSink *sink) {
+	sBox *box = new sBox{host, port, sink, WAITING, -1, "", retryDelay, 0, 0, 0, 0};
+	std::lock_guard<std::mutex> lock(commandMutex);
+	addedBoxes.push_back(box);
+	commandsRequested++;
+	wakeup();
+	return boxCount++;
+}
+
+void MonitorEngine::removeBox(size_t id) {
+	if (std::this_thread::get_id() == thread->get_id()) {
+		// called by a sink, there may be pending additions that are processed first
+		processCommands();
+		if (id < boxes.size()) {
+			closeBox(id, false);
+			boxes[id]->state = REMOVED;
+		}
+		return;
+	}
+	std::unique_lock<std::mutex> lock(commandMutex);
+	removedBoxes.push_back(id);
+	uint64_t command = ++commandsRequested;
+	wakeup();
+	commandsDone.wait(lock, [&]{ return commandsProcessed >= command || stopRequested; });
+}
+
+void MonitorEngine::processCommands() {
+	std::vector<sBox *> added;
+	std::vector<size_t> removed;
+	uint64_t command;
+	{
+		std::lock_guard<std::mutex> lock(commandMutex);
+		added.swap(addedBoxes);
+		removed.swap(removedBoxes);
+		command = commandsRequested;
+	}
+	if (added.size()) {
+		std::lock_guard<std::mutex> lock(metricsMutex);
+		metrics.resize(boxes.size() + added.size());
+	}
+	for (sBox *box : added) {
+		boxes.push_back(box);
+		connectBox(boxes.size() - 1);
+	}
+	for (size_t id : removed) {
+		if (id < boxes.size()) {
+			closeBox(id, false);
+			boxes[id]->state = REMOVED;
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(commandMutex);
+		commandsProcessed = command;
+	}
+	commandsDone.notify_all();
+}
+
+void MonitorEngine::schedule(size_t id, uint64_t delay) {
+	sBox *box = boxes[id];
+	box->timerTick = currentTick + std::max<uint64_t>(1, (delay + TICK - 1) / TICK);
+	wheel[box->timerTick % WHEEL_SLOTS].push_back(id);
+}
+
+void MonitorEngine::advanceTimers() {
+	uint64_t tick = now() / TICK;
+	std::vector<size_t> expired;
+	while (currentTick < tick) {
+		currentTick++;
+		expired.clear();
+		expired.swap(wheel[currentTick % WHEEL_SLOTS]);
+		for (size_t id : expired) {
+			// timers are not removed from the wheel when a box changes its state
+			sBox *box = boxes[id];
+			if (box->timerTick > currentTick && box->timerTick % WHEEL_SLOTS == currentTick % WHEEL_SLOTS) {
+				// expires in a later round
+				wheel[currentTick % WHEEL_SLOTS].push_back(id);
+				continue;
+			}
+			if (box->timerTick != currentTick)
+				continue;
+			box->timerTick = 0;
+			switch (box->state) {
+			case WAITING:
+				connectBox(id);
+				break;
+			case RESOLVING:
+				ERR("Exception - timeout resolving " << box->host);
+				closeBox(id, true);
+				break;
+			case CONNECTING:
+				ERR("Exception - timeout connecting to " << box->host);
+				closeBox(id, true);
+				break;
+			case CONNECTED:
+				checkIdle(id);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+void MonitorEngine::connectBox(size_t id) {
+	sBox *box = boxes[id];
+	DBG("connecting to call monitor at " << box->host << ":" << box->port);
+	box->state = RESOLVING;
+	box->resolveRequest++;
+	schedule(id, timeouts.connectTimeout * 1000ULL);
+	std::lock_guard<std::mutex> lock(resolver->mutex);
+	resolver->requests.push_back(sResolver::sRequest{id, box->resolveRequest, box->host, box->port});
+	resolver->requestAdded.notify_one();
+}
+
+void MonitorEngine::handleResolved() {
+	uint64_t value;
+	if (read(resolver->eventFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+		ERR(std::string{"could not read resolver event: "} + strerror(errno));
+	std::vector<sResolver::sResult> results;
+	{
+		std::lock_guard<std::mutex> lock(resolver->mutex);
+		results.swap(resolver->results);
+	}
+	for (sResolver::sResult &result : results) {
+		// the box may have been removed or timed out in the meantime
+		if (result.id >= boxes.size() || boxes[result.id]->state != RESOLVING || boxes[result.id]->resolveRequest != result.number) {
+			if (result.address)
+				freeaddrinfo(result.address);
+			continue;
+		}
+		if (result.error != 0) {
+			ERR("Exception - could not resolve " << boxes[result.id]->host << ": " << gai_strerror(result.error));
+			closeBox(result.id, true);
+			continue;
+		}
+		startConnect(result.id, result.address);
+		freeaddrinfo(result.address);
+	}
+}
+
+void MonitorEngine::startConnect(size_t id, addrinfo *result) {
+	sBox *box = boxes[id];
+	box->state = CONNECTING;
+	box->fd = socket(result->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (box->fd >= 0) {
+		// the call monitor is silent between calls, so keepalive probes check if the box is still there
+		int on = 1;
+		int idle = timeouts.keepaliveIdle, interval = timeouts.keepaliveInterval, count = timeouts.keepaliveCount;
+		unsigned int userTimeout = (timeouts.keepaliveIdle + timeouts.keepaliveInterval * timeouts.keepaliveCount) * 1000;
+		if (setsockopt(box->fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) < 0 ||
+				setsockopt(box->fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) < 0 ||
+				setsockopt(box->fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) < 0 ||
+				setsockopt(box->fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count)) < 0 ||
+				setsockopt(box->fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &userTimeout, sizeof(userTimeout)) < 0)
+			ERR(std::string{"could not enable keepalive: "} + strerror(errno));
+	}
+	if (box->fd < 0 || (connect(box->fd, result->ai_addr, result->ai_addrlen) < 0 && errno != EINPROGRESS)) {
+		ERR("Exception - could not connect to " << box->host << ": " << strerror(errno));
+		closeBox(id, true);
+		return;
+	}
+	// the timeout scheduled by connectBox() covers resolving and connecting
+	epoll_event ev = {};
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+	ev.data.u64 = id;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, box->fd, &ev);
+}
+
+void MonitorEngine::closeBox(size_t id, bool retry, bool dead) {
+	sBox *box = boxes[id];
+	if (box->state == REMOVED)
+		return;
+	uint64_t time = now();
+	box->timerTick = 0;
+	if (!stopRequested) {
+		std::lock_guard<std::mutex> lock(metricsMutex);
+		if (box->state == RESOLVING || box->state == CONNECTING)
+			metrics[id].connectFailures++;
+		if (box->state == CONNECTED)
+			metrics[id].disconnects++;
+		if (dead) {
+			metrics[id].deadConnections++;
+			metrics[id].detectionLatency += time - box->lastActivity;
+			metrics[id].maxDetectionLatency = std::max(metrics[id].maxDetectionLatency, time - box->lastActivity);
+		}
+	}
+	if (box->state == CONNECTED)
+		box->lostAt = time;
+	if (box->fd >= 0) {
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, box->fd, nullptr);
+		close(box->fd);
+		box->fd = -1;
+	}
+	box->input.clear();
+	bool wasConnected = box->state == CONNECTED;
+	box->state = WAITING;
+	if (wasConnected && !stopRequested)
+		box->sink->handleMonitorDisconnected(id);
+	if (retry && dead && !stopRequested) {
+		// the box answered before, so try again right away
+		schedule(id, 0);
+	} else if (retry && !stopRequested) {
+		// wait between half and the full retry delay, so that many boxes do not retry in lockstep
+		uint64_t delay = box->retryDelay * 500ULL + randomGenerator() % (box->retryDelay * 500ULL + 1);
+		ERR("waiting " << delay / 1000 << " seconds before retrying");
+		schedule(id, delay);
+		box->retryDelay = box->retryDelay > maxRetryDelay / 2 ? maxRetryDelay : box->retryDelay * 2;
+	}
+}
+
+void MonitorEngine::handleIo(size_t id, uint32_t events) {
+	if (id >= boxes.size())
+		return;
+	sBox *box = boxes[id];
+	if (box->state == CONNECTING) {
+		int error = 0;
+		socklen_t length = sizeof(error);
+		if (getsockopt(box->fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+			ERR("Exception - could not connect to " << box->host << ": " << strerror(error));
+			ERR("Make sure to enable the Fritz!Box call monitor by dialing #96*5* once.");
+			closeBox(id, true);
+			return;
+		}
+		if (!(events & EPOLLOUT))
+			return;
+		DBG("connected to call monitor at " << box->host);
+		box->state = CONNECTED;
+		box->lastActivity = now();
+		box->timerTick = 0;
+		if (timeouts.idleTimeout)
+			schedule(id, timeouts.idleTimeout * 1000ULL);
+		{
+			std::lock_guard<std::mutex> lock(metricsMutex);
+			metrics[id].connects++;
+			if (box->lostAt) {
+				uint64_t latency = box->lastActivity - box->lostAt;
+				metrics[id].reconnects++;
+				metrics[id].reconnectLatency += latency;
+				metrics[id].maxReconnectLatency = std::max(metrics[id].maxReconnectLatency, latency);
+				box->lostAt = 0;
+			}
+		}
+		epoll_event ev = {};
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.u64 = id;
+		epoll_ctl(epollFd, EPOLL_CTL_MOD, box->fd, &ev);
+		box->sink->handleMonitorConnected(id);
+	}
+	if (box->state == CONNECTED && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+		readBox(id);
+}
+
+void MonitorEngine::readBox(size_t id) {
+	sBox *box = boxes[id];
+	char buffer[4096];
+	bool closed = false;
+	bool dead = false;
+	uint64_t readStart = PipelineLatency::Now();
+	while (true) {
+		ssize_t n = recv(box->fd, buffer, sizeof(buffer), 0);
+		if (n > 0) {
+			box->input.append(buffer, n);
+			box->lastActivity = now();
+			continue;
+		}
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (n < 0) {
+			ERR("Exception - " << strerror(errno));
+			// keepalive timed out or the box answered with a reset after a reboot
+			dead = errno == ETIMEDOUT || errno == ECONNRESET || errno == EHOSTUNREACH;
+		}
+		closed = true;
+		break;
+	}
+	uint64_t received = PipelineLatency::Now();
+	PipelineLatency::Get().record(PipelineLatency::SOCKET_READ, received - readStart);
+
+	// split received data into lines, an incomplete line remains in the buffer
+	MonitorEvent event;
+	size_t start = 0;
+	const char *end;
+	while (box->state == CONNECTED &&
+			(end = static_cast<const char *>(memchr(box->input.data() + start, '\n', box->input.size() - start)))) {
+		const char *line = box->input.data() + start;
+		size_t length = end - line + 1;
+		start += length;
+		if (gConfig && gConfig->logPersonalInfo())
+			DBG("Got message " << std::string(line, length));
+		box->sink->handleMonitorLine(id, line, length);
+		if (box->state != CONNECTED)
+			return;
+		uint64_t decodeStart = PipelineLatency::Now();
+		bool known = MonitorDecoder::Decode(line, length, event);
+		event.receiveTime = received;
+		PipelineLatency::Get().record(PipelineLatency::DECODE, PipelineLatency::Now() - decodeStart);
+		if (event.boxTime) {
+			// the clocks of box and host may differ, the box sends full seconds only
+			int64_t delay = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count()
+			                - (int64_t) event.boxTime * 1000;
+			PipelineLatency::Get().record(PipelineLatency::BOX_TO_LIBRARY, delay > 0 ? delay : 0);
+		}
+		if (!known) {
+			DBG("Got unknown message " << std::string(line, length));
+			ERR("Exception unknown data received.");
+			closeBox(id, true);
+			return;
+		}
+		box->retryDelay = retryDelay;
+		box->sink->handleMonitorEvent(id, event);
+	}
+	if (box->state != CONNECTED)
+		return;
+	box->input.erase(0, start);
+	if (closed)
+		closeBox(id, true, dead);
+}
+
+void MonitorEngine::checkIdle(size_t id) {
+	sBox *box = boxes[id];
+	uint64_t idle = now() - box->lastActivity;
+	if (idle >= timeouts.idleTimeout * 1000ULL) {
+		ERR("no data from call monitor at " << box->host << " for " << idle / 1000 << " seconds, reconnecting");
+		closeBox(id, true, true);
+	} else {
+		schedule(id, timeouts.idleTimeout * 1000ULL - idle);
+	}
+}
+
+bool MonitorEngine::getMetrics(size_t id, sMonitorMetrics &boxMetrics) const {
+	std::lock_guard<std::mutex> lock(metricsMutex);
+	if (id >= metrics.size())
+		return false;
+	boxMetrics = metrics[id];
+	return true;
+}
+
+sMonitorMetrics MonitorEngine::getMetrics() const {
+	std::lock_guard<std::mutex> lock(metricsMutex);
+	sMonitorMetrics sum;
+	for (const sMonitorMetrics &boxMetrics : metrics)
+		sum += boxMetrics;
+	return sum;
+}
+
+void MonitorEngine::run() {
+	DBG("Monitor engine thread started");
+	const int MAX_EVENTS = 64;
+	epoll_event events[MAX_EVENTS];
+	while (!stopRequested) {
+		int timeout = (int) ((currentTick + 1) * TICK - std::min(now(), (currentTick + 1) * TICK));
+		int n = epoll_wait(epollFd, events, MAX_EVENTS, timeout);
+		if (n < 0 && errno != EINTR) {
+			ERR(std::string{"event loop failed: "} + strerror(errno));
+			break;
+		}
+		for (int i = 0; i < n && !stopRequested; i++) {
+			if (events[i].data.u64 == RESOLVED_EVENT) {
+				handleResolved();
+			} else if (events[i].data.u64 == WAKEUP_EVENT) {
+				uint64_t value;
+				if (read(wakeupFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+					ERR(std::string{"could not read wakeup event: "} + strerror(errno));
+				processCommands();
+			} else {
+				handleIo(events[i].data.u64, events[i].events);
+			}
+		}
+		advanceTimers();
+	}
+	DBG("Monitor engine thread ended");
+}
+
+}
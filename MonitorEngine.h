@@ -0,0 +1,215 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef MONITORENGINE_H
+#define MONITORENGINE_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MonitorDecoder.h"
+
+struct addrinfo;
+
+namespace fritz {
+
+/**
+ * Receives the events of the boxes added to a MonitorEngine.
+ * All methods are called from the thread of the engine and should return quickly,
+ * as they delay the events of all other boxes.
+ */
+class MonitorSink {
+public:
+	virtual ~MonitorSink() { }
+	/**
+	 * Called for each line received from the call monitor of a box.
+	 * @param the id of the box, as returned by MonitorEngine::addBox()
+	 * @param the decoded event, may be swapped with another object
+	 */
+	virtual void handleMonitorEvent(size_t box, MonitorEvent &event) = 0;
+	/**
+	 * Called for each line received, before it is decoded.
+	 * @param the id of the box
+	 * @param the line including the line break, not null terminated
+	 * @param the length of the line
+	 */
+	virtual void handleMonitorLine(size_t box __attribute__((unused)), const char *line __attribute__((unused)), size_t length __attribute__((unused))) { }
+	virtual void handleMonitorConnected(size_t box __attribute__((unused))) { }
+	virtual void handleMonitorDisconnected(size_t box __attribute__((unused))) { }
+};
+
+/**
+ * Timeouts used by a MonitorEngine to detect dead connections, in seconds.
+ */
+struct sMonitorTimeouts {
+	unsigned int connectTimeout = 10;        // a connection attempt is given up after this time
+	unsigned int idleTimeout = 0;            // the connection is re-established if no data was received for this time, 0 disables this watchdog
+	unsigned int keepaliveIdle = 5;          // TCP keepalive probes are sent if no data was received for this time
+	unsigned int keepaliveInterval = 2;      // time between two keepalive probes
+	unsigned int keepaliveCount = 3;         // the connection is dead after this number of unanswered probes
+};
+
+/**
+ * Counters of a MonitorEngine, latencies are in milliseconds.
+ */
+struct sMonitorMetrics {
+	uint64_t connects = 0;                   // established connections
+	uint64_t connectFailures = 0;
+	uint64_t disconnects = 0;                // lost connections, including dead ones
+	uint64_t deadConnections = 0;            // connections detected dead by keepalive or the idle watchdog
+	uint64_t detectionLatency = 0;           // sum of the times from the last data received until a dead connection was detected
+	uint64_t maxDetectionLatency = 0;
+	uint64_t reconnects = 0;                 // connections re-established after a loss
+	uint64_t reconnectLatency = 0;           // sum of the times from losing a connection until it was re-established
+	uint64_t maxReconnectLatency = 0;
+	uint64_t droppedEvents = 0;              // events the sink could not queue, e.g., by Listener
+	sMonitorMetrics &operator+=(const sMonitorMetrics &other) {
+		connects            += other.connects;
+		connectFailures     += other.connectFailures;
+		disconnects         += other.disconnects;
+		deadConnections     += other.deadConnections;
+		detectionLatency    += other.detectionLatency;
+		maxDetectionLatency  = std::max(maxDetectionLatency, other.maxDetectionLatency);
+		reconnects          += other.reconnects;
+		reconnectLatency    += other.reconnectLatency;
+		maxReconnectLatency  = std::max(maxReconnectLatency, other.maxReconnectLatency);
+		droppedEvents       += other.droppedEvents;
+		return *this;
+	}
+};
+
+/**
+ * Monitors the calls of many Fritz!Boxes from a single thread.
+ * The engine uses one epoll loop with non-blocking sockets. Lost connections are
+ * re-established with exponential backoff and random jitter, the retries are
+ * kept in a timer wheel. Deleting the engine stops the thread immediately.
+ * Dead connections, e.g., after a reboot of the box or a NAT timeout, are detected using
+ * TCP keepalive and an optional idle watchdog, and re-established right away.
+ * Host names are resolved by separate threads, so a slow name server does not
+ * delay the other boxes.
+ */
+class MonitorEngine {
+private:
+	enum eState {
+		WAITING,                   // waiting for the next connection attempt
+		RESOLVING,                 // waiting for the address of the host
+		CONNECTING,
+		CONNECTED,
+		REMOVED
+	};
+	struct sBox {
+		std::string host;
+		int port;
+		MonitorSink *sink;
+		eState state;
+		int fd;
+		std::string input;         // received data not yet split into lines
+		unsigned int retryDelay;   // seconds
+		uint64_t timerTick;        // tick the pending timer expires at, 0 if none
+		uint64_t lastActivity;     // ms, time the connection was established or data was received
+		uint64_t lostAt;           // ms, time the last connection was lost, 0 if not applicable
+		uint64_t resolveRequest;   // number of the last resolve request, to ignore outdated results
+	};
+	struct sResolver;
+	static const size_t RESOLVER_THREADS = 2;
+	std::shared_ptr<sResolver> resolver;      // shared with the resolver threads, which may outlive the engine
+	static const uint64_t TICK = 100;         // ms per slot of the timer wheel
+	static const size_t WHEEL_SLOTS = 1024;   // longer timers take several rounds
+	std::vector<size_t> wheel[WHEEL_SLOTS];
+	uint64_t currentTick;
+	std::vector<sBox *> boxes;                // indexed by box id, owned by the thread of the engine
+	std::mutex commandMutex;
+	std::condition_variable commandsDone;
+	std::vector<sBox *> addedBoxes;           // passed to the thread of the engine
+	std::vector<size_t> removedBoxes;
+	uint64_t commandsRequested;
+	uint64_t commandsProcessed;
+	size_t boxCount;
+	unsigned int retryDelay;
+	unsigned int maxRetryDelay;
+	sMonitorTimeouts timeouts;
+	mutable std::mutex metricsMutex;
+	std::vector<sMonitorMetrics> metrics;     // indexed by box id
+	int epollFd;
+	int wakeupFd;
+	std::atomic<bool> stopRequested;
+	std::thread *thread;
+	std::mt19937 randomGenerator;
+	void run();
+	void wakeup();
+	uint64_t now() const;
+	void processCommands();
+	void advanceTimers();
+	void schedule(size_t id, uint64_t delay);
+	void connectBox(size_t id);
+	void handleResolved();
+	void startConnect(size_t id, addrinfo *address);
+	void handleIo(size_t id, uint32_t events);
+	void readBox(size_t id);
+	void checkIdle(size_t id);
+	void closeBox(size_t id, bool retry, bool dead = false);
+public:
+	/**
+	 * Creates the engine and starts its thread.
+	 * @param seconds to wait before the first retry, doubled on each failed attempt
+	 * @param upper limit for the retry delay in seconds
+	 * @param timeouts for detecting dead connections
+	 */
+	MonitorEngine(unsigned int retryDelay = 60, unsigned int maxRetryDelay = 3600, sMonitorTimeouts timeouts = sMonitorTimeouts());
+	virtual ~MonitorEngine();
+	/**
+	 * Starts monitoring a box. The connection is established asynchronously.
+	 * @param host name or address of the box
+	 * @param the call monitor port, usually 1012
+	 * @param the sink that receives the events of this box
+	 * @return the id of the box
+	 */
+	size_t addBox(std::string host, int port, MonitorSink *sink);
+	/**
+	 * Stops monitoring a box. When this method returns, the sink of the box is not
+	 * called anymore. It may also be called by the sink itself.
+	 * @param the id returned by addBox()
+	 */
+	void removeBox(size_t id);
+	/**
+	 * Returns the counters of a box.
+	 * @param the id returned by addBox()
+	 * @param the counters
+	 * @return false, if the id is unknown
+	 */
+	bool getMetrics(size_t id, sMonitorMetrics &boxMetrics) const;
+	/**
+	 * Returns the counters of all boxes.
+	 */
+	sMonitorMetrics getMetrics() const;
+};
+
+}
+
+#endif /* MONITORENGINE_H */
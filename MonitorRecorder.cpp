@@ -0,0 +1,77 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "MonitorRecorder.h"
+
+#include <chrono>
+#include <cstdlib>
+
+#include <liblog++/Log.h>
+
+namespace fritz {
+
+MonitorRecorder::MonitorRecorder(const std::string &fileName)
+: file(fileName.c_str(), std::ios::out | std::ios::trunc), start{Now()}, lines{0} {
+	if (!file.is_open())
+		ERR("could not open " << fileName << " for recording");
+}
+
+MonitorRecorder::~MonitorRecorder() {
+	file.close();
+}
+
+uint64_t MonitorRecorder::Now() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void MonitorRecorder::handleMonitorLine(size_t box, const char *line, size_t length) {
+	std::lock_guard<std::mutex> lock(mutex);
+	file << (Now() - start) << '\t' << box << '\t';
+	file.write(line, length);
+	// lines are terminated by "\r\n", but be prepared for a missing line break
+	if (length == 0 || line[length-1] != '\n')
+		file << '\n';
+	file.flush();
+	lines++;
+}
+
+bool MonitorRecorder::Load(const std::string &fileName, std::vector<sRecordedLine> &recording) {
+	std::ifstream file(fileName.c_str());
+	if (!file.is_open())
+		return false;
+	std::string line;
+	while (std::getline(file, line)) {
+		size_t tab1 = line.find('\t');
+		size_t tab2 = tab1 == std::string::npos ? tab1 : line.find('\t', tab1 + 1);
+		if (tab2 == std::string::npos) {
+			DBG("skipped invalid line in recording");
+			continue;
+		}
+		sRecordedLine recorded;
+		recorded.offset = strtoull(line.c_str(), nullptr, 10);
+		recorded.box    = strtoul(line.c_str() + tab1 + 1, nullptr, 10);
+		recorded.line   = line.substr(tab2 + 1) + '\n';
+		recording.push_back(recorded);
+	}
+	return true;
+}
+
+}
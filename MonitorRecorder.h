@@ -0,0 +1,78 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef MONITORRECORDER_H
+#define MONITORRECORDER_H
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MonitorEngine.h"
+
+namespace fritz {
+
+/**
+ * A line of a call monitor recording.
+ */
+struct sRecordedLine {
+	uint64_t offset;             // ms since the start of the recording
+	size_t box;                  // the id of the box that sent the line
+	std::string line;            // including the line break
+};
+
+/**
+ * Records the lines received by a MonitorEngine, e.g., to replay them in tests
+ * and benchmarks. Add the recorder as the sink of the boxes to record.
+ * Each line is written as "offset<TAB>box<TAB>line", the offset is in ms since
+ * the recorder was created.
+ */
+class MonitorRecorder : public MonitorSink {
+private:
+	std::mutex mutex;
+	std::ofstream file;
+	uint64_t start;
+	size_t lines;
+	static uint64_t Now();
+public:
+	/**
+	 * @param the file to write, an existing file is replaced
+	 */
+	MonitorRecorder(const std::string &fileName);
+	virtual ~MonitorRecorder();
+	void handleMonitorLine(size_t box, const char *line, size_t length) override;
+	void handleMonitorEvent(size_t box __attribute__((unused)), MonitorEvent &event __attribute__((unused))) override { }
+	bool isOpen() const { return file.is_open(); }
+	size_t getLines() const { return lines; }
+	/**
+	 * Reads a recording.
+	 * @param the file written by a MonitorRecorder
+	 * @param the recorded lines
+	 * @return false, if the file could not be read
+	 */
+	static bool Load(const std::string &fileName, std::vector<sRecordedLine> &recording);
+};
+
+}
+
+#endif /* MONITORRECORDER_H */
@@ -0,0 +1,79 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "RetryScheduler.h"
+
+#include <random>
+
+namespace fritz {
+
+void CancellationToken::cancel() {
+	*canceled = true;
+	RetryScheduler::Get().wakeUp();
+}
+
+bool CancellationToken::isCanceled() const {
+	if (*canceled)
+		return true;
+	for (auto &parent : parents)
+		if (*parent)
+			return true;
+	return false;
+}
+
+CancellationToken CancellationToken::createChild() const {
+	CancellationToken child;
+	child.parents = parents;
+	child.parents.push_back(canceled);
+	return child;
+}
+
+std::chrono::milliseconds RetryPolicy::getDelay(unsigned int failures) const {
+	double delay = initialDelay.count();
+	for (unsigned int i = 1; i < failures && delay < maxDelay.count(); i++)
+		delay *= 2;
+	if (delay > maxDelay.count())
+		delay = maxDelay.count();
+	if (jitter > 0) {
+		static thread_local std::minstd_rand random{std::random_device()()};
+		std::uniform_real_distribution<double> distribution(1.0 - jitter, 1.0 + jitter);
+		delay *= distribution(random);
+	}
+	return std::chrono::milliseconds(static_cast<std::chrono::milliseconds::rep>(delay));
+}
+
+RetryScheduler &RetryScheduler::Get() {
+	static RetryScheduler scheduler;
+	return scheduler;
+}
+
+bool RetryScheduler::waitUntil(std::chrono::steady_clock::time_point due, const CancellationToken &token) {
+	std::unique_lock<std::mutex> lock(mutex);
+	return tokenCanceled.wait_until(lock, due, [&token]() { return token.isCanceled(); });
+}
+
+void RetryScheduler::wakeUp() {
+	// lock, so that the notification is not lost while a caller checks its token
+	std::lock_guard<std::mutex> lock(mutex);
+	tokenCanceled.notify_all();
+}
+
+}
@@ -0,0 +1,161 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef RETRYSCHEDULER_H
+#define RETRYSCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <liblog++/Log.h>
+
+namespace fritz {
+
+/**
+ * Thrown by RetryScheduler::retry(), if its token was canceled before an attempt succeeded.
+ */
+class RetryCanceled : public std::runtime_error {
+public:
+	RetryCanceled() : std::runtime_error("retry canceled") { }
+};
+
+/**
+ * Cancels the retries it was passed to. Copies share the same state.
+ */
+class CancellationToken {
+private:
+	std::shared_ptr<std::atomic<bool>> canceled;
+	std::vector<std::shared_ptr<std::atomic<bool>>> parents;   // of tokens created by createChild()
+public:
+	CancellationToken() : canceled{std::make_shared<std::atomic<bool>>(false)} { }
+	/**
+	 * Fails all pending retries using this token with RetryCanceled.
+	 */
+	void cancel();
+	bool isCanceled() const;
+	/**
+	 * Returns a new token, that is canceled by its own cancel() and by canceling this token.
+	 */
+	CancellationToken createChild() const;
+};
+
+/**
+ * When to try again after a failed attempt.
+ * The delay starts with initialDelay and doubles with every attempt up to maxDelay,
+ * randomly varied by +/- jitter to avoid that many clients retry at the same time.
+ */
+struct RetryPolicy {
+	std::chrono::milliseconds initialDelay;
+	std::chrono::milliseconds maxDelay;
+	double jitter;                        // fraction of the delay, 0.0 - 1.0
+	unsigned int maxAttempts;             // 0 for no limit
+	std::chrono::milliseconds deadline;   // time after the first attempt no further attempt is started, 0 for no limit
+
+	RetryPolicy(std::chrono::milliseconds initialDelay = std::chrono::seconds(60),
+	            std::chrono::milliseconds maxDelay = std::chrono::seconds(3600),
+	            double jitter = 0.1, unsigned int maxAttempts = 0,
+	            std::chrono::milliseconds deadline = std::chrono::milliseconds(0))
+	: initialDelay{initialDelay}, maxDelay{maxDelay}, jitter{jitter}, maxAttempts{maxAttempts}, deadline{deadline} { }
+	/**
+	 * @param the number of failed attempts so far, starting with 1
+	 * @return the delay before the next attempt, including jitter
+	 */
+	std::chrono::milliseconds getDelay(unsigned int failures) const;
+};
+
+/**
+ * Process wide support for retries of failed operations.
+ * All attempts run in the calling thread, which waits for the delay between attempts
+ * on a condition variable that is notified by CancellationToken::cancel(), so a canceled
+ * token ends the wait at once. An attempt already running is not interrupted, no
+ * further attempt is started after it.
+ */
+class RetryScheduler {
+private:
+	std::mutex mutex;
+	std::condition_variable tokenCanceled;
+	RetryScheduler() { }
+	/**
+	 * Blocks the calling thread until the given time.
+	 * @return true, if token was canceled before
+	 */
+	bool waitUntil(std::chrono::steady_clock::time_point due, const CancellationToken &token);
+public:
+	static RetryScheduler &Get();
+	/**
+	 * Runs attempt in the calling thread until it does not throw std::runtime_error, the policy gives up
+	 * or token is canceled. Other exceptions are passed on without a retry.
+	 * @param the operation to run
+	 * @param when to retry
+	 * @param cancels waiting for the next attempt
+	 * @param description of the operation for the log
+	 * @return the result of the successful attempt
+	 * @throws the exception of the last attempt, if the policy gives up, or RetryCanceled
+	 */
+	template<typename T> T retry(std::function<T()> attempt, const RetryPolicy &policy,
+	                             const CancellationToken &token, const std::string &what);
+	/**
+	 * Wakes the waiting callers, to check for canceled tokens.
+	 */
+	void wakeUp();
+};
+
+template<typename T> T RetryScheduler::retry(std::function<T()> attempt, const RetryPolicy &policy,
+                                             const CancellationToken &token, const std::string &what) {
+	unsigned int failures = 0;
+	auto start = std::chrono::steady_clock::now();
+	while (true) {
+		if (token.isCanceled())
+			throw RetryCanceled();
+		std::chrono::steady_clock::time_point due;
+		try {
+			return attempt();
+		} catch (RetryCanceled &) {
+			// of a nested retry
+			throw;
+		} catch (std::runtime_error &re) {
+			failures++;
+			ERR("Exception in " << what << " - " << re.what());
+			std::chrono::milliseconds delay = policy.getDelay(failures);
+			auto now = std::chrono::steady_clock::now();
+			if ((policy.maxAttempts && failures >= policy.maxAttempts) ||
+			    (policy.deadline.count() && now + delay > start + policy.deadline)) {
+				ERR("giving up after " << failures << " attempts");
+				throw;
+			}
+			ERR("waiting " << delay.count() / 1000.0 << " seconds before retrying");
+			due = now + delay;
+		}
+		if (waitUntil(due, token))
+			throw RetryCanceled();
+	}
+}
+
+}
+
+#endif /* RETRYSCHEDULER_H */
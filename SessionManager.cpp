@@ -0,0 +1,417 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "SessionManager.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <gcrypt.h>
+#include <langinfo.h>
+
+#include "Config.h"
+#include "Tools.h"
+#include <liblog++/Log.h>
+#include <libconv++/CharsetConverter.h>
+
+namespace fritz {
+
+std::shared_ptr<SessionManager> SessionManager::me;
+std::mutex SessionManager::meMutex;
+
+SessionManager::SessionManager(time_t sessionTimeout, time_t refreshMargin)
+: httpClient{gConfig->getUrl(), gConfig->getUiPort(), gConfig->getMaxBoxRequests()}, sessionTimeout{sessionTimeout}, refreshMargin{refreshMargin},
+  loginRunning{false}, loginsDone{0}, loginResult{false}, loggedIn{false}, lastRequest{0}, identified{false}, stopRequested{false} {
+	static std::once_flag gcryptInitialized;
+	std::call_once(gcryptInitialized, []() {
+		// init libgcrypt
+		gcry_check_version (nullptr);
+		// disable secure memory
+		gcry_control (GCRYCTL_DISABLE_SECMEM, 0);
+		gcry_control (GCRYCTL_INITIALIZATION_FINISHED, 0);
+	});
+	thread = new std::thread(&SessionManager::run, this);
+}
+
+SessionManager::~SessionManager() {
+	stop();
+}
+
+void SessionManager::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!thread)
+			return;
+		stopRequested = true;
+		wakeup.notify_all();
+	}
+	thread->join();
+	delete thread;
+	thread = nullptr;
+}
+
+void SessionManager::CreateSessionManager(time_t sessionTimeout, time_t refreshMargin) {
+	std::shared_ptr<SessionManager> previous;
+	{
+		std::lock_guard<std::mutex> lock(meMutex);
+		previous = me;
+		me.reset(new SessionManager(sessionTimeout, refreshMargin));
+	}
+	if (previous)
+		previous->stop();
+}
+
+std::shared_ptr<SessionManager> SessionManager::GetSessionManager() {
+	std::lock_guard<std::mutex> lock(meMutex);
+	// not after Config::Shutdown()
+	if (!me && gConfig)
+		me.reset(new SessionManager(600, 60));
+	return me;
+}
+
+void SessionManager::DeleteSessionManager() {
+	std::shared_ptr<SessionManager> previous;
+	{
+		std::lock_guard<std::mutex> lock(meMutex);
+		previous.swap(me);
+	}
+	if (previous) {
+		DBG("deleting session manager");
+		// the background refresh uses gConfig, which is deleted next
+		previous->stop();
+	}
+}
+
+bool SessionManager::isValid(time_t now) {
+	return loggedIn && now - lastRequest < sessionTimeout;
+}
+
+bool SessionManager::login() {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (isValid(time(nullptr)))
+		return true;
+	if (loginRunning) {
+		// use the result of the login in progress
+		size_t done = loginsDone;
+		loginDone.wait(lock, [this, done]() { return loginsDone != done; });
+		if (isValid(time(nullptr)))
+			return true;
+		if (loginError)
+			std::rethrow_exception(loginError);
+		return loginResult;
+	}
+	return exclusiveLogin(lock, false);
+}
+
+bool SessionManager::exclusiveLogin(std::unique_lock<std::mutex> &lock, bool refreshOnly) {
+	loginRunning = true;
+	lock.unlock();
+	bool result = false;
+	std::exception_ptr error;
+	try {
+		result = refreshOnly ? refresh() : authenticate();
+	} catch (std::runtime_error &re) {
+		error = std::current_exception();
+	}
+	lock.lock();
+	loginRunning = false;
+	loginsDone++;
+	loginResult = result;
+	loginError = error;
+	Config::eLoginType type = gConfig->getLoginType();
+	loggedIn = result && (type == Config::SID || type == Config::LUA);
+	if (loggedIn)
+		lastRequest = time(nullptr);
+	loginDone.notify_all();
+	wakeup.notify_all();
+	if (error)
+		std::rethrow_exception(error);
+	return result;
+}
+
+void SessionManager::touch() {
+	std::lock_guard<std::mutex> lock(mutex);
+	lastRequest = time(nullptr);
+	if (gConfig)
+		gConfig->updateLastRequestTime();
+}
+
+void SessionManager::invalidate() {
+	std::lock_guard<std::mutex> lock(mutex);
+	loggedIn = false;
+}
+
+void SessionManager::run() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopRequested) {
+		if (!loggedIn || loginRunning) {
+			wakeup.wait(lock);
+			continue;
+		}
+		time_t now = time(nullptr);
+		time_t refreshAt = lastRequest + sessionTimeout - refreshMargin;
+		if (now < refreshAt) {
+			wakeup.wait_for(lock, std::chrono::seconds(refreshAt - now));
+			continue;
+		}
+		try {
+			exclusiveLogin(lock, true);
+		} catch (std::runtime_error &re) {
+			ERR("Exception refreshing session with " << gConfig->getUrl() << " - " << re.what());
+		}
+		if (!loggedIn && !stopRequested) {
+			// retry later, or log in when the next request needs it
+			wakeup.wait_for(lock, std::chrono::seconds(refreshMargin / 4 + 1));
+		}
+	}
+}
+
+bool SessionManager::refresh() {
+	// a request with the current SID tells whether it is still valid and extends its lifetime
+	std::string sXml;
+	if (gConfig->getLoginType() == Config::LUA)
+		sXml = httpClient.get("/login_sid.lua", {{"sid", gConfig->getSid()}});
+	else
+		sXml = httpClient.get("/cgi-bin/webcm", {{"getpage", "../html/login_sid.xml"}, {"sid", gConfig->getSid()}});
+	size_t sidStart = sXml.find("<SID>");
+	if (sidStart != std::string::npos && sXml.compare(sidStart + 5, 16, gConfig->getSid()) == 0 && gConfig->getSid() != "0000000000000000") {
+		DBG("refreshed session.");
+		gConfig->updateLastRequestTime();
+		return true;
+	}
+	DBG("session expired, logging in again.");
+	return authenticate();
+}
+
+static void AppendUtf16(std::string &buffer, unsigned int codePoint) {
+	// the box replaces every character > 0xFF with '.'
+	if (codePoint > 0xFF)
+		codePoint = '.';
+	buffer += static_cast<char>(codePoint);
+	buffer += '\0';
+}
+
+std::string SessionManager::CalculateLoginResponse(const std::string &challenge, const std::string &password, std::string charset) {
+	static const char HEX[] = "0123456789abcdef";
+	if (charset.empty())
+		charset = nl_langinfo(CODESET);
+	// only a password in another charset needs iconv, UTF-8 is decoded below
+	std::string converted;
+	if (charset != "UTF-8" && charset != "utf-8" && charset != "utf8") {
+		convert::CharsetConverter conv(charset, "UTF-8");
+		converted = conv.convert(password);
+	}
+	const std::string &utf8Password = converted.empty() ? password : converted;
+	// the box needs an md5 sum of the string "challenge-password" in UTF-16LE,
+	// which is encoded here directly, into a buffer reused by later logins
+	static thread_local std::string buffer;
+	buffer.clear();
+	for (const std::string *part : { &challenge, &utf8Password }) {
+		const unsigned char *pos = reinterpret_cast<const unsigned char *>(part->data());
+		const unsigned char *end = pos + part->size();
+		while (pos < end) {
+			unsigned int c = *pos;
+			size_t length = c < 0x80 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 0;
+			bool valid = length && pos + length <= end;
+			for (size_t i = 1; valid && i < length; i++)
+				valid = (pos[i] & 0xC0) == 0x80;
+			if (!valid) {
+				// not UTF-8, take the byte as latin1
+				AppendUtf16(buffer, c);
+				pos++;
+				continue;
+			}
+			unsigned int codePoint = length == 1 ? c : c & (0xFF >> (length + 1));
+			for (size_t i = 1; i < length; i++)
+				codePoint = (codePoint << 6) | (pos[i] & 0x3F);
+			AppendUtf16(buffer, codePoint);
+			// characters outside the BMP take two UTF-16 units
+			if (codePoint > 0xFFFF)
+				AppendUtf16(buffer, codePoint);
+			pos += length;
+		}
+		if (part == &challenge)
+			AppendUtf16(buffer, '-');
+	}
+	unsigned char hash[16];
+	gcry_md_hash_buffer(GCRY_MD_MD5, hash, buffer.data(), buffer.size());
+	// do not leave the password in memory
+	std::fill(buffer.begin(), buffer.end(), '\0');
+	buffer.clear();
+	std::fill(converted.begin(), converted.end(), '\0');
+	std::string response;
+	response.reserve(challenge.size() + 1 + 2 * sizeof(hash));
+	response += challenge;
+	response += '-';
+	for (unsigned char byte : hash) {
+		response += HEX[byte >> 4];
+		response += HEX[byte & 0x0F];
+	}
+	return response;
+}
+
+void SessionManager::identify() {
+	std::string boxId, firmware;
+	try {
+		// not available with old firmware versions
+		BoxProfile::ParseBoxInfo(httpClient.get("/jason_boxinfo.xml"), boxId, firmware);
+	} catch (std::runtime_error &re) {}
+	if (boxId.empty())
+		boxId = gConfig->getUrl();
+	if (profile.load(gConfig->getConfigDir(), boxId, firmware)) {
+		if (gConfig->getLoginType() == Config::UNKNOWN)
+			gConfig->setLoginType(profile.getLoginType());
+		if (gConfig->getLang().empty())
+			gConfig->setLang(profile.getLang());
+	}
+	identified = true;
+}
+
+bool SessionManager::authenticate() {
+	if (!identified)
+		identify();
+	// detect type of login once, the stored profile tells which page to use
+	Config::eLoginType type = gConfig->getLoginType();
+	std::string sXml; // sXml is used twice!
+	bool detected = false;
+	if (type == Config::UNKNOWN || type == Config::LUA) {
+		// detect if this Fritz!Box uses SIDs
+		DBG("requesting login_sid.lua from Fritz!Box.");
+		// might return 404 with older fw-versions, our httpClient throws a SockeException for this, catched here
+		try {
+		  sXml = httpClient.get("/login_sid.lua", {{"sid", gConfig->getSid()}});
+		} catch (std::runtime_error &re) {}
+		detected = sXml.find("<Rights") != std::string::npos;
+		if (detected)
+			gConfig->setLoginType(Config::LUA);
+	}
+	if (!detected && type != Config::PASSWORD) {
+		DBG("requesting login_sid.xml from Fritz!Box.");
+		sXml = httpClient.get("/cgi-bin/webcm", {{"getpage", "../html/login_sid.xml"}});
+		if (sXml.find("<iswriteaccess>") != std::string::npos)
+			gConfig->setLoginType(Config::SID);
+		else
+			gConfig->setLoginType(Config::PASSWORD);
+	}
+	profile.setLoginType(gConfig->getLoginType());
+
+	if (gConfig->getLoginType() == Config::SID || gConfig->getLoginType() == Config::LUA) {
+		std::stringstream loginPath;
+		if (gConfig->getLoginType() == Config::LUA) {
+			loginPath << "/login_sid.lua";
+		} else {
+			loginPath << "/cgi-bin/webcm";
+		}
+		// check if no password is needed (SID is directly available)
+		size_t sidStart = sXml.find("<SID>");
+		if (sidStart == std::string::npos) {
+			ERR("Error - Expected field <SID> not found in login_sid.xml or login_sid.lua.");
+			return false;
+		}
+		sidStart += 5;
+		std::string sid = sXml.substr(sidStart, 16);
+		if (sid.compare("0000000000000000") != 0) {
+			// save SID
+			DBG("SID is still valid - all ok.");
+			gConfig->setSid(sid);
+			gConfig->updateLastRequestTime();
+			return true;
+		} else {
+			DBG("We need to log in.");
+			// generate response out of challenge and password
+			size_t challengeStart = sXml.find("<Challenge>");
+			if (challengeStart == std::string::npos) {
+				ERR("Error - Expected <Challenge> not found in login_sid.xml or login_sid.lua.");
+				return false;
+			}
+			challengeStart += 11;
+			size_t challengeStop = sXml.find("<", challengeStart);
+            std::string challenge = sXml.substr(challengeStart, challengeStop - challengeStart);
+            std::string response = CalculateLoginResponse(challenge, gConfig->getPassword());
+            // send response to box
+			std::string sMsg;
+
+			PooledHttpClient::param_t postdata;
+			if (gConfig->getLoginType() == Config::SID)
+				postdata = {{"login:command/response", response},
+				            {"getpage", "../html/de/menus/menu2.html"}};
+			else
+                postdata = {{"username", gConfig->getUsername()}, {"response", response }};
+
+            DBG("Sending login request "
+             << ( gConfig->getUsername().size() ? "for user " : "" )
+             << gConfig->getUsername() << "...");
+
+            sMsg = httpClient.post(loginPath.str(), postdata);
+			size_t sidStart, sidStop;
+			if (gConfig->getLoginType() == Config::SID) {
+				sidStart = sMsg.find("name=\"sid\"");
+				if (sidStart == std::string::npos) {
+					ERR("Error - Expected sid field not found.");
+					return false;
+				}
+				sidStart = sMsg.find("value=\"", sidStart + 10) + 7;
+				sidStop = sMsg.find("\"", sidStart);
+			} else {
+				sidStart = sMsg.find("<SID>");
+				if (sidStart == std::string::npos) {
+					ERR("Error - Expected sid field not found.");
+					return false;
+				}
+				sidStart += 5;
+				sidStop = sMsg.find("</SID>");
+			}
+			// save SID
+			gConfig->setSid(sMsg.substr(sidStart, sidStop-sidStart));
+			if (gConfig->getSid().compare("0000000000000000") != 0) {
+				DBG("login successful.");
+				gConfig->updateLastRequestTime();
+				return true;
+			} else {
+				ERR("login failed, check your password settings!.");
+				return false;
+			}
+		}
+	}
+	if (gConfig->getLoginType() == Config::PASSWORD) {
+		DBG("logging into fritz box using old scheme without SIDs.");
+		// no password, no login
+		if ( gConfig->getPassword().length() == 0)
+			return true; //TODO: check if box really doesn't need a password
+
+		std::string sMsg;
+
+		sMsg = httpClient.post("/cgi-bin/webcm",
+				               {{"login:command/password", Tools::UrlEncode(gConfig->getPassword())}});
+
+		// determine if login was successful
+		if (sMsg.find("class=\"errorMessage\"") != std::string::npos) {
+			ERR("login failed, check your password settings.");
+			return false;
+		}
+		DBG("login successful.");
+		return true;
+	}
+	return false;
+}
+
+}
@@ -0,0 +1,133 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef SESSIONMANAGER_H
+#define SESSIONMANAGER_H
+
+#include <condition_variable>
+#include <ctime>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "BoxProfile.h"
+#include "HttpConnectionPool.h"
+
+namespace fritz {
+
+/**
+ * Keeps the login session (SID) to the Fritz!Box web interface, shared by all FritzClient objects.
+ * The box drops a SID after some minutes without requests. The SessionManager knows
+ * the time of the last request and refreshes the SID in the background before it
+ * expires, so requests normally find a valid SID without logging in. If a login is
+ * needed nevertheless, concurrent callers wait for one common login.
+ * The SID is stored in gConfig.
+ * Clients keep the session manager they got as long as they use it, it is stopped
+ * when replaced or deleted and freed when the last client is done with it.
+ */
+class SessionManager {
+private:
+	static std::shared_ptr<SessionManager> me;
+	static std::mutex meMutex;
+	PooledHttpClient httpClient;
+	time_t sessionTimeout;
+	time_t refreshMargin;
+	std::mutex mutex;
+	std::condition_variable loginDone;
+	std::condition_variable wakeup;
+	bool loginRunning;
+	size_t loginsDone;
+	bool loginResult;                 // of the last login, passed to the callers waiting for it
+	std::exception_ptr loginError;
+	bool loggedIn;                    // the SID in gConfig is valid as of lastRequest
+	time_t lastRequest;
+	BoxProfile profile;
+	bool identified;                  // whether the profile was loaded
+	bool stopRequested;
+	std::thread *thread;
+	void identify();
+	bool authenticate();
+	bool refresh();
+	bool isValid(time_t now);
+	/**
+	 * Runs authenticate() or refresh() while other callers wait, called with the mutex locked.
+	 */
+	bool exclusiveLogin(std::unique_lock<std::mutex> &lock, bool refreshOnly);
+	void run();
+	/**
+	 * Stops refreshing the session in the background.
+	 */
+	void stop();
+	SessionManager(time_t sessionTimeout, time_t refreshMargin);
+public:
+	/**
+	 * Starts session management for the box in gConfig.
+	 * @param the time in seconds the box keeps a SID without requests
+	 * @param the SID is refreshed this number of seconds before it would expire
+	 */
+	static void CreateSessionManager(time_t sessionTimeout = 600, time_t refreshMargin = 60);
+	/**
+	 * Returns the session manager, creating it with default settings if needed.
+	 * @return the session manager, nullptr if gConfig is not set up
+	 */
+	static std::shared_ptr<SessionManager> GetSessionManager();
+	/**
+	 * Stops the session manager. Clients still holding it can finish their requests.
+	 */
+	static void DeleteSessionManager();
+	virtual ~SessionManager();
+	/**
+	 * Makes sure there is a valid login. Returns immediately if the current SID is valid,
+	 * otherwise logs in or waits for the login of another thread.
+	 * @return false, if the login failed, e.g., due to a wrong password
+	 * @throws std::runtime_error if the box can not be reached
+	 */
+	bool login();
+	/**
+	 * Tells that the box answered a request with the current SID, which extends its lifetime.
+	 * Only call this for responses that show the SID was accepted.
+	 */
+	void touch();
+	/**
+	 * Tells that the box did not accept the current SID, e.g., it answered with status 403 or
+	 * without the expected page. The next call to login() logs in again.
+	 */
+	void invalidate();
+	/**
+	 * Returns the capabilities of the box, known after the first login.
+	 */
+	BoxProfile &getProfile() { return profile; }
+	/**
+	 * Calculates the response to a login challenge of the box, the md5 sum of "challenge-password"
+	 * in UTF-16LE, with every character above 0xFF replaced by '.'.
+	 * @param the challenge sent by the box
+	 * @param the password
+	 * @param the charset of the password, the system charset if empty
+	 * @return "challenge-md5sum"
+	 */
+	static std::string CalculateLoginResponse(const std::string &challenge, const std::string &password, std::string charset = "");
+};
+
+}
+
+#endif /* SESSIONMANAGER_H */
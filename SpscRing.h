@@ -0,0 +1,103 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <utility>
+#include <vector>
+
+namespace fritz {
+
+/**
+ * Bounded lock-free queue for exactly one producer and one consumer thread.
+ * Items are exchanged with the slots instead of being copied, so the
+ * buffers of reused objects (e.g., strings) travel between both threads and
+ * the queue does not allocate after its construction.
+ */
+template <class T>
+class SpscRing {
+private:
+	std::vector<T> slots;
+	size_t mask;
+	// head and tail are kept on different cache lines by padding instead of alignas(64),
+	// which would make the ring over-aligned and need C++17 aligned new on the heap
+	static const size_t CACHE_LINE = 64;
+	std::atomic<size_t> head; // next slot to read, written by the consumer only
+	char headPadding[CACHE_LINE - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> tail; // next slot to write, written by the producer only
+	char tailPadding[CACHE_LINE - sizeof(std::atomic<size_t>)];
+public:
+	/**
+	 * @param the minimum number of items the queue can hold, is rounded up to a power of two
+	 */
+	explicit SpscRing(size_t capacity)
+	: head{0}, tail{0} {
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+		slots.resize(size);
+		mask = size - 1;
+	}
+	SpscRing(const SpscRing &) = delete;
+	SpscRing &operator=(const SpscRing &) = delete;
+	/**
+	 * Appends an item, called by the producer thread only.
+	 * @param the item, on success it is exchanged with an unused object
+	 * @return false, if the queue is full
+	 */
+	bool push(T &item) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == slots.size())
+			return false;
+		std::swap(slots[t & mask], item);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+	/**
+	 * Removes the oldest item, called by the consumer thread only.
+	 * @param the object to exchange with the item
+	 * @return false, if the queue is empty
+	 */
+	bool pop(T &item) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+		std::swap(item, slots[h & mask]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+	bool empty() const {
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+	size_t size() const {
+		size_t h = head.load(std::memory_order_acquire);
+		return tail.load(std::memory_order_acquire) - h;
+	}
+	size_t capacity() const {
+		return slots.size();
+	}
+};
+
+}
+
+#endif /* SPSCRING_H */
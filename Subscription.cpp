@@ -0,0 +1,143 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "Subscription.h"
+
+#include "Listener.h"
+
+namespace fritz {
+
+Subscription::Subscription(EventHandler *handler, eOverflowPolicy policy, size_t capacity)
+: handler{handler}, policy{policy}, capacity{capacity ? capacity : 1}, stopRequested{false} {
+	thread = new std::thread(&Subscription::run, this);
+}
+
+Subscription::~Subscription() {
+	stop();
+}
+
+void Subscription::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!thread)
+			return;
+		stopRequested = true;
+		queue.clear();
+		metrics.depth = 0;
+		notEmpty.notify_all();
+		notFull.notify_all();
+		if (std::this_thread::get_id() == thread->get_id()) {
+			// called from handleEvent(), e.g., by Listener::Unsubscribe(); joining would deadlock
+			try {
+				keepAlive = shared_from_this();
+			} catch (std::bad_weak_ptr &e) {
+				// not owned by a shared_ptr, the owner keeps it until the handler returns
+			}
+			thread->detach();
+			delete thread;
+			thread = nullptr;
+			return;
+		}
+	}
+	thread->join();
+	delete thread;
+	std::lock_guard<std::mutex> lock(mutex);
+	thread = nullptr;
+}
+
+bool Subscription::coalesce(const CallEventPtr &event) {
+	// the newest queued event of the connection is the one to merge with
+	for (auto it = queue.rbegin(); it != queue.rend(); ++it) {
+		if ((*it)->connId != event->connId || (*it)->box != event->box)
+			continue;
+		if (event->type == CallEvent::RESOLVED && (*it)->type == CallEvent::CALL) {
+			std::shared_ptr<CallEvent> merged = std::make_shared<CallEvent>(**it);
+			merged->remoteName = event->remoteName;
+			merged->remoteType = event->remoteType;
+			*it = merged;
+			return true;
+		}
+		if (event->type == CallEvent::DISCONNECT && (*it)->type == CallEvent::CONNECT) {
+			*it = event;
+			return true;
+		}
+		return false;
+	}
+	return false;
+}
+
+void Subscription::push(const CallEventPtr &event) {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (stopRequested)
+		return;
+	if (queue.size() >= capacity) {
+		switch (policy) {
+		case BLOCK:
+			notFull.wait(lock, [this]() { return queue.size() < capacity || stopRequested; });
+			if (stopRequested)
+				return;
+			break;
+		case COALESCE:
+			if (coalesce(event)) {
+				metrics.coalesced++;
+				return;
+			}
+			// fall through
+		case DROP_OLDEST:
+			queue.pop_front();
+			metrics.dropped++;
+			break;
+		}
+	}
+	queue.push_back(event);
+	metrics.depth = queue.size();
+	if (metrics.depth > metrics.maxDepth)
+		metrics.maxDepth = metrics.depth;
+	notEmpty.notify_one();
+}
+
+void Subscription::run() {
+	// released last, after the lock, as it may delete this object
+	std::shared_ptr<Subscription> self;
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		notEmpty.wait(lock, [this]() { return !queue.empty() || stopRequested; });
+		if (stopRequested) {
+			self.swap(keepAlive);
+			break;
+		}
+		CallEventPtr event = std::move(queue.front());
+		queue.pop_front();
+		metrics.depth = queue.size();
+		notFull.notify_one();
+		lock.unlock();
+		handler->handleEvent(event);
+		lock.lock();
+		metrics.delivered++;
+	}
+}
+
+sSubscriptionMetrics Subscription::getMetrics() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return metrics;
+}
+
+}
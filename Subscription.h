@@ -0,0 +1,106 @@
+/*
+ * libfritz++
+ *
+ * Copyright (C) 2007-2012 Joachim Wilke <libfritz@joachim-wilke.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef SUBSCRIPTION_H
+#define SUBSCRIPTION_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace fritz {
+
+class EventHandler;
+struct CallEvent;
+typedef std::shared_ptr<const CallEvent> CallEventPtr;
+
+/**
+ * Counters of a Subscription.
+ */
+struct sSubscriptionMetrics {
+	size_t depth;              // events waiting for delivery
+	size_t maxDepth;           // maximum of depth since subscribing
+	uint64_t delivered;
+	uint64_t dropped;          // events discarded due to a full queue
+	uint64_t coalesced;        // events merged into a queued event due to a full queue
+	sSubscriptionMetrics() : depth{0}, maxDepth{0}, delivered{0}, dropped{0}, coalesced{0} {}
+};
+
+/**
+ * Delivers call events to one EventHandler using an own bounded queue and thread,
+ * so that a slow handler does not delay the Listener or other subscribers.
+ * Events of one connection are delivered in order.
+ */
+class Subscription : public std::enable_shared_from_this<Subscription> {
+public:
+	/**
+	 * What happens to a new event if the queue is full.
+	 */
+	enum eOverflowPolicy {
+		BLOCK,                   // the Listener waits for space; this stalls a dispatch worker,
+		                         // delaying all subscribers and the handler of the Listener
+		DROP_OLDEST,             // the oldest queued event is discarded
+		COALESCE,                // the event is merged with a queued event of the same connection,
+		                         // i.e., RESOLVED into CALL and DISCONNECT replacing CONNECT,
+		                         // otherwise the oldest queued event is discarded
+	};
+private:
+	EventHandler *handler;
+	eOverflowPolicy policy;
+	size_t capacity;
+	std::deque<CallEventPtr> queue;
+	std::mutex mutex;
+	std::condition_variable notEmpty;
+	std::condition_variable notFull;
+	bool stopRequested;
+	sSubscriptionMetrics metrics;
+	std::thread *thread;
+	std::shared_ptr<Subscription> keepAlive;  // set while the thread runs on after being stopped by the handler
+	bool coalesce(const CallEventPtr &event);
+	void run();
+public:
+	/**
+	 * @param the handler, has to exist until the subscription is stopped
+	 * @param the overflow policy
+	 * @param the maximum number of queued events
+	 */
+	Subscription(EventHandler *handler, eOverflowPolicy policy, size_t capacity);
+	virtual ~Subscription();
+	/**
+	 * Queues an event for delivery, according to the overflow policy.
+	 * With BLOCK, the calling thread waits while the queue is full.
+	 */
+	void push(const CallEventPtr &event);
+	/**
+	 * Stops delivery, waiting for a running call of the handler. Queued events are discarded.
+	 * If called by the handler itself, it returns without waiting. The thread then ends after
+	 * the handler returns, it keeps the subscription alive until then, if it is owned by a shared_ptr.
+	 */
+	void stop();
+	sSubscriptionMetrics getMetrics();
+};
+
+}
+
+#endif /* SUBSCRIPTION_H */
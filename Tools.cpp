@@ -21,17 +21,20 @@
 
 #include "Tools.h"
 
+#include <algorithm>
 #include <string>
 #include <cstdlib>
 #include <locale.h>
 #include <langinfo.h>
 #include <sstream>
 #include <iostream>
+#include <cstring>
 #include <errno.h>
 
 #include "Config.h"
 #include "FritzClient.h"
 #include <liblog++/Log.h>
+#include <libconv++/CharsetConverter.h>
 
 namespace fritz{
 Tools::Tools()
@@ -276,5 +279,87 @@ std::string Tools::Tokenize(const std::string &buffer, const char delimiter, siz
 	return token;
 }
 
+std::string Tools::UrlEncode(const std::string &s_input) {
+	std::string result;
+	std::string s;
+	std::string hex = "0123456789abcdef";
+	convert::CharsetConverter conv("", "ISO-8859-15");
+	s = conv.convert(s_input);
+	for (unsigned int i=0; i<s.length(); i++) {
+		if( ('a' <= s[i] && s[i] <= 'z')
+				|| ('A' <= s[i] && s[i] <= 'Z')
+				|| ('0' <= s[i] && s[i] <= '9') ) {
+			result += s[i];
+		} else {
+			result += '%';
+			result += hex[(unsigned char) s[i] >> 4];
+			result += hex[(unsigned char) s[i] & 0x0f];
+		}
+	}
+	return result;
+}
+
+static const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+
+static inline uint64_t Rotate(uint64_t value, int bits) {
+	return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t Tools::HashContent(const std::string &data) {
+	ContentHasher hasher;
+	hasher.update(data.data(), data.size());
+	return hasher.digest();
+}
+
+ContentHasher::ContentHasher()
+: hash{PRIME3}, length{0}, pendingSize{0} {
+}
+
+void ContentHasher::update(const char *data, size_t size) {
+	const char *pos = data;
+	const char *end = pos + size;
+	length += size;
+	// complete a lane left over by the previous piece
+	if (pendingSize) {
+		size_t missing = std::min<size_t>(8 - pendingSize, size);
+		memcpy(pending + pendingSize, pos, missing);
+		pendingSize += missing;
+		pos += missing;
+		if (pendingSize < 8)
+			return;
+		uint64_t lane;
+		memcpy(&lane, pending, sizeof(lane));
+		hash ^= Rotate(lane * PRIME2, 31) * PRIME1;
+		hash = Rotate(hash, 27) * PRIME1 + PRIME2;
+		pendingSize = 0;
+	}
+	// 8 bytes at a time, the remainder waits for the next piece
+	for (; pos + 8 <= end; pos += 8) {
+		uint64_t lane;
+		memcpy(&lane, pos, sizeof(lane));
+		hash ^= Rotate(lane * PRIME2, 31) * PRIME1;
+		hash = Rotate(hash, 27) * PRIME1 + PRIME2;
+	}
+	memcpy(pending, pos, end - pos);
+	pendingSize = end - pos;
+}
+
+uint64_t ContentHasher::digest() const {
+	uint64_t result = hash + length;
+	for (size_t i = 0; i < pendingSize; i++) {
+		result ^= static_cast<unsigned char>(pending[i]) * PRIME3;
+		result = Rotate(result, 11) * PRIME1;
+	}
+	// final mix, so that every input bit affects every output bit
+	result ^= result >> 33;
+	result *= PRIME2;
+	result ^= result >> 29;
+	result *= PRIME3;
+	result ^= result >> 32;
+	return result;
+}
+
 }
 
@@ -22,6 +22,7 @@
 #ifndef FRITZTOOLS_H
 #define FRITZTOOLS_H
 
+#include <cstdint>
 #include <stdexcept>
 #include <string>
 
@@ -40,6 +41,38 @@ public:
 	static bool GetLocationSettings();
 	static void GetSipSettings();
 	static std::string Tokenize(const std::string &buffer, const char delimiter, size_t pos);
+	/**
+	 * Encodes a parameter for a request to the Fritz!Box, which expects ISO-8859-15.
+	 * All characters except letters and digits are percent-encoded.
+	 * @param the parameter in the local charset
+	 * @return the encoded parameter
+	 */
+	static std::string UrlEncode(const std::string &s);
+	/**
+	 * Calculates a fast, non-cryptographic 64 bit hash, in the style of xxHash64.
+	 * Used to detect if the Fritz!Box sent the same data as before.
+	 * @param the data
+	 * @return the hash
+	 */
+	static uint64_t HashContent(const std::string &data);
+};
+
+/**
+ * Calculates Tools::HashContent() of data passed in pieces, e.g., while it is received.
+ */
+class ContentHasher {
+private:
+	uint64_t hash;
+	uint64_t length;
+	char pending[8];         // bytes not yet hashed, less than 8
+	size_t pendingSize;
+public:
+	ContentHasher();
+	void update(const char *data, size_t size);
+	/**
+	 * @return the hash of all data passed so far
+	 */
+	uint64_t digest() const;
 };
 
 }
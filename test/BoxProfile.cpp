@@ -0,0 +1,125 @@
+/*
+ * BoxProfile.cpp
+ */
+
+#include "gtest/gtest.h"
+#include "FakeBoxFixture.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <unistd.h>
+#include <BoxProfile.h>
+#include <Config.h>
+#include <FritzClient.h>
+#include <SessionManager.h>
+
+namespace test {
+
+class BoxProfile : public FakeBoxFixture {
+protected:
+	std::string dir;
+
+	void SetUp() {
+		FakeBoxFixture::SetUp();
+		char tmpl[] = "/tmp/boxprofileXXXXXX";
+		ASSERT_TRUE(mkdtemp(tmpl) != nullptr);
+		dir = tmpl;
+	}
+
+	void TearDown() {
+		FakeBoxFixture::TearDown();
+		ASSERT_EQ(0, system(("rm -rf " + dir).c_str()));
+	}
+
+	// a new start of the application, with the profile stored by the previous one
+	void restart() {
+		setupBox();
+		fritz::Config::SetupConfigDir(dir);
+	}
+};
+
+TEST_F(BoxProfile, ParseBoxInfo) {
+	std::string boxId, firmware;
+	EXPECT_TRUE(fritz::BoxProfile::ParseBoxInfo(
+			"<j:BoxInfo xmlns:j=\"http://jason.avm.de/updatecheck/\"><j:Name>FRITZ!Box 7390</j:Name>"
+			"<j:Serial>0896A1B2C3D4</j:Serial><j:Version>84.06.83</j:Version><j:Revision>32412</j:Revision></j:BoxInfo>",
+			boxId, firmware));
+	EXPECT_EQ("0896A1B2C3D4", boxId);
+	EXPECT_EQ("84.06.83-32412", firmware);
+	EXPECT_FALSE(fritz::BoxProfile::ParseBoxInfo("<html></html>", boxId, firmware));
+}
+
+TEST_F(BoxProfile, StoreAndLoad) {
+	{
+		fritz::BoxProfile profile;
+		EXPECT_FALSE(profile.load(dir, "box:1", "84.05.50"));
+		profile.setLoginType(fritz::Config::SID);
+		profile.setLang("en");
+		profile.setSupport(fritz::BoxProfile::CALL_LIST_LUA, fritz::BoxProfile::UNSUPPORTED);
+	}
+	fritz::BoxProfile profile;
+	EXPECT_TRUE(profile.load(dir, "box:1", "84.05.50"));
+	EXPECT_EQ(fritz::Config::SID, profile.getLoginType());
+	EXPECT_EQ("en", profile.getLang());
+	EXPECT_EQ(fritz::BoxProfile::UNSUPPORTED, profile.getSupport(fritz::BoxProfile::CALL_LIST_LUA));
+	EXPECT_EQ(fritz::BoxProfile::UNKNOWN, profile.getSupport(fritz::BoxProfile::FONBOOK_XML));
+	// after a firmware update, everything is detected again
+	fritz::BoxProfile updated;
+	EXPECT_FALSE(updated.load(dir, "box:1", "84.06.83"));
+	EXPECT_EQ(fritz::Config::UNKNOWN, updated.getLoginType());
+	EXPECT_EQ(fritz::BoxProfile::UNKNOWN, updated.getSupport(fritz::BoxProfile::CALL_LIST_LUA));
+}
+
+TEST_F(BoxProfile, SkipsProbesOfKnownBox) {
+	// a box with a firmware that knows lua logins, but not the lua call list
+	std::atomic<int> probes{0};
+	handler = [&probes](const sFakeRequest &request) {
+		sFakeResponse response;
+		if (request.path == "/jason_boxinfo.xml")
+			response.body = "<j:BoxInfo><j:Serial>0896A1B2C3D4</j:Serial><j:Version>84.05.28</j:Version></j:BoxInfo>";
+		else if (request.path == "/fon_num/foncalls_list.lua" || request.target.find("login_sid.xml") != std::string::npos) {
+			probes++;
+			response.status = 404;
+		} else if (request.path == "/cgi-bin/webcm" && request.target.find("foncalls") != std::string::npos)
+			response.body = "<html><a href=\"../html/de/FRITZ!Box_Anrufliste.csv\"></a></html>";
+		else if (request.path == "/cgi-bin/webcm" && request.target.find(".csv") != std::string::npos)
+			response.body = FakeHttpServer::Fixture("foncalls_csv");
+		else
+			response = FakeLuaBox(request);
+		return response;
+	};
+	for (int run = 0; run < 2; run++) {
+		restart();
+		fritz::FritzClient fc;
+		EXPECT_NE(std::string::npos, fc.requestCallList().find("Typ;Datum;Name;"));
+		EXPECT_EQ(fritz::Config::LUA, fritz::gConfig->getLoginType());
+		// only the first run probes the lua call list
+		EXPECT_EQ(1, probes);
+	}
+}
+
+TEST_F(BoxProfile, KeepsSupportAfterErrors) {
+	// the lua call list fails once with a server error and once with the login page
+	std::atomic<int> callLists{0};
+	handler = [&callLists](const sFakeRequest &request) {
+		sFakeResponse response = FakeLuaBox(request);
+		if (request.path == "/fon_num/foncalls_list.lua") {
+			int call = callLists++;
+			if (call == 0)
+				response.status = 500;
+			else if (call == 1)
+				response.body = "<html></html>";
+		}
+		return response;
+	};
+	for (int run = 0; run < 2; run++) {
+		restart();
+		fritz::Config::SetupRetryPolicy(fritz::RetryPolicy(std::chrono::milliseconds(10), std::chrono::milliseconds(10), 0.0, 3));
+		fritz::FritzClient fc;
+		EXPECT_EQ(FakeHttpServer::Fixture("foncalls_csv"), fc.requestCallList());
+	}
+	// neither error made the second run skip the lua call list
+	EXPECT_EQ(4, callLists);
+}
+
+}
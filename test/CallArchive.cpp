@@ -0,0 +1,234 @@
+/*
+ * CallArchive.cpp
+ */
+
+#include "gtest/gtest.h"
+#include "BasicInitFixture.h"
+#include "FakeBoxClient.h"
+
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <CallArchive.h>
+#include <CallList.h>
+
+namespace test {
+
+class CallArchive : public BasicInitFixture {
+protected:
+	std::string dir;
+
+	CallArchive()
+	:BasicInitFixture("49", "721") {};
+
+	void SetUp() {
+		BasicInitFixture::SetUp();
+		char tmpl[] = "/tmp/libfritztest.XXXXXX";
+		dir = mkdtemp(tmpl);
+	}
+
+	void TearDown() {
+		DIR *d = opendir(dir.c_str());
+		while (dirent *file = readdir(d))
+			if (file->d_name[0] != '.')
+				unlink((dir + "/" + file->d_name).c_str());
+		closedir(d);
+		rmdir(dir.c_str());
+	}
+
+	ino_t inode(std::string file) {
+		struct stat st;
+		return stat((dir + "/" + file).c_str(), &st) == 0 ? st.st_ino : 0;
+	}
+
+	fritz::CallEntry entry(time_t timestamp, std::string number, std::string duration = "0:01") {
+		fritz::CallEntry ce;
+		ce.type         = fritz::CallEntry::INCOMING;
+		ce.date         = "01.10.26";
+		ce.time         = "10:00";
+		ce.remoteName   = "A; Muster";
+		ce.remoteNumber = number;
+		ce.localName    = "DECT";
+		ce.localNumber  = "Internet: 111";
+		ce.duration     = duration;
+		ce.timestamp    = timestamp;
+		return ce;
+	}
+};
+
+TEST_F(CallArchive, MergeDeduplicates) {
+	fritz::CallArchive archive(dir);
+	EXPECT_EQ(0, (int) archive.size());
+	EXPECT_EQ(3, (int) archive.merge({ entry(300, "07216080"), entry(100, "0304711"), entry(200, "07216080") }));
+	EXPECT_EQ(1, (int) archive.merge({ entry(300, "07216080"), entry(400, "0304711"), entry(300, "07216080") }));
+	EXPECT_EQ(1, (int) archive.merge({ entry(300, "07216080", "0:02") }));
+	EXPECT_EQ(5, (int) archive.size());
+}
+
+TEST_F(CallArchive, Query) {
+	{
+		fritz::CallArchive archive(dir);
+		archive.merge({ entry(300, "07216080"), entry(100, "0304711"), entry(200, "6080") });
+		// older than all archived calls
+		archive.merge({ entry(50, "0304711") });
+	}
+	fritz::CallArchive archive(dir);
+	ASSERT_EQ(4, (int) archive.size());
+
+	std::vector<fritz::CallEntry> calls = archive.callsBetween(100, 300);
+	ASSERT_EQ(2, (int) calls.size());
+	EXPECT_EQ(100, calls[0].timestamp);
+	EXPECT_EQ(200, calls[1].timestamp);
+	EXPECT_EQ("A, Muster", calls[0].remoteName);
+	EXPECT_EQ("Internet: 111", calls[0].localNumber);
+	EXPECT_EQ("0:01", calls[0].duration);
+
+	calls = archive.callsByNumber("004972160800");
+	ASSERT_EQ(0, (int) calls.size());
+	calls = archive.callsByNumber("00497216080");
+	ASSERT_EQ(2, (int) calls.size());
+	EXPECT_EQ(200, calls[0].timestamp);
+	EXPECT_EQ(300, calls[1].timestamp);
+	EXPECT_EQ(2, (int) archive.callsByNumber("0304711").size());
+}
+
+TEST_F(CallArchive, RecoverFromPartialWrite) {
+	{
+		fritz::CallArchive archive(dir);
+		archive.merge({ entry(100, "0304711"), entry(200, "6080") });
+	}
+	{
+		std::ofstream data((dir + "/callhistory.dat").c_str(), std::ios::app);
+		data << "300;1;01.10.26;10:00;A";
+	}
+	fritz::CallArchive archive(dir);
+	EXPECT_EQ(2, (int) archive.size());
+	EXPECT_EQ(1, (int) archive.merge({ entry(300, "0304711") }));
+	EXPECT_EQ(2, (int) archive.callsByNumber("0304711").size());
+}
+
+TEST_F(CallArchive, OutOfOrderMergeKeepsIndex) {
+	ino_t index;
+	{
+		fritz::CallArchive archive(dir);
+		archive.merge({ entry(300, "07216080"), entry(400, "0304711") });
+		index = inode("callhistory.idx");
+		// older calls are appended to the data file after newer ones, they go to the side index
+		archive.merge({ entry(100, "0304711"), entry(200, "6080"), entry(500, "6080") });
+		EXPECT_EQ(0, (int) archive.merge({ entry(100, "0304711") }));
+		EXPECT_EQ(5, (int) archive.callsBetween(0, 1000).size());
+	}
+	fritz::CallArchive archive(dir);
+	// the index is neither rewritten by the merge nor rebuilt on opening, which would replace the file
+	EXPECT_EQ(index, inode("callhistory.idx"));
+	EXPECT_EQ(5, (int) archive.size());
+	std::vector<fritz::CallEntry> calls = archive.callsBetween(100, 500);
+	ASSERT_EQ(4, (int) calls.size());
+	for (size_t pos = 0; pos < calls.size(); pos++)
+		EXPECT_EQ(100 * (time_t) (pos + 1), calls[pos].timestamp);
+	EXPECT_EQ(2, (int) archive.callsByNumber("0304711").size());
+}
+
+TEST_F(CallArchive, DropUncommittedData) {
+	{
+		fritz::CallArchive archive(dir);
+		archive.merge({ entry(100, "0304711"), entry(200, "6080") });
+	}
+	ino_t index = inode("callhistory.idx");
+	{
+		// an index entry written by an interrupted merge
+		std::ofstream file((dir + "/callhistory.idx").c_str(), std::ios::app | std::ios::binary);
+		file << std::string(24, 'x');
+	}
+	fritz::CallArchive archive(dir);
+	EXPECT_EQ(index, inode("callhistory.idx"));
+	EXPECT_EQ(2, (int) archive.size());
+	EXPECT_EQ(1, (int) archive.merge({ entry(300, "0304711") }));
+	EXPECT_EQ(3, (int) archive.callsBetween(0, 1000).size());
+}
+
+TEST_F(CallArchive, RebuildDirtyIndex) {
+	{
+		fritz::CallArchive archive(dir);
+		archive.merge({ entry(100, "0304711"), entry(200, "6080") });
+	}
+	{
+		// damage the header, e.g., by an interrupted rewrite of the number index
+		std::fstream file((dir + "/callhistory.hdr").c_str(), std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(4);
+		file.put(1);
+	}
+	ino_t index = inode("callhistory.idx");
+	fritz::CallArchive archive(dir);
+	EXPECT_NE(index, inode("callhistory.idx"));
+	EXPECT_EQ(2, (int) archive.size());
+	EXPECT_EQ(1, (int) archive.callsByNumber("0304711").size());
+}
+
+TEST_F(CallArchive, CompactSideIndex) {
+	fritz::CallArchive archive(dir);
+	archive.merge({ entry(10000, "0304711") });
+	ino_t index = inode("callhistory.idx");
+	// each merge is older than the archived calls
+	for (time_t timestamp = 9999; timestamp > 9699; timestamp--)
+		archive.merge({ entry(timestamp, "6080") });
+	// the side index grew too large and was merged into the index
+	EXPECT_NE(index, inode("callhistory.idx"));
+	EXPECT_EQ(301, (int) archive.size());
+	std::vector<fritz::CallEntry> calls = archive.callsBetween(0, 20000);
+	ASSERT_EQ(301U, calls.size());
+	for (size_t pos = 1; pos < calls.size(); pos++)
+		EXPECT_EQ(calls[pos-1].timestamp + 1, calls[pos].timestamp);
+	EXPECT_EQ(300U, archive.callsByNumber("6080").size());
+}
+
+TEST_F(CallArchive, ArchivePerBox) {
+	fritz::CallArchive first(dir, "fritz.box");
+	fritz::CallArchive second(dir, "fd00::1");
+	first.merge({ entry(100, "0304711"), entry(200, "6080") });
+	second.merge({ entry(100, "0304711") });
+	EXPECT_EQ(2, (int) first.size());
+	EXPECT_EQ(1, (int) second.size());
+	EXPECT_NE(0U, inode("callhistory-fritz.box.dat"));
+	EXPECT_NE(0U, inode("callhistory-fd00__1.dat"));
+	EXPECT_EQ(0U, inode("callhistory.dat"));
+}
+
+TEST_F(CallArchive, NumberIndexRuns) {
+	// many small merges, alternating between numbers, in and out of order
+	size_t calls = 0;
+	{
+		fritz::CallArchive archive(dir);
+		for (int merge = 0; merge < 50; merge++) {
+			time_t timestamp = merge % 5 == 0 ? 10000 - merge : 1000 + merge * 10;
+			archive.merge({ entry(timestamp, merge % 3 ? "0304711" : "07216080"), entry(timestamp + 1, "0304711") });
+			calls += merge % 3 ? 2 : 1;
+		}
+		std::vector<fritz::CallEntry> result = archive.callsByNumber("0304711");
+		ASSERT_EQ(calls, result.size());
+		for (size_t pos = 1; pos < result.size(); pos++)
+			EXPECT_LE(result[pos-1].timestamp, result[pos].timestamp);
+	}
+	fritz::CallArchive archive(dir);
+	EXPECT_EQ(100, (int) archive.size());
+	EXPECT_EQ(calls, archive.callsByNumber("0304711").size());
+	EXPECT_EQ(100 - calls, archive.callsByNumber("07216080").size());
+}
+
+TEST_F(CallArchive, CallList) {
+	fritz::Config::SetupConfigDir(dir);
+	delete fritz::gConfig->fritzClientFactory;
+	fritz::gConfig->fritzClientFactory = new FakeBoxClientFactory();
+	fritz::CallList::CreateCallList();
+	fritz::CallList *callList = fritz::CallList::GetCallList(false);
+	for (size_t i=0; i<100 && !callList->isValid(); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ASSERT_TRUE(callList->getArchive() != nullptr);
+	EXPECT_EQ(14, (int) callList->getArchive()->size());
+	fritz::CallList::DeleteCallList();
+}
+
+}
@@ -0,0 +1,364 @@
+/*
+ * CallList.cpp
+ */
+
+#include "gtest/gtest.h"
+#include "FakeBoxClient.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <CallList.h>
+#include <CallStatistics.h>
+#include <Config.h>
+
+namespace test {
+
+class CallList : public ::testing::Test {
+protected:
+	fritz::CallList *callList;
+
+	void SetUp() {
+		fritz::Config::Setup("localhost", "", "pwd", true);
+
+		delete fritz::gConfig->fritzClientFactory;
+		fritz::gConfig->fritzClientFactory = new FakeBoxClientFactory();
+
+		fritz::CallList::CreateCallList();
+		callList = fritz::CallList::GetCallList(false);
+		for (size_t i=0; i<100; i++) {
+			if (callList->isValid())
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		}
+	}
+
+	void TearDown() {
+		fritz::CallList::DeleteCallList();
+	}
+
+	void waitForReload(size_t version) {
+		for (size_t i=0; i<100 && callList->getVersion() == version; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+
+	// same conversion as done by the call list parser
+	time_t timestamp(int day, int month, int year, int hour, int min) {
+		tm t;
+		t.tm_mday  = day;
+		t.tm_mon   = month - 1;
+		t.tm_year  = year + 100;
+		t.tm_hour  = hour;
+		t.tm_min   = min;
+		t.tm_sec   = 0;
+		t.tm_isdst = 0;
+		return mktime(&t);
+	}
+};
+
+TEST_F(CallList, Parse) {
+	ASSERT_TRUE(callList->isValid());
+	EXPECT_EQ(14, (int) callList->getSize(fritz::CallEntry::ALL));
+	EXPECT_EQ(6,  (int) callList->getSize(fritz::CallEntry::INCOMING));
+	EXPECT_EQ(3,  (int) callList->getSize(fritz::CallEntry::MISSED));
+	EXPECT_EQ(5,  (int) callList->getSize(fritz::CallEntry::OUTGOING));
+	EXPECT_EQ(timestamp(19, 12, 10, 14, 23), callList->getLastCall());
+	EXPECT_EQ(timestamp(16, 12, 10, 18, 57), callList->getLastMissedCall());
+	EXPECT_TRUE(callList->retrieveEntry(fritz::CallEntry::ALL, 14) == nullptr);
+}
+
+TEST_F(CallList, MissedCalls) {
+	ASSERT_TRUE(callList->isValid());
+	EXPECT_EQ(3, (int) callList->missedCalls(0));
+	EXPECT_EQ(1, (int) callList->missedCalls(timestamp(11, 12, 10, 11, 20)));
+	EXPECT_EQ(0, (int) callList->missedCalls(callList->getLastMissedCall()));
+	EXPECT_EQ(3, (int) callList->missedCallsByMsn("Internet: 111"));
+	EXPECT_EQ(0, (int) callList->missedCallsByMsn("Internet: 222"));
+}
+
+TEST_F(CallList, MissedCallsWithMsnFilter) {
+	ASSERT_TRUE(callList->isValid());
+	fritz::Config::SetupMsnFilter({"222"});
+	EXPECT_EQ(0, (int) callList->missedCalls(0));
+	fritz::Config::SetupMsnFilter({"111"});
+	EXPECT_EQ(3, (int) callList->missedCalls(0));
+}
+
+TEST_F(CallList, MissedCallsAfterSort) {
+	ASSERT_TRUE(callList->isValid());
+	callList->sort(fritz::CallEntry::ELEM_DATE, true);
+	EXPECT_EQ(1, (int) callList->missedCalls(timestamp(11, 12, 10, 11, 20)));
+}
+
+TEST_F(CallList, CallsBetween) {
+	ASSERT_TRUE(callList->isValid());
+	std::vector<fritz::CallEntry *> calls = callList->callsBetween(timestamp(8, 12, 10, 0, 0), timestamp(9, 12, 10, 0, 0));
+	ASSERT_EQ(6, (int) calls.size());
+	EXPECT_EQ("12:21", calls.front()->time);
+	EXPECT_EQ("23:33", calls.back()->time);
+
+	calls = callList->callsBetween(timestamp(8, 12, 10, 0, 0), timestamp(9, 12, 10, 0, 0), fritz::CallEntry::OUTGOING);
+	ASSERT_EQ(3, (int) calls.size());
+	for (auto ce : calls)
+		EXPECT_EQ(fritz::CallEntry::OUTGOING, ce->type);
+
+	EXPECT_EQ(0, (int) callList->callsBetween(timestamp(1, 1, 11, 0, 0), timestamp(2, 1, 11, 0, 0)).size());
+}
+
+TEST_F(CallList, SortAllTypes) {
+	ASSERT_TRUE(callList->isValid());
+	callList->sort(fritz::CallEntry::ELEM_DURATION, false);
+	EXPECT_EQ("0:17", callList->retrieveEntry(fritz::CallEntry::ALL, 0)->duration);
+	EXPECT_EQ("0:17", callList->retrieveEntry(fritz::CallEntry::INCOMING, 0)->duration);
+	EXPECT_EQ("0:01", callList->retrieveEntry(fritz::CallEntry::OUTGOING, 0)->duration);
+	for (size_t type = fritz::CallEntry::ALL; type < fritz::CallEntry::TYPES_COUNT; type++) {
+		fritz::CallEntry::eCallType t = (fritz::CallEntry::eCallType) type;
+		for (size_t pos = 1; pos < callList->getSize(t); pos++)
+			EXPECT_GE(fritz::CallList::ParseDuration(callList->retrieveEntry(t, pos-1)->duration),
+			          fritz::CallList::ParseDuration(callList->retrieveEntry(t, pos)->duration));
+	}
+}
+
+TEST_F(CallList, SortCached) {
+	ASSERT_TRUE(callList->isValid());
+	callList->sort(fritz::CallEntry::ELEM_REMOTENAME, true);
+	fritz::CallEntry *first = callList->retrieveEntry(fritz::CallEntry::ALL, 0);
+	callList->sort(fritz::CallEntry::ELEM_DATE, true);
+	EXPECT_EQ("04.12.10", callList->retrieveEntry(fritz::CallEntry::ALL, 0)->date);
+	callList->sort(fritz::CallEntry::ELEM_REMOTENAME, true);
+	EXPECT_EQ(first, callList->retrieveEntry(fritz::CallEntry::ALL, 0));
+	EXPECT_EQ("", first->remoteName);
+}
+
+TEST_F(CallList, ParseDuration) {
+	EXPECT_EQ(60,    fritz::CallList::ParseDuration("0:01"));
+	EXPECT_EQ(36000, fritz::CallList::ParseDuration("10:00"));
+	EXPECT_EQ(35940, fritz::CallList::ParseDuration("9:59"));
+}
+
+TEST_F(CallList, StoreDeduplicatesStrings) {
+	ASSERT_TRUE(callList->isValid());
+	std::shared_ptr<const fritz::CallStore> store = callList->getStore();
+	ASSERT_EQ(14, (int) store->size());
+	EXPECT_EQ(store->getLocalNumber(0), store->getLocalNumber(1));
+	EXPECT_EQ(store->getRemoteNumber(9), store->getRemoteNumber(12));
+	EXPECT_EQ(34, (int) store->getPool().size()); // instead of 8 strings per entry
+}
+
+TEST_F(CallList, EntryFacade) {
+	ASSERT_TRUE(callList->isValid());
+	fritz::CallEntry *ce = callList->retrieveEntry(fritz::CallEntry::ALL, 0);
+	ASSERT_TRUE(ce != nullptr);
+	EXPECT_EQ(fritz::CallEntry::OUTGOING, ce->type);
+	EXPECT_EQ("19.12.10", ce->date);
+	EXPECT_EQ("14:23", ce->time);
+	EXPECT_EQ("AVM Ansage (HD)", ce->remoteName);
+	EXPECT_EQ("**799", ce->remoteNumber);
+	EXPECT_EQ("DECT extern", ce->localName);
+	EXPECT_EQ("Internet: 111", ce->localNumber);
+	EXPECT_EQ("0:01", ce->duration);
+	EXPECT_EQ(timestamp(19, 12, 10, 14, 23), ce->timestamp);
+	// entries are created once and stay valid until the next reload
+	EXPECT_EQ(ce, callList->retrieveEntry(fritz::CallEntry::ALL, 0));
+	EXPECT_EQ(ce, callList->retrieveEntry(fritz::CallEntry::OUTGOING, 0));
+}
+
+TEST_F(CallList, FormatDuration) {
+	EXPECT_EQ("0:01", fritz::CallList::FormatDuration(60));
+	EXPECT_EQ("10:00", fritz::CallList::FormatDuration(36000));
+	EXPECT_EQ("9:59", fritz::CallList::FormatDuration(35940));
+}
+
+TEST_F(CallList, ProvisionalEntries) {
+	ASSERT_TRUE(callList->isValid());
+	// a call the Fritz!Box already knows and a new one
+	fritz::CallEntry known;
+	known.type         = fritz::CallEntry::OUTGOING;
+	known.date         = "19.12.10";
+	known.time         = "14:24";
+	known.remoteName   = "**799";
+	known.remoteNumber = "**799";
+	known.localNumber  = "111";
+	known.duration     = "0:01";
+	known.timestamp    = timestamp(19, 12, 10, 14, 24);
+	fritz::CallEntry fresh = known;
+	fresh.time         = "15:00";
+	fresh.remoteNumber = "0721123";
+	fresh.timestamp    = timestamp(19, 12, 10, 15, 0);
+
+	callList->addProvisional(known);
+	callList->addProvisional(fresh);
+	ASSERT_EQ(16, (int) callList->getSize(fritz::CallEntry::ALL));
+	EXPECT_EQ(7, (int) callList->getSize(fritz::CallEntry::OUTGOING));
+	EXPECT_TRUE(callList->retrieveEntry(fritz::CallEntry::ALL, 0)->provisional);
+	EXPECT_EQ("0721123", callList->retrieveEntry(fritz::CallEntry::ALL, 0)->remoteNumber);
+	EXPECT_FALSE(callList->retrieveEntry(fritz::CallEntry::ALL, 2)->provisional);
+	EXPECT_EQ(fresh.timestamp, callList->getLastCall());
+	// not counted before confirmed by the Fritz!Box
+	EXPECT_EQ(5, (int) callList->getStatistics().getCalls(fritz::CallEntry::OUTGOING));
+
+	// the reload confirms the first call, the second one stays provisional
+	size_t version = callList->getVersion();
+	callList->reload();
+	waitForReload(version);
+	ASSERT_EQ(15, (int) callList->getSize(fritz::CallEntry::ALL));
+	EXPECT_TRUE(callList->retrieveEntry(fritz::CallEntry::ALL, 0)->provisional);
+	EXPECT_EQ("0721123", callList->retrieveEntry(fritz::CallEntry::ALL, 0)->remoteNumber);
+	EXPECT_FALSE(callList->retrieveEntry(fritz::CallEntry::ALL, 1)->provisional);
+}
+
+TEST_F(CallList, ReloadLater) {
+	ASSERT_TRUE(callList->isValid());
+	fritz::CallEntry known;
+	known.type         = fritz::CallEntry::OUTGOING;
+	known.date         = "19.12.10";
+	known.time         = "14:24";
+	known.remoteNumber = "**799";
+	known.localNumber  = "111";
+	known.duration     = "0:01";
+	known.timestamp    = timestamp(19, 12, 10, 14, 24);
+	callList->addProvisional(known);
+	size_t version = callList->getVersion();
+	// several calls ending at the same time share one reload
+	callList->reloadLater(std::chrono::seconds(1));
+	callList->reloadLater(std::chrono::seconds(1));
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	EXPECT_EQ(version, callList->getVersion());
+	EXPECT_TRUE(callList->retrieveEntry(fritz::CallEntry::ALL, 0)->provisional);
+	waitForReload(version);
+	EXPECT_EQ(version + 1, callList->getVersion());
+	EXPECT_EQ(14, (int) callList->getSize(fritz::CallEntry::ALL));
+	EXPECT_FALSE(callList->retrieveEntry(fritz::CallEntry::ALL, 0)->provisional);
+}
+
+TEST_F(CallList, ProvisionalKeepsEntries) {
+	ASSERT_TRUE(callList->isValid());
+	fritz::CallEntry *ce = callList->retrieveEntry(fritz::CallEntry::ALL, 0);
+	std::shared_ptr<const fritz::CallStore> store = callList->getStore();
+	fritz::CallEntry call = *ce;
+	call.remoteNumber = "0721123";
+	call.timestamp    = timestamp(19, 12, 10, 15, 0);
+	// readers run while the call monitor adds entries
+	std::atomic<bool> stop(false);
+	std::thread reader([this, &stop]() {
+		while (!stop) {
+			for (size_t pos = 0; pos < callList->getSize(fritz::CallEntry::ALL); pos++)
+				callList->retrieveEntry(fritz::CallEntry::ALL, pos);
+			callList->missedCalls(0);
+			callList->sort(fritz::CallEntry::ELEM_DURATION);
+		}
+	});
+	for (size_t i = 0; i < 20; i++)
+		callList->addProvisional(call);
+	stop = true;
+	reader.join();
+	// entries and the store handed out before stay valid
+	EXPECT_EQ("**799", ce->remoteNumber);
+	EXPECT_EQ(14, (int) store->size());
+	EXPECT_EQ(34, (int) callList->getSize(fritz::CallEntry::ALL));
+}
+
+TEST_F(CallList, UnchangedReload) {
+	ASSERT_TRUE(callList->isValid());
+	size_t version = callList->getVersion();
+	fritz::CallEntry *ce = callList->retrieveEntry(fritz::CallEntry::ALL, 0);
+	// the second reload waits for the first one
+	callList->reload();
+	callList->reload();
+	callList->reload();
+	EXPECT_TRUE(callList->isValid());
+	// the same data is not parsed again, so entries stay the same
+	EXPECT_EQ(version, callList->getVersion());
+	EXPECT_EQ(ce, callList->retrieveEntry(fritz::CallEntry::ALL, 0));
+	EXPECT_EQ(14, (int) callList->getSize(fritz::CallEntry::ALL));
+}
+
+// sends a part of the list, repeats the request and sends the list in pieces, or fails
+class RetryingBoxClient : public FakeBoxClient {
+public:
+	static bool fail;
+	RetryingBoxClient() : FakeBoxClient("74.04.86") {}
+	virtual bool streamCallList(const sink_t &sink) {
+		if (fail)
+			return false;
+		std::string csv = requestCallList();
+		sink(csv.data(), 100);
+		sink(nullptr, 0);
+		for (size_t pos = 0; pos < csv.size(); pos += 300)
+			sink(csv.data() + pos, std::min<size_t>(300, csv.size() - pos));
+		return true;
+	}
+};
+
+bool RetryingBoxClient::fail = false;
+
+class RetryingBoxClientFactory : public fritz::FritzClientFactory {
+	virtual fritz::FritzClient *create() {
+		return new RetryingBoxClient;
+	}
+};
+
+TEST_F(CallList, StreamedReload) {
+	ASSERT_TRUE(callList->isValid());
+	size_t version = callList->getVersion();
+	delete fritz::gConfig->fritzClientFactory;
+	fritz::gConfig->fritzClientFactory = new RetryingBoxClientFactory();
+	// the repeated list has the same hash as before, it is not parsed again
+	RetryingBoxClient::fail = false;
+	callList->reload();
+	callList->reload();
+	EXPECT_EQ(version, callList->getVersion());
+	// a failed request keeps the list
+	RetryingBoxClient::fail = true;
+	callList->reload();
+	callList->reload();
+	EXPECT_TRUE(callList->isValid());
+	EXPECT_EQ(14, (int) callList->getSize(fritz::CallEntry::ALL));
+}
+
+// sends the given number of copies of the same call
+class RepeatedCallClient : public FakeBoxClient {
+public:
+	static size_t copies;
+	RepeatedCallClient() : FakeBoxClient("74.04.86") {}
+	virtual std::string requestCallList() {
+		std::string csv = "sep=;\nTyp;Datum;Name;Rufnummer;Nebenstelle;Eigene Rufnummer;Dauer\n";
+		for (size_t i = 0; i < copies; i++)
+			csv += "1;20.12.10 10:00;;0721123;;Internet: 111;0:01\n";
+		return csv;
+	}
+};
+
+size_t RepeatedCallClient::copies = 1;
+
+class RepeatedCallClientFactory : public fritz::FritzClientFactory {
+	virtual fritz::FritzClient *create() {
+		return new RepeatedCallClient;
+	}
+};
+
+TEST_F(CallList, StatisticsCountEqualCalls) {
+	ASSERT_TRUE(callList->isValid());
+	EXPECT_EQ(6, (int) callList->getStatistics().getCalls(fritz::CallEntry::INCOMING));
+	delete fritz::gConfig->fritzClientFactory;
+	fritz::gConfig->fritzClientFactory = new RepeatedCallClientFactory();
+	size_t version = callList->getVersion();
+	RepeatedCallClient::copies = 1;
+	callList->reload();
+	waitForReload(version);
+	EXPECT_EQ(7, (int) callList->getStatistics().getCalls(fritz::CallEntry::INCOMING));
+	// a second call in the same minute is added, the first one is not added again
+	version = callList->getVersion();
+	RepeatedCallClient::copies = 2;
+	callList->reload();
+	waitForReload(version);
+	EXPECT_EQ(8, (int) callList->getStatistics().getCalls(fritz::CallEntry::INCOMING));
+	// fewer copies do not remove calls
+	version = callList->getVersion();
+	RepeatedCallClient::copies = 1;
+	callList->reload();
+	waitForReload(version);
+	EXPECT_EQ(8, (int) callList->getStatistics().getCalls(fritz::CallEntry::INCOMING));
+}
+
+}
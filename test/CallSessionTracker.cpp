@@ -0,0 +1,95 @@
+/*
+ * CallSessionTracker.cpp
+ */
+
+#include "gtest/gtest.h"
+
+#include <CallSessionTracker.h>
+
+namespace test {
+
+static fritz::CallSession session(int connId, bool outgoing = false) {
+	fritz::CallSession s;
+	s.connId       = connId;
+	s.outgoing     = outgoing;
+	s.startTime    = 1292765000;
+	s.remoteNumber = "0721" + std::to_string(connId);
+	s.localNumber  = "111";
+	s.medium       = "SIP0";
+	return s;
+}
+
+TEST(CallSessionTracker, ManySessions) {
+	fritz::CallSessionTracker tracker(4);
+	for (int connId = 0; connId < 100; connId++)
+		tracker.begin(session(connId * 7));
+	EXPECT_EQ(100, (int) tracker.size());
+	// remove every other session, the remaining ones must still be found
+	fritz::CallEntry ce;
+	for (int connId = 0; connId < 100; connId += 2)
+		EXPECT_TRUE(tracker.end(connId * 7, 0, ce));
+	EXPECT_EQ(50, (int) tracker.size());
+	for (int connId = 0; connId < 100; connId++)
+		EXPECT_EQ(connId % 2 == 1, tracker.contains(connId * 7));
+	EXPECT_FALSE(tracker.end(0, 0, ce));
+	EXPECT_FALSE(tracker.connect(0, 0));
+}
+
+TEST(CallSessionTracker, SeveralBoxes) {
+	fritz::CallSessionTracker tracker(4);
+	// the boxes use the same connection ids independently
+	for (size_t box = 0; box < 10; box++)
+		for (int connId = 0; connId < 4; connId++) {
+			fritz::CallSession s = session(connId);
+			s.box = box;
+			tracker.begin(s);
+		}
+	EXPECT_EQ(40, (int) tracker.size());
+	fritz::CallEntry ce;
+	EXPECT_TRUE(tracker.end(1, 0, ce, 3));
+	EXPECT_FALSE(tracker.contains(1, 3));
+	EXPECT_TRUE(tracker.contains(1, 2));
+	EXPECT_TRUE(tracker.contains(1, 4));
+	EXPECT_FALSE(tracker.connect(1, 0, 3));
+	EXPECT_TRUE(tracker.connect(1, 0));
+	EXPECT_FALSE(tracker.contains(0, 10));
+	EXPECT_EQ(39, (int) tracker.size());
+}
+
+TEST(CallSessionTracker, Entries) {
+	fritz::CallSessionTracker tracker;
+	fritz::CallEntry ce;
+
+	tracker.begin(session(1));
+	ASSERT_TRUE(tracker.end(1, 0, ce));
+	EXPECT_EQ(fritz::CallEntry::MISSED, ce.type);
+	EXPECT_EQ("07211", ce.remoteName);
+	EXPECT_EQ("0:00", ce.duration);
+	EXPECT_TRUE(ce.provisional);
+
+	tracker.begin(session(2));
+	ASSERT_TRUE(tracker.connect(2, 1292765010));
+	ASSERT_TRUE(tracker.resolve(2, "Finanzamt"));
+	ASSERT_TRUE(tracker.end(2, 61, ce));
+	EXPECT_EQ(fritz::CallEntry::INCOMING, ce.type);
+	EXPECT_EQ("Finanzamt", ce.remoteName);
+	EXPECT_EQ("07212", ce.remoteNumber);
+	EXPECT_EQ("111", ce.localNumber);
+	EXPECT_EQ("0:02", ce.duration);
+
+	tracker.begin(session(3, true));
+	ASSERT_TRUE(tracker.end(3, 0, ce));
+	EXPECT_EQ(fritz::CallEntry::OUTGOING, ce.type);
+
+	// date and time are formatted like in the call list of the Fritz!Box
+	time_t start = 1292765000;
+	tm t;
+	localtime_r(&start, &t);
+	char date[16];
+	strftime(date, sizeof(date), "%d.%m.%y", &t);
+	EXPECT_EQ(date, ce.date);
+	EXPECT_EQ(5, (int) ce.time.size());
+	EXPECT_EQ(0, (int) tracker.size());
+}
+
+}
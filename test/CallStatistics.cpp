@@ -0,0 +1,90 @@
+/*
+ * CallStatistics.cpp
+ */
+
+#include "gtest/gtest.h"
+#include "BasicInitFixture.h"
+#include "FakeBoxClient.h"
+
+#include <thread>
+#include <CallList.h>
+#include <CallStatistics.h>
+
+namespace test {
+
+class CallStatistics : public BasicInitFixture {
+protected:
+	CallStatistics()
+	:BasicInitFixture("49", "721") {};
+
+	fritz::CallEntry entry(fritz::CallEntry::eCallType type, std::string number, std::string time, std::string duration) {
+		fritz::CallEntry ce;
+		ce.type         = type;
+		ce.date         = "01.10.26";
+		ce.time         = time;
+		ce.remoteNumber = number;
+		ce.duration     = duration;
+		ce.timestamp    = 0;
+		return ce;
+	}
+};
+
+TEST_F(CallStatistics, Ingest) {
+	fritz::CallStatistics cs;
+	cs.ingest(entry(fritz::CallEntry::INCOMING, "07216080",     "10:15", "0:05"));
+	cs.ingest(entry(fritz::CallEntry::MISSED,   "004972160800", "10:30", "0:00"));
+	cs.ingest(entry(fritz::CallEntry::OUTGOING, "6080",         "18:00", "1:00"));
+	cs.ingest(entry(fritz::CallEntry::MISSED,   "",             "10:45", "0:00"));
+
+	EXPECT_EQ(4, (int) cs.getCalls());
+	EXPECT_EQ(2, (int) cs.getCalls(fritz::CallEntry::MISSED));
+	EXPECT_EQ(65 * 60, cs.getTalkTime());
+	EXPECT_DOUBLE_EQ(2.0 / 3, cs.getMissedCallRate());
+	EXPECT_EQ(3, (int) cs.getCallsPerHour(10));
+	EXPECT_EQ(10, (int) cs.getBusiestHour());
+
+	fritz::CallStatistics::sNumberStatistics ns;
+	ASSERT_TRUE(cs.getNumberStatistics("07216080", ns));
+	EXPECT_EQ(2, (int) ns.calls);
+	EXPECT_EQ(0, (int) ns.missedCalls);
+	EXPECT_EQ(65 * 60, ns.talkTime);
+	EXPECT_FALSE(cs.getNumberStatistics("0815", ns));
+}
+
+TEST_F(CallStatistics, TopCallers) {
+	fritz::CallStatistics cs(2);
+	cs.ingest(entry(fritz::CallEntry::INCOMING, "1", "10:00", "0:01"));
+	cs.ingest(entry(fritz::CallEntry::INCOMING, "2", "10:00", "0:01"));
+	cs.ingest(entry(fritz::CallEntry::INCOMING, "3", "10:00", "0:01"));
+	cs.ingest(entry(fritz::CallEntry::INCOMING, "3", "10:00", "0:01"));
+	cs.ingest(entry(fritz::CallEntry::INCOMING, "2", "10:00", "0:01"));
+	cs.ingest(entry(fritz::CallEntry::INCOMING, "3", "10:00", "0:01"));
+
+	std::vector<std::pair<std::string, size_t>> top = cs.getTopCallers();
+	ASSERT_EQ(2, (int) top.size());
+	EXPECT_EQ("00497213", top[0].first);
+	EXPECT_EQ(3, (int) top[0].second);
+	EXPECT_EQ("00497212", top[1].first);
+	EXPECT_EQ(2, (int) top[1].second);
+}
+
+TEST_F(CallStatistics, CallListReload) {
+	delete fritz::gConfig->fritzClientFactory;
+	fritz::gConfig->fritzClientFactory = new FakeBoxClientFactory();
+	fritz::CallList::CreateCallList();
+	fritz::CallList *callList = fritz::CallList::GetCallList(false);
+	for (size_t i=0; i<100 && callList->getVersion() < 1; i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ASSERT_EQ(14, (int) callList->getStatistics().getCalls());
+
+	// the same list again does not add any calls, it is not even parsed again
+	callList->reload();
+	callList->reload();
+	callList->reload();
+	ASSERT_EQ(1, (int) callList->getVersion());
+	EXPECT_EQ(14, (int) callList->getStatistics().getCalls());
+	EXPECT_EQ(3,  (int) callList->getStatistics().getCalls(fritz::CallEntry::MISSED));
+	fritz::CallList::DeleteCallList();
+}
+
+}
@@ -0,0 +1,55 @@
+/*
+ * ContentDecoder.cpp
+ */
+
+#include "gtest/gtest.h"
+#include "FakeHttpServer.h"
+
+#include <ContentDecoder.h>
+
+namespace test {
+
+// decodes data passed in pieces of the given size
+static std::string Decode(const std::string &encoding, const std::string &data, size_t piece) {
+	std::string result;
+	fritz::ContentDecoder decoder(encoding, [&result](const char *data, size_t length) {
+		result.append(data, length);
+	});
+	for (size_t pos = 0; pos < data.size(); pos += piece)
+		decoder.write(data.data() + pos, std::min(piece, data.size() - pos));
+	decoder.finish();
+	return result;
+}
+
+TEST(ContentDecoder, Fixtures) {
+	for (const std::string name : {"foncalls_csv", "fonbuch_xml"}) {
+		std::string fixture = FakeHttpServer::Fixture(name);
+		ASSERT_LT(0U, fixture.size());
+		EXPECT_EQ(fixture, Decode("gzip", FakeHttpServer::Compress(fixture, 31), 1));
+		EXPECT_EQ(fixture, Decode("x-gzip", FakeHttpServer::Compress(fixture, 31), 100000));
+		EXPECT_EQ(fixture, Decode("deflate", FakeHttpServer::Compress(fixture, 15), 7));
+		// some servers send deflate without the zlib header
+		EXPECT_EQ(fixture, Decode("deflate", FakeHttpServer::Compress(fixture, -15), 1));
+		EXPECT_EQ(fixture, Decode("deflate", FakeHttpServer::Compress(fixture, -15), 100000));
+	}
+}
+
+TEST(ContentDecoder, LargeBody) {
+	std::string large;
+	for (int i = 0; large.size() < (1 << 20); i++)
+		large.append("line " + std::to_string(i) + "\n");
+	EXPECT_EQ(large, Decode("gzip", FakeHttpServer::Compress(large), 4096));
+}
+
+TEST(ContentDecoder, Errors) {
+	EXPECT_FALSE(fritz::ContentDecoder::IsSupported("br"));
+	EXPECT_THROW(Decode("br", "", 1), std::runtime_error);
+	EXPECT_THROW(Decode("gzip", "this is not compressed at all", 100), std::runtime_error);
+	std::string compressed = FakeHttpServer::Compress(FakeHttpServer::Fixture("foncalls_csv"));
+	EXPECT_THROW(Decode("gzip", compressed.substr(0, compressed.size() / 2), 100), std::runtime_error);
+	compressed[compressed.size() / 2] ^= 0x55;
+	compressed[compressed.size() / 2 + 1] ^= 0x55;
+	EXPECT_THROW(Decode("gzip", compressed, 100), std::runtime_error);
+}
+
+}
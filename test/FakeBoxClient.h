@@ -55,6 +55,18 @@ public:
 		return getFile("fonbuch_xml");
 	}
 
+	virtual bool streamCallList(const sink_t &sink) {
+		std::string csv = requestCallList();
+		sink(csv.data(), csv.size());
+		return true;
+	}
+
+	virtual bool streamFonbook(const sink_t &sink) {
+		std::string xml = requestFonbook();
+		sink(xml.data(), xml.size());
+		return true;
+	}
+
 	virtual void writeFonbook(std::string) {
 	}
 
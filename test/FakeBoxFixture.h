@@ -0,0 +1,45 @@
+/*
+ * FakeBoxFixture.h
+ */
+
+#ifndef FAKEBOXFIXTURE_H_
+#define FAKEBOXFIXTURE_H_
+
+#include "gtest/gtest.h"
+#include "FakeHttpServer.h"
+
+#include <Config.h>
+#include <HttpConnectionPool.h>
+#include <SessionManager.h>
+
+namespace test {
+
+// runs a FakeHttpServer as the box in gConfig, answering like FakeLuaBox unless a test sets another handler
+class FakeBoxFixture : public ::testing::Test {
+protected:
+	FakeHttpServer::handler_t handler;
+	FakeHttpServer server;
+
+	FakeBoxFixture()
+	: handler(FakeLuaBox), server([this](const sFakeRequest &request) { return handler(request); }) {}
+
+	// sets up gConfig for the server, again for tests simulating a restart
+	void setupBox() {
+		fritz::Config::Setup("127.0.0.1", "", "pwd");
+		fritz::Config::SetupPorts(1012, server.port, 49000);
+	}
+
+	void SetUp() {
+		fritz::HttpConnectionPool::Get().clear();
+		setupBox();
+	}
+
+	void TearDown() {
+		fritz::SessionManager::DeleteSessionManager();
+		fritz::HttpConnectionPool::Get().clear();
+	}
+};
+
+}
+
+#endif /* FAKEBOXFIXTURE_H_ */
@@ -0,0 +1,65 @@
+/*
+ * FakeCallMonitor.h
+ */
+
+#ifndef FAKECALLMONITOR_H_
+#define FAKECALLMONITOR_H_
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace test {
+
+// serves the given lines to the clients connecting to a local port
+class FakeCallMonitor {
+private:
+	int serverFd;
+	std::thread *thread;
+public:
+	int port;
+	/**
+	 * @param the lines sent to each client
+	 * @param the number of clients to serve, one after the other
+	 * @param milliseconds to keep a connection open after sending the lines
+	 */
+	FakeCallMonitor(std::vector<std::string> lines, int clients = 1, int holdTime = 2000) {
+		serverFd = socket(AF_INET, SOCK_STREAM, 0);
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		bind(serverFd, (sockaddr *) &addr, sizeof(addr));
+		socklen_t len = sizeof(addr);
+		getsockname(serverFd, (sockaddr *) &addr, &len);
+		port = ntohs(addr.sin_port);
+		timeval timeout = { 5, 0 };
+		setsockopt(serverFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		listen(serverFd, 1);
+		thread = new std::thread([this, lines, clients, holdTime]() {
+			for (int client = 0; client < clients; client++) {
+				int fd = accept(serverFd, nullptr, nullptr);
+				if (fd < 0)
+					return;
+				for (auto line : lines) {
+					if (write(fd, line.c_str(), line.size()) < 0)
+						break;
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(holdTime));
+				close(fd);
+			}
+		});
+	}
+	~FakeCallMonitor() {
+		thread->join();
+		delete thread;
+		close(serverFd);
+	}
+};
+
+}
+
+#endif /* FAKECALLMONITOR_H_ */
@@ -0,0 +1,216 @@
+/*
+ * FakeHttpServer.h
+ */
+
+#ifndef FAKEHTTPSERVER_H_
+#define FAKEHTTPSERVER_H_
+
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace test {
+
+struct sFakeRequest {
+	std::string method;
+	std::string target;                          // path and query
+	std::string path;
+	std::map<std::string, std::string> headers;  // names in lower case
+	std::string body;
+};
+
+struct sFakeResponse {
+	int status = 200;
+	std::string body;
+	std::map<std::string, std::string> headers;
+	bool close = false;                          // close the connection after this response
+	bool drop = false;                           // close the connection without a response
+};
+
+// a local HTTP/1.1 server with keep-alive, answering each request using a handler function
+class FakeHttpServer {
+public:
+	typedef std::function<sFakeResponse(const sFakeRequest &)> handler_t;
+private:
+	int serverFd;
+	std::thread *thread;
+	std::mutex mutex;
+	std::vector<int> clientFds;
+	std::vector<std::thread *> clientThreads;
+	handler_t handler;
+
+	static bool readRequest(int fd, std::string &pending, sFakeRequest &request) {
+		char buffer[4096];
+		size_t end;
+		while ((end = pending.find("\r\n\r\n")) == std::string::npos) {
+			ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+			if (n <= 0)
+				return false;
+			pending.append(buffer, n);
+		}
+		std::istringstream head(pending.substr(0, end));
+		pending.erase(0, end + 4);
+		std::string line, version;
+		std::getline(head, line);
+		std::istringstream requestLine(line);
+		requestLine >> request.method >> request.target >> version;
+		request.path = request.target.substr(0, request.target.find('?'));
+		request.headers.clear();
+		while (std::getline(head, line)) {
+			size_t colon = line.find(':');
+			if (colon == std::string::npos)
+				continue;
+			std::string name = line.substr(0, colon);
+			for (char &c : name)
+				c = tolower(c);
+			std::string value = line.substr(colon + 1);
+			value.erase(0, value.find_first_not_of(' '));
+			if (value.size() && value[value.size() - 1] == '\r')
+				value.erase(value.size() - 1);
+			request.headers[name] = value;
+		}
+		size_t length = request.headers.count("content-length") ? atoi(request.headers["content-length"].c_str()) : 0;
+		while (pending.size() < length) {
+			ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+			if (n <= 0)
+				return false;
+			pending.append(buffer, n);
+		}
+		request.body = pending.substr(0, length);
+		pending.erase(0, length);
+		return true;
+	}
+
+	void serve(int fd) {
+		std::string pending;
+		sFakeRequest request;
+		while (readRequest(fd, pending, request)) {
+			requests++;
+			sFakeResponse response = handler(request);
+			if (response.drop)
+				break;
+			std::ostringstream message;
+			message << "HTTP/1.1 " << response.status << " Fake\r\n";
+			if (!response.headers.count("Transfer-Encoding"))
+				message << "Content-Length: " << response.body.size() << "\r\n";
+			for (auto &header : response.headers)
+				message << header.first << ": " << header.second << "\r\n";
+			if (response.close)
+				message << "Connection: close\r\n";
+			message << "\r\n" << response.body;
+			std::string data = message.str();
+			if (send(fd, data.data(), data.size(), MSG_NOSIGNAL) < 0 || response.close)
+				break;
+		}
+		shutdown(fd, SHUT_RDWR);
+	}
+
+public:
+	int port;
+	std::atomic<int> connections;
+	std::atomic<int> requests;
+
+	FakeHttpServer(handler_t handler)
+	: handler(handler), connections{0}, requests{0} {
+		serverFd = socket(AF_INET, SOCK_STREAM, 0);
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		bind(serverFd, (sockaddr *) &addr, sizeof(addr));
+		socklen_t len = sizeof(addr);
+		getsockname(serverFd, (sockaddr *) &addr, &len);
+		port = ntohs(addr.sin_port);
+		listen(serverFd, 16);
+		thread = new std::thread([this]() {
+			while (true) {
+				int fd = accept(serverFd, nullptr, nullptr);
+				if (fd < 0)
+					return;
+				connections++;
+				std::lock_guard<std::mutex> lock(mutex);
+				clientFds.push_back(fd);
+				clientThreads.push_back(new std::thread(&FakeHttpServer::serve, this, fd));
+			}
+		});
+	}
+
+	// closes all connections, like a server dropping idle keep-alive connections
+	void closeConnections() {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (int fd : clientFds)
+			shutdown(fd, SHUT_RDWR);
+	}
+
+	~FakeHttpServer() {
+		shutdown(serverFd, SHUT_RDWR);
+		thread->join();
+		delete thread;
+		closeConnections();
+		for (std::thread *client : clientThreads) {
+			client->join();
+			delete client;
+		}
+		for (int fd : clientFds)
+			close(fd);
+		close(serverFd);
+	}
+
+	// returns the body of a recorded response in test/<version>/
+	static std::string Fixture(const std::string &name, const std::string &version = "74.04.86") {
+		std::stringstream ss;
+#ifdef SOURCE_DIR
+		ss << SOURCE_DIR << "/";
+#endif
+		ss << "test/" << version << "/" << name;
+		std::ifstream t(ss.str().c_str());
+		std::string content((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
+		size_t body = content.find("\n\n");
+		return body == std::string::npos ? content : content.substr(body + 2);
+	}
+
+	// compresses data like a server with Content-Encoding gzip (windowBits 31), deflate (15) or raw deflate (-15)
+	static std::string Compress(const std::string &data, int windowBits = 31) {
+		z_stream stream = z_stream();
+		deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+		std::string result(deflateBound(&stream, data.size()), '\0');
+		stream.next_in   = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+		stream.avail_in  = data.size();
+		stream.next_out  = reinterpret_cast<Bytef *>(&result[0]);
+		stream.avail_out = result.size();
+		deflate(&stream, Z_FINISH);
+		result.resize(stream.total_out);
+		deflateEnd(&stream);
+		return result;
+	}
+};
+
+// answers like a Fritz!Box with lua login
+inline sFakeResponse FakeLuaBox(const sFakeRequest &request) {
+	sFakeResponse response;
+	if (request.path == "/login_sid.lua") {
+		std::string sid = request.method == "POST" || request.target.find("sid=0123456789abcdef") != std::string::npos
+		                ? "0123456789abcdef" : "0000000000000000";
+		response.body = "<SessionInfo><SID>" + sid + "</SID><Challenge>1234567z</Challenge><BlockTime>0</BlockTime><Rights></Rights></SessionInfo>";
+	} else if (request.path == "/fon_num/foncalls_list.lua") {
+		response.body = FakeHttpServer::Fixture("foncalls_csv");
+	} else if (request.path == "/cgi-bin/webcm") {
+		response.body = "<html></html>";
+	} else {
+		response.status = 404;
+	}
+	return response;
+}
+
+}
+
+#endif /* FAKEHTTPSERVER_H_ */
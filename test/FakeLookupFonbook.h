@@ -0,0 +1,38 @@
+/*
+ * FakeLookupFonbook.h
+ */
+
+#ifndef FAKELOOKUPFONBOOK_H_
+#define FAKELOOKUPFONBOOK_H_
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <LookupFonbook.h>
+
+namespace test {
+
+// a reverse lookup service that knows every number, but answers slowly
+class FakeLookupFonbook : public fritz::LookupFonbook {
+public:
+	std::chrono::milliseconds delay;
+	mutable std::atomic<int> lookups;
+
+	FakeLookupFonbook(std::string techId = "OERT", std::chrono::milliseconds delay = std::chrono::milliseconds(100))
+	:LookupFonbook("Fake lookup", techId), delay(delay), lookups{0} {}
+
+	virtual sResolveResult lookup(std::string number) const {
+		lookups++;
+		std::this_thread::sleep_for(delay);
+		sResolveResult result(number);
+		result.name = "Name of " + number;
+		result.successful = true;
+		return result;
+	}
+
+	size_t cacheSize() const { return getFonbookList().size(); }
+};
+
+}
+
+#endif /* FAKELOOKUPFONBOOK_H_ */
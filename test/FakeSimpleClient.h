@@ -29,6 +29,12 @@ public:
 				</contact></phonebooks>";
 	}
 
+	virtual bool streamFonbook(const sink_t &sink) {
+		std::string xml = requestFonbook();
+		sink(xml.data(), xml.size());
+		return true;
+	}
+
 };
 
 class FakeSimpleClientFactory : public fritz::FritzClientFactory {
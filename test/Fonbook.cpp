@@ -10,6 +10,10 @@
 #include "gtest/gtest.h"
 #include "BasicInitFixture.h"
 
+#include "FakeLookupFonbook.h"
+
+#include <thread>
+#include <vector>
 #include <Fonbook.h>
 
 namespace test {
@@ -20,5 +24,31 @@ public:
 			:Fonbook("Test", "TEST") {};
 };
 
+
+class LookupFonbook : public BasicInitFixture {
+};
+
+TEST_F(LookupFonbook, ConcurrentLookups) {
+	// several dispatch workers miss the cache for the same numbers at the same time
+	FakeLookupFonbook fonbook("TEST", std::chrono::milliseconds(1));
+	std::vector<std::thread> threads;
+	std::atomic<int> wrong{0};
+	for (int thread = 0; thread < 8; thread++)
+		threads.push_back(std::thread([&fonbook, &wrong, thread]() {
+			for (int i = 0; i < 200; i++) {
+				std::string number = "0721" + std::to_string((i * 7 + thread) % 100);
+				fritz::Fonbook::sResolveResult result = i % 2 ? fonbook.resolveToName(number) : fonbook.resolveToNameLocally(number);
+				if ((i % 2 || result.successful) && result.name != "Name of " + number)
+					wrong++;
+			}
+		}));
+	for (std::thread &thread : threads)
+		thread.join();
+	EXPECT_EQ(0, wrong);
+	// each number is cached once, even if it was looked up by several threads
+	EXPECT_EQ(100U, fonbook.cacheSize());
+	EXPECT_LE(100, fonbook.lookups);
+}
+
 }
 
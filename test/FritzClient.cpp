@@ -7,8 +7,12 @@
 
 #include "gtest/gtest.h"
 #include "BasicInitFixture.h"
+#include "FakeBoxFixture.h"
 
+#include <atomic>
 #include <FritzClient.h>
+#include <HttpConnectionPool.h>
+#include <SessionManager.h>
 
 namespace test {
 
@@ -30,8 +34,118 @@ TEST_F(FritzClient, RequestIP) {
 	ASSERT_TRUE((ip.length() >= 7) && (ip.length() <= 15));
 }
 
+// the tests below run against a FakeHttpServer
+class FritzClientOnFakeBox : public FakeBoxFixture {
+protected:
+	int parallelCallListRequests(unsigned int maxBoxRequests) {
+		std::atomic<int> active{0}, peak{0};
+		handler = [&active, &peak](const sFakeRequest &request) {
+			int now = ++active;
+			int expected = peak;
+			while (now > expected && !peak.compare_exchange_weak(expected, now))
+				;
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			active--;
+			return FakeLuaBox(request);
+		};
+		setupBox();
+		fritz::Config::SetupMaxBoxRequests(maxBoxRequests);
+		std::vector<std::thread> threads;
+		std::atomic<int> callLists{0};
+		for (int i = 0; i < 3; i++)
+			threads.emplace_back([&callLists]() {
+				fritz::FritzClient fc;
+				if (fc.requestCallList().find("Typ;Datum;Name;") != std::string::npos)
+					callLists++;
+			});
+		for (auto &thread : threads)
+			thread.join();
+		fritz::HttpConnectionPool::Get().clear();
+		EXPECT_EQ(3, callLists);
+		return peak;
+	}
+};
+
+TEST_F(FritzClientOnFakeBox, ParallelRequests) {
+	// several clients exist at the same time and send their requests in parallel, within the limit
+	EXPECT_EQ(2, parallelCallListRequests(2));
+	EXPECT_EQ(1, parallelCallListRequests(1));
 }
 
+TEST_F(FritzClientOnFakeBox, StreamCallList) {
+	fritz::FritzClient fc;
+	std::string csv;
+	EXPECT_TRUE(fc.streamCallList([&csv](const char *data, size_t length) {
+		ASSERT_TRUE(data != nullptr);
+		csv.append(data, length);
+	}));
+	EXPECT_EQ(FakeHttpServer::Fixture("foncalls_csv"), csv);
+	EXPECT_EQ(csv, fc.requestCallList());
+}
+
+TEST_F(FritzClientOnFakeBox, CompressedDownloads) {
+	std::atomic<int> compressed{0};
+	handler = [&compressed](const sFakeRequest &request) {
+		sFakeResponse response = FakeLuaBox(request);
+		auto accept = request.headers.find("accept-encoding");
+		if (accept != request.headers.end() && accept->second.find("gzip") != std::string::npos) {
+			response.body = FakeHttpServer::Compress(response.body);
+			response.headers["Content-Encoding"] = "gzip";
+			compressed++;
+		}
+		return response;
+	};
+	{
+		fritz::FritzClient fc;
+		EXPECT_EQ(FakeHttpServer::Fixture("foncalls_csv"), fc.requestCallList());
+		EXPECT_EQ(0, compressed);
+	}
+	fritz::Config::SetupCompression(true);
+	fritz::FritzClient fc;
+	EXPECT_EQ(FakeHttpServer::Fixture("foncalls_csv"), fc.requestCallList());
+	EXPECT_LT(0, compressed);
+}
 
+TEST_F(FritzClientOnFakeBox, RejectedSession) {
+	std::atomic<int> sidChecks{0}, callLists{0};
+	handler = [&sidChecks, &callLists](const sFakeRequest &request) {
+		if (request.path == "/login_sid.lua" && request.target.find("sid=0123456789abcdef") != std::string::npos)
+			sidChecks++;
+		sFakeResponse response = FakeLuaBox(request);
+		// the box forgot the SID, and answers with its login page
+		if (request.path == "/fon_num/foncalls_list.lua" && callLists++ == 0)
+			response.body = "<html><title>FRITZ!Box</title></html>";
+		return response;
+	};
+	// with the default retry policy, a retry would wait for a minute
+	fritz::FritzClient fc;
+	EXPECT_EQ(FakeHttpServer::Fixture("foncalls_csv"), fc.requestCallList());
+	// the SID was checked again before the request was repeated
+	EXPECT_EQ(2, callLists);
+	EXPECT_EQ(1, sidChecks);
+	// the session manager stays usable by this client after it was replaced
+	fritz::SessionManager::DeleteSessionManager();
+	EXPECT_EQ(FakeHttpServer::Fixture("foncalls_csv"), fc.requestCallList());
+}
 
+TEST_F(FritzClientOnFakeBox, LuaPageWithoutMarker) {
+	std::atomic<int> callLists{0}, webcm{0};
+	handler = [&callLists, &webcm](const sFakeRequest &request) {
+		sFakeResponse response = FakeLuaBox(request);
+		// a firmware that never sends the expected page
+		if (request.path == "/fon_num/foncalls_list.lua") {
+			callLists++;
+			response.body = "<html><title>FRITZ!Box</title></html>";
+		}
+		if (request.path == "/cgi-bin/webcm")
+			webcm++;
+		return response;
+	};
+	fritz::FritzClient fc;
+	fc.requestCallList();
+	// one repetition with a new session, then the old interface is used
+	EXPECT_EQ(2, callLists);
+	EXPECT_LT(0, webcm);
+}
 
+}
@@ -9,8 +9,11 @@
 
 #include "gtest/gtest.h"
 #include "BasicInitFixture.h"
+#include "FakeBoxFixture.h"
 #include "FakeSimpleClient.h"
 
+#include <atomic>
+#include <sstream>
 #include <FritzFonbook.h>
 #include <FonbookManager.h>
 
@@ -57,6 +60,118 @@ TEST_F(FritzFonbook, ParseSimpleXMLFonbook) {
 	ASSERT_STREQ("004930254600000", fbe->getNumber(3).c_str());
 }
 
+TEST_F(FritzFonbook, UnchangedReload) {
+	std::vector <std::string> vFonbookID;
+	vFonbookID.push_back("FRITZ");
+	fritz::FonbookManager::CreateFonbookManager(vFonbookID, "FRITZ", false);
+	fritz::Fonbook *fb = fritz::FonbookManager::GetFonbookManager()->GetFonbook();
+	for (size_t i=0; i<100; i++) {
+		if (fb->isInitialized())
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+	ASSERT_TRUE(fb->isInitialized());
+	const fritz::FonbookEntry* fbe = fb->retrieveFonbookEntry(0);
+
+	// the second reload waits for the first one, the same data is not parsed again
+	fb->reload();
+	fb->reload();
+	EXPECT_TRUE(fb->isInitialized());
+	EXPECT_EQ(fbe, fb->retrieveFonbookEntry(0));
+	ASSERT_EQ(1, (int) fb->getFonbookSize());
+	// waits for the last reload
+	fritz::FonbookManager::DeleteFonbookManager();
+}
+
+class TimestampClient : public fritz::FritzClient {
+public:
+	static std::atomic<int> requests;
+	static std::atomic<int> timestamp;
+	virtual std::string requestFonbook() {
+		requests++;
+		std::stringstream xml;
+		xml << "<?xml version=\"1.0\" encoding=\"utf-8\"?><phonebooks><phonebook name=\"Telefonbuch\">"
+		    << "<timestamp>" << timestamp << "</timestamp><contact><category>0</category>"
+		    << "<person><realName>Version " << timestamp << "</realName></person>"
+		    << "<telephony><number type=\"home\" prio=\"1\">00493062810000</number></telephony>"
+		    << "</contact></phonebook></phonebooks>";
+		return xml.str();
+	}
+	virtual bool streamFonbook(const sink_t &sink) {
+		std::string xml = requestFonbook();
+		sink(xml.data(), xml.size());
+		return true;
+	}
+};
+
+std::atomic<int> TimestampClient::requests{0};
+std::atomic<int> TimestampClient::timestamp{0};
+
+class TimestampClientFactory : public fritz::FritzClientFactory {
+public:
+	virtual fritz::FritzClient *create() {
+		return new TimestampClient;
+	}
+};
+
+TEST_F(FritzFonbook, Polling) {
+	delete fritz::gConfig->fritzClientFactory;
+	fritz::gConfig->fritzClientFactory = new TimestampClientFactory();
+	TimestampClient::timestamp = 1000;
+	fritz::FonbookManager::CreateFonbookManager({"FRITZ"}, "FRITZ", false);
+	fritz::FritzFonbook *fb = dynamic_cast<fritz::FritzFonbook *>((*fritz::FonbookManager::GetFonbookManager()->getFonbooks())["FRITZ"]);
+	ASSERT_TRUE(fb != nullptr);
+	for (size_t i=0; i<100 && !fb->isInitialized(); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ASSERT_TRUE(fb->isInitialized());
+	EXPECT_EQ("Version 1000", fb->retrieveFonbookEntry(0)->getName());
+
+	// while nothing changes, the interval grows up to the maximum
+	TimestampClient::requests = 0;
+	fb->startPolling(std::chrono::milliseconds(20), std::chrono::milliseconds(80));
+	std::this_thread::sleep_for(std::chrono::milliseconds(400));
+	EXPECT_EQ(80, fb->getPollInterval().count());
+	EXPECT_GT(10, TimestampClient::requests);
+	EXPECT_LT(2, TimestampClient::requests);
+
+	// a change is detected within the maximum interval
+	TimestampClient::timestamp = 1001;
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	fb->stopPolling();
+	EXPECT_EQ("Version 1001", fb->retrieveFonbookEntry(0)->getName());
+	fritz::FonbookManager::DeleteFonbookManager();
+}
+
+// a FritzFonbook fetching its data from a FakeHttpServer
+class PolledFritzFonbook : public FakeBoxFixture {
+};
+
+TEST_F(PolledFritzFonbook, StopPollingCancelsRetry) {
+	// the box answers the first request, later ones fail and are retried a minute later
+	std::atomic<int> requests{0};
+	handler = [&requests](const sFakeRequest &request) {
+		sFakeResponse response = FakeLuaBox(request);
+		if (request.target.find("fonbuch") != std::string::npos && requests++ > 0)
+			response.status = 500;
+		return response;
+	};
+	fritz::FonbookManager::CreateFonbookManager({"FRITZ"}, "FRITZ", false);
+	fritz::FritzFonbook *fb = dynamic_cast<fritz::FritzFonbook *>((*fritz::FonbookManager::GetFonbookManager()->getFonbooks())["FRITZ"]);
+	ASSERT_TRUE(fb != nullptr);
+	for (size_t i=0; i<100 && !fb->isInitialized(); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ASSERT_TRUE(fb->isInitialized());
+	fb->startPolling(std::chrono::milliseconds(20), std::chrono::milliseconds(20));
+	for (size_t i=0; i<100 && requests < 2; i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	ASSERT_LE(2, requests);
+	auto start = std::chrono::steady_clock::now();
+	fb->stopPolling();
+	EXPECT_GT(std::chrono::seconds(1), std::chrono::steady_clock::now() - start);
+	// the failed request did not drop the entries
+	EXPECT_TRUE(fb->isInitialized());
+	fritz::FonbookManager::DeleteFonbookManager();
+}
 
 }
 
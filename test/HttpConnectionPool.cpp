@@ -0,0 +1,156 @@
+/*
+ * HttpConnectionPool.cpp
+ */
+
+#include "gtest/gtest.h"
+#include "FakeBoxFixture.h"
+
+#include <Config.h>
+#include <FritzClient.h>
+#include <HttpConnection.h>
+#include <HttpConnectionPool.h>
+
+namespace test {
+
+class HttpConnectionPool : public FakeBoxFixture {
+};
+
+static sFakeResponse Echo(const sFakeRequest &request) {
+	sFakeResponse response;
+	if (request.path == "/missing")
+		response.status = 404;
+	if (request.path == "/close")
+		response.close = true;
+	response.body = request.method + " " + request.target + (request.body.size() ? " " + request.body : "");
+	return response;
+}
+
+TEST_F(HttpConnectionPool, ReuseConnection) {
+	handler = Echo;
+	fritz::sHttpPoolMetrics before = fritz::HttpConnectionPool::Get().getMetrics();
+	fritz::PooledHttpClient client("127.0.0.1", server.port);
+	EXPECT_EQ("GET /a?sid=1&x=", client.get("/a", {{"x", ""}, {"sid", "1"}}));
+	EXPECT_EQ("POST /b sid=1&y=2", client.post("/b", {{"sid", "1"}, {"y", "2"}}));
+	EXPECT_THROW(client.get("/missing"), std::runtime_error);
+	std::string mime = client.postMIME("/c", {{"PhonebookId", "0"}});
+	EXPECT_NE(std::string::npos, mime.find("Content-Disposition: form-data; name=\"PhonebookId\"\r\n\r\n0\r\n"));
+	EXPECT_EQ(1, server.connections);
+	EXPECT_EQ(4, server.requests);
+	fritz::sHttpPoolMetrics after = fritz::HttpConnectionPool::Get().getMetrics();
+	EXPECT_EQ(1U, after.created - before.created);
+	EXPECT_EQ(3U, after.reused - before.reused);
+	EXPECT_EQ(1U, after.idle);
+}
+
+TEST_F(HttpConnectionPool, ServerClosesConnection) {
+	handler = Echo;
+	fritz::sHttpPoolMetrics before = fritz::HttpConnectionPool::Get().getMetrics();
+	fritz::PooledHttpClient client("127.0.0.1", server.port);
+	// a response with "Connection: close" is not pooled
+	EXPECT_EQ("GET /close", client.get("/close"));
+	EXPECT_EQ(0U, fritz::HttpConnectionPool::Get().getMetrics().idle);
+	EXPECT_EQ("GET /a", client.get("/a"));
+	EXPECT_EQ(2, server.connections);
+	// an idle connection closed by the server is evicted by the health check
+	server.closeConnections();
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	EXPECT_EQ("GET /b", client.get("/b"));
+	EXPECT_EQ(3, server.connections);
+	EXPECT_EQ(1U, fritz::HttpConnectionPool::Get().getMetrics().evicted - before.evicted);
+}
+
+TEST_F(HttpConnectionPool, NoResendOfPost) {
+	// the server processes a request, but closes the connection before answering
+	std::atomic<int> posts{0}, gets{0};
+	handler = [&posts, &gets](const sFakeRequest &request) {
+		sFakeResponse response = Echo(request);
+		if (request.path == "/dial")
+			response.drop = posts++ == 0;
+		if (request.path == "/list")
+			response.drop = gets++ == 0;
+		return response;
+	};
+	fritz::HttpConnection connection("127.0.0.1", server.port);
+	fritz::sHttpResponseHead head;
+	std::string body;
+	auto sink = [&body](const char *data, size_t length) { body.append(data, length); };
+	connection.request("GET", "/a", {}, "", head, sink);
+	// a GET on the reused connection is repeated on a new one
+	body.clear();
+	connection.request("GET", "/list", {}, "", head, sink);
+	EXPECT_EQ("GET /list", body);
+	EXPECT_EQ(2, gets);
+	// a POST is not, the box may have dialed already
+	EXPECT_THROW(connection.request("POST", "/dial", {}, "number=0721", head, sink), std::runtime_error);
+	EXPECT_EQ(1, posts);
+}
+
+TEST_F(HttpConnectionPool, ConcurrencyLimit) {
+	std::atomic<int> active{0}, peak{0};
+	handler = [&active, &peak](const sFakeRequest &request) {
+		int now = ++active;
+		int expected = peak;
+		while (now > expected && !peak.compare_exchange_weak(expected, now))
+			;
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		active--;
+		return Echo(request);
+	};
+	std::vector<std::thread> threads;
+	for (int i = 0; i < 4; i++)
+		threads.emplace_back([this]() {
+			fritz::PooledHttpClient client("127.0.0.1", server.port, 2);
+			client.get("/a");
+		});
+	for (auto &thread : threads)
+		thread.join();
+	EXPECT_EQ(2, peak);
+	EXPECT_EQ(4, server.requests);
+}
+
+TEST_F(HttpConnectionPool, CallListRefreshOnWarmPool) {
+	std::string csv;
+	{
+		fritz::FritzClient fc;
+		csv = fc.requestCallList();
+	}
+	EXPECT_NE(std::string::npos, csv.find("Typ;Datum;Name;"));
+	int connections = server.connections;
+	EXPECT_EQ(1, connections);
+	{
+		fritz::FritzClient fc;
+		csv = fc.requestCallList();
+	}
+	EXPECT_NE(std::string::npos, csv.find("Typ;Datum;Name;"));
+	EXPECT_EQ(connections, server.connections);
+}
+
+TEST_F(HttpConnectionPool, StreamedBody) {
+	std::string large(1 << 20, 'x');
+	for (size_t pos = 0; pos < large.size(); pos += 1000)
+		large[pos] = '\n';
+	handler = [&large](const sFakeRequest &request) {
+		sFakeResponse response;
+		if (request.path == "/missing")
+			response.status = 404;
+		response.body = large;
+		return response;
+	};
+	fritz::PooledHttpClient client("127.0.0.1", server.port);
+	std::string received;
+	size_t pieces = 0;
+	client.getStream("/large", {}, [&received, &pieces](const char *data, size_t length) {
+		received.append(data, length);
+		pieces++;
+	});
+	EXPECT_EQ(large, received);
+	EXPECT_LT(1U, pieces);
+	// the body of an error is not passed on
+	received.clear();
+	EXPECT_THROW(client.getStream("/missing", {}, [&received](const char *data, size_t length) {
+		received.append(data, length);
+	}), std::runtime_error);
+	EXPECT_EQ("", received);
+}
+
+}
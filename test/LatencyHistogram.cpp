@@ -0,0 +1,65 @@
+/*
+ * LatencyHistogram.cpp
+ */
+
+#include "gtest/gtest.h"
+#include "FakeCallMonitor.h"
+
+#include <LatencyHistogram.h>
+#include <MonitorEngine.h>
+
+namespace test {
+
+TEST(LatencyHistogram, Percentiles) {
+	fritz::LatencyHistogram histogram;
+	for (uint64_t value = 1; value <= 100; value++)
+		histogram.record(value);
+	histogram.record(0);
+	fritz::sHistogramSnapshot s = histogram.snapshot();
+	EXPECT_EQ(101U, s.count);
+	EXPECT_EQ(5050U, s.sum);
+	EXPECT_EQ(100U, s.max);
+	EXPECT_EQ(1U, s.buckets[0]);
+	EXPECT_EQ(1U, s.buckets[1]);
+	EXPECT_EQ(2U, s.buckets[2]);
+	// the median 50 is in [32, 64)
+	EXPECT_EQ(63U, s.percentile(0.5));
+	// upper bounds beyond the maximum are capped
+	EXPECT_EQ(100U, s.percentile(0.99));
+	EXPECT_EQ(100U, s.percentile(1.0));
+	histogram.reset();
+	EXPECT_EQ(0U, histogram.snapshot().count);
+	EXPECT_EQ(0U, histogram.snapshot().percentile(0.5));
+}
+
+class NullSink : public fritz::MonitorSink {
+public:
+	void handleMonitorEvent(size_t box __attribute__((unused)), fritz::MonitorEvent &event) override {
+		EXPECT_NE(0U, event.receiveTime);
+	}
+};
+
+TEST(LatencyHistogram, PipelineStages) {
+	fritz::PipelineLatency &latency = fritz::PipelineLatency::Get();
+	latency.reset();
+	latency.recordFonbook("LOCL", 10);
+	FakeCallMonitor box({
+		"19.12.10 14:23:05;RING;0;0721123;111;SIP0;\r\n",
+		"19.12.10 14:23:07;CONNECT;0;4;0721123;\r\n",
+	}, 1, 300);
+	NullSink sink;
+	{
+		fritz::MonitorEngine engine;
+		engine.addBox("127.0.0.1", box.port, &sink);
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	}
+	fritz::PipelineLatency::snapshot_t snapshot = latency.snapshot();
+	EXPECT_EQ(2U, snapshot["decode"].count);
+	EXPECT_LE(1U, snapshot["socketRead"].count);
+	EXPECT_EQ(2U, snapshot["boxToLibrary"].count);
+	EXPECT_EQ(1U, snapshot["resolve:LOCL"].count);
+	EXPECT_EQ(0U, snapshot["handler"].count);
+	EXPECT_EQ(snapshot.end(), snapshot.find("resolve:OERT"));
+}
+
+}
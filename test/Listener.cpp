@@ -7,8 +7,17 @@
 
 #include "gtest/gtest.h"
 #include "BasicInitFixture.h"
+#include "FakeCallMonitor.h"
+#include "FakeLookupFonbook.h"
 
 #include <libfritz++/Listener.h>
+#include <libfritz++/FonbookManager.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 
 namespace test {
 
@@ -30,6 +39,308 @@ class MyEventHandler : public fritz::EventHandler {
 
 };
 
+class RecordingEventHandler : public fritz::EventHandler {
+public:
+	std::mutex mutex;
+	std::map<int, std::vector<std::string>> events;
+	std::vector<int> disconnects;
+	virtual void handleCall(bool, int connId, std::string, std::string, fritz::FonbookEntry::eType, std::string, std::string, std::string)  {
+		record(connId, "CALL");
+	}
+	virtual void handleConnect(int connId) {
+		record(connId, "CONNECT");
+	}
+	virtual void handleDisconnect(int connId, std::string) {
+		record(connId, "DISCONNECT");
+		std::lock_guard<std::mutex> lock(mutex);
+		disconnects.push_back(connId);
+	}
+	void record(int connId, std::string what) {
+		// the Listener never calls a handler concurrently
+		EXPECT_TRUE(mutex.try_lock());
+		events[connId].push_back(what);
+		mutex.unlock();
+	}
+};
+
+// a reverse lookup service that is slow for one number only
+class SelectiveLookupFonbook : public FakeLookupFonbook {
+public:
+	SelectiveLookupFonbook() : FakeLookupFonbook("OERT", std::chrono::milliseconds(500)) {}
+	virtual sResolveResult lookup(std::string number) const {
+		if (number == "0721123")
+			return FakeLookupFonbook::lookup(number);
+		sResolveResult result(number);
+		return result;
+	}
+};
+
+// replaces the online lookup of the FonbookManager
+static void SetupLookup(FakeLookupFonbook *lookup) {
+	fritz::FonbookManager::CreateFonbookManager({"OERT"}, "", false);
+	fritz::Fonbooks *fonbooks = fritz::FonbookManager::GetFonbookManager()->getFonbooks();
+	for (fritz::Fonbook *&fonbook : *fonbooks)
+		if (fonbook->getTechId() == "OERT") {
+			delete fonbook;
+			fonbook = lookup;
+		}
+}
+
+TEST_F(Listener, DispatchDoesNotBlockOnSlowLookup) {
+	FakeCallMonitor monitor({
+		"19.12.10 14:23:05;RING;0;0721123;111;SIP0;\r\n",
+		"19.12.10 14:23:06;RING;4;0721456;111;SIP0;\r\n",
+		"19.12.10 14:23:07;CONNECT;4;4;0721456;\r\n",
+		"19.12.10 14:23:08;DISCONNECT;4;1;\r\n",
+		"19.12.10 14:23:09;CONNECT;0;4;0721123;\r\n",
+		"19.12.10 14:23:10;DISCONNECT;0;1;\r\n",
+	});
+	fritz::Config::Setup("127.0.0.1", "", "", true);
+	fritz::Config::SetupPorts(monitor.port, 8080, 47000);
+	SetupLookup(new SelectiveLookupFonbook);
+
+	RecordingEventHandler e;
+	fritz::Listener::CreateListener(&e);
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+	fritz::Listener::DeleteListener();
+	fritz::FonbookManager::DeleteFonbookManager();
+
+	std::vector<std::string> expected = { "CALL", "CONNECT", "DISCONNECT" };
+	EXPECT_EQ(expected, e.events[0]);
+	EXPECT_EQ(expected, e.events[4]);
+	// connection 4 shares the worker of connection 0, but is not delayed by its lookup
+	std::vector<int> disconnects = { 4, 0 };
+	EXPECT_EQ(disconnects, e.disconnects);
+}
+
+class RecordingResolvingEventHandler : public fritz::ResolvingEventHandler {
+public:
+	std::mutex mutex;
+	std::vector<std::string> events;
+	virtual void handleCall(bool, int, std::string remoteNumber, std::string remoteName, fritz::FonbookEntry::eType, std::string, std::string, std::string)  {
+		record("CALL " + remoteNumber + " " + remoteName);
+	}
+	virtual void handleCallResolved(int, std::string remoteName, fritz::FonbookEntry::eType) {
+		record("RESOLVED " + remoteName);
+	}
+	virtual void handleConnect(int) {
+		record("CONNECT");
+	}
+	void record(std::string what) {
+		std::lock_guard<std::mutex> lock(mutex);
+		events.push_back(what);
+	}
+	virtual void handleDisconnect(int, std::string) {}
+};
+
+TEST_F(Listener, ResolvingEventHandlerWithoutName) {
+	FakeCallMonitor monitor({
+		"19.12.10 14:23:05;RING;0;0721123;111;SIP0;\r\n",
+		"19.12.10 14:23:07;CONNECT;0;4;0721123;\r\n",
+	});
+	fritz::Config::Setup("127.0.0.1", "", "", true);
+	fritz::Config::SetupPorts(monitor.port, 8080, 47000);
+	fritz::FonbookManager::CreateFonbookManager({}, "", false);
+
+	RecordingResolvingEventHandler e;
+	fritz::Listener::CreateListener(&e);
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+	fritz::Listener::DeleteListener();
+	fritz::FonbookManager::DeleteFonbookManager();
+
+	// no phonebook knows the number, so there is no second notification
+	std::vector<std::string> expected = { "CALL 0721123 0721123", "CONNECT" };
+	EXPECT_EQ(expected, e.events);
+}
+
+TEST_F(Listener, ResolvingEventHandlerWithLateName) {
+	FakeCallMonitor monitor({
+		"19.12.10 14:23:05;RING;0;0721123;111;SIP0;\r\n",
+		"19.12.10 14:23:07;RING;1;0721456;111;SIP0;\r\n",
+	});
+	fritz::Config::Setup("127.0.0.1", "", "", true);
+	fritz::Config::SetupPorts(monitor.port, 8080, 47000);
+	// replace the online lookup by a slow fake
+	SetupLookup(new FakeLookupFonbook("OERT", std::chrono::milliseconds(300)));
+
+	RecordingResolvingEventHandler e;
+	fritz::Listener::CreateListener(&e);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	{
+		// the calls are notified without waiting for the lookup
+		std::lock_guard<std::mutex> lock(e.mutex);
+		std::vector<std::string> expected = { "CALL 0721123 0721123", "CALL 0721456 0721456" };
+		std::sort(e.events.begin(), e.events.end());
+		EXPECT_EQ(expected, e.events);
+	}
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+	fritz::Listener::DeleteListener();
+	fritz::FonbookManager::DeleteFonbookManager();
+
+	std::sort(e.events.begin(), e.events.end());
+	std::vector<std::string> expected = { "CALL 0721123 0721123", "CALL 0721456 0721456",
+	                                      "RESOLVED Name of 0721123", "RESOLVED Name of 0721456" };
+	EXPECT_EQ(expected, e.events);
+}
+
+class CallEventHandler : public fritz::ResolvingEventHandler {
+public:
+	std::vector<fritz::CallEventPtr> events;
+	virtual void handleEvent(const fritz::CallEventPtr &event) {
+		events.push_back(event);
+	}
+};
+
+TEST_F(Listener, CallEvents) {
+	FakeCallMonitor monitor({
+		"19.12.10 14:23:05;CALL;0;4;111;0721123#;SIP1;\r\n",
+		"19.12.10 14:23:07;CONNECT;0;4;0721123;\r\n",
+		"19.12.10 14:23:10;DISCONNECT;0;61;\r\n",
+	});
+	fritz::Config::Setup("127.0.0.1", "", "", true);
+	fritz::Config::SetupPorts(monitor.port, 8080, 47000);
+	fritz::FonbookManager::CreateFonbookManager({}, "", false);
+
+	CallEventHandler e;
+	fritz::Listener::CreateListener(&e);
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+	fritz::Listener::DeleteListener();
+	fritz::FonbookManager::DeleteFonbookManager();
+
+	ASSERT_EQ(3U, e.events.size());
+	EXPECT_EQ(fritz::CallEvent::CALL, e.events[0]->type);
+	EXPECT_TRUE(e.events[0]->outgoing);
+	EXPECT_EQ("0721123", e.events[0]->remoteNumber);
+	EXPECT_EQ("111", e.events[0]->localParty);
+	EXPECT_EQ("SIP1", e.events[0]->medium);
+	EXPECT_EQ(fritz::CallEvent::CONNECT, e.events[1]->type);
+	EXPECT_EQ(fritz::CallEvent::DISCONNECT, e.events[2]->type);
+	EXPECT_EQ("61", e.events[2]->duration);
+	EXPECT_EQ(1L, e.events[0].use_count());
+}
+
+TEST_F(Listener, SeveralBoxes) {
+	// both boxes use connection id 0 for their calls
+	FakeCallMonitor first({
+		"19.12.10 14:23:05;RING;0;0721123;111;SIP0;\r\n",
+		"19.12.10 14:23:07;CONNECT;0;4;0721123;\r\n",
+		"19.12.10 14:23:10;DISCONNECT;0;61;\r\n",
+	});
+	FakeCallMonitor second({
+		"19.12.10 14:23:06;RING;0;0721456;222;SIP1;\r\n",
+		"19.12.10 14:23:11;DISCONNECT;0;0;\r\n",
+	});
+	fritz::Config::Setup("127.0.0.1", "", "", true);
+	fritz::Config::SetupPorts(first.port, 8080, 47000);
+	fritz::FonbookManager::CreateFonbookManager({}, "", false);
+
+	size_t box = 0;
+	CallEventHandler e;
+	EXPECT_FALSE(fritz::Listener::AddBox("127.0.0.1", second.port, box));
+	fritz::Listener::CreateListener(&e);
+	ASSERT_TRUE(fritz::Listener::AddBox("127.0.0.1", second.port, box));
+	EXPECT_EQ(1U, box);
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+	fritz::sMonitorMetrics metrics;
+	ASSERT_TRUE(fritz::Listener::GetMonitorMetrics(1, metrics));
+	EXPECT_EQ(1U, metrics.connects);
+	EXPECT_FALSE(fritz::Listener::GetMonitorMetrics(2, metrics));
+	fritz::Listener::DeleteListener();
+	fritz::FonbookManager::DeleteFonbookManager();
+
+	std::vector<std::string> events[2];
+	for (auto &event : e.events) {
+		ASSERT_GT(2U, event->box);
+		std::string what = std::to_string(event->type);
+		if (event->type == fritz::CallEvent::CALL)
+			what += " " + event->remoteNumber + " " + event->localParty;
+		events[event->box].push_back(what);
+	}
+	std::vector<std::string> expected = { "0 0721123 111", "2", "3" };
+	EXPECT_EQ(expected, events[0]);
+	expected = { "0 0721456 222", "3" };
+	EXPECT_EQ(expected, events[1]);
+}
+
+class SlowEventHandler : public fritz::EventHandler {
+public:
+	virtual void handleEvent(const fritz::CallEventPtr &) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(400));
+	}
+};
+
+TEST_F(Listener, SlowSubscriberDoesNotDelayOthers) {
+	FakeCallMonitor monitor({
+		"19.12.10 14:23:05;RING;0;0721123;111;SIP0;\r\n",
+		"19.12.10 14:23:07;CONNECT;0;4;0721123;\r\n",
+		"19.12.10 14:23:10;DISCONNECT;0;61;\r\n",
+	});
+	fritz::Config::Setup("127.0.0.1", "", "", true);
+	fritz::Config::SetupPorts(monitor.port, 8080, 47000);
+	fritz::FonbookManager::CreateFonbookManager({}, "", false);
+
+	SlowEventHandler slow;
+	CallEventHandler fast;
+	size_t slowId = fritz::Listener::Subscribe(&slow, fritz::Subscription::BLOCK, 8);
+	size_t fastId = fritz::Listener::Subscribe(&fast, fritz::Subscription::DROP_OLDEST, 8);
+	MyEventHandler e;
+	fritz::Listener::CreateListener(&e);
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	fritz::sSubscriptionMetrics slowMetrics, fastMetrics;
+	EXPECT_TRUE(fritz::Listener::GetSubscriptionMetrics(slowId, slowMetrics));
+	EXPECT_TRUE(fritz::Listener::GetSubscriptionMetrics(fastId, fastMetrics));
+	fritz::Listener::DeleteListener();
+	fritz::Listener::Unsubscribe(slowId);
+	fritz::Listener::Unsubscribe(fastId);
+	fritz::FonbookManager::DeleteFonbookManager();
+
+	EXPECT_EQ(3U, fastMetrics.delivered);
+	EXPECT_EQ(0U, slowMetrics.delivered);
+	EXPECT_EQ(2U, slowMetrics.depth);
+	EXPECT_FALSE(fritz::Listener::GetSubscriptionMetrics(slowId, slowMetrics));
+	EXPECT_EQ(3U, fast.events.size());
+}
+
+class BlockedEventHandler : public fritz::EventHandler {
+public:
+	std::mutex mutex;
+	std::condition_variable released;
+	bool blocked = true;
+	std::atomic<int> calls{0};
+	virtual void handleCall(bool, int, std::string, std::string, fritz::FonbookEntry::eType, std::string, std::string, std::string)  {
+		calls++;
+		std::unique_lock<std::mutex> lock(mutex);
+		released.wait(lock, [this]() { return !blocked; });
+	}
+	void release() {
+		std::lock_guard<std::mutex> lock(mutex);
+		blocked = false;
+		released.notify_all();
+	}
+};
+
+TEST_F(Listener, FullQueueDropsEvents) {
+	std::vector<std::string> lines(1000, "19.12.10 14:23:05;RING;0;0721123;111;SIP0;\r\n");
+	FakeCallMonitor monitor(lines);
+	fritz::Config::Setup("127.0.0.1", "", "", true);
+	fritz::Config::SetupPorts(monitor.port, 8080, 47000);
+	fritz::FonbookManager::CreateFonbookManager({}, "", false);
+
+	BlockedEventHandler e;
+	fritz::Listener::CreateListener(&e);
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	// the worker of connection 0 is stuck in the handler, the engine reads on
+	fritz::sMonitorMetrics metrics;
+	ASSERT_TRUE(fritz::Listener::GetMonitorMetrics(metrics));
+	EXPECT_LT(0U, metrics.droppedEvents);
+	e.release();
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	ASSERT_TRUE(fritz::Listener::GetMonitorMetrics(metrics));
+	fritz::Listener::DeleteListener();
+	fritz::FonbookManager::DeleteFonbookManager();
+	EXPECT_EQ(1000, e.calls + (int) metrics.droppedEvents);
+}
+
 TEST_F(Listener, CreateAndDeleteListenerWithConnect) {
     fritz::Config::Setup("www.joachim-wilke.de", "", "", true);
 	fritz::Config::SetupPorts(80, 8080, 47000);
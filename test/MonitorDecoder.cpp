@@ -0,0 +1,54 @@
+/*
+ * MonitorDecoder.cpp
+ */
+
+#include "gtest/gtest.h"
+
+#include <MonitorDecoder.h>
+
+namespace test {
+
+TEST(MonitorDecoder, Ring) {
+	fritz::MonitorEvent event;
+	ASSERT_TRUE(fritz::MonitorDecoder::Decode("19.12.10 14:23:05;RING;2;07216080;111;SIP0;\r\n", event));
+	EXPECT_EQ(fritz::MonitorEvent::RING, event.type);
+	EXPECT_EQ(2, event.connId);
+	EXPECT_EQ("07216080", event.partA);
+	EXPECT_EQ("111", event.partB);
+	EXPECT_EQ("SIP0", event.partC);
+	EXPECT_EQ("", event.partD);
+
+	tm t = {};
+	t.tm_mday = 19; t.tm_mon = 11; t.tm_year = 110;
+	t.tm_hour = 14; t.tm_min = 23; t.tm_sec = 5; t.tm_isdst = -1;
+	EXPECT_EQ(mktime(&t), event.boxTime);
+}
+
+TEST(MonitorDecoder, CallConnectDisconnect) {
+	fritz::MonitorEvent event;
+	ASSERT_TRUE(fritz::MonitorDecoder::Decode("19.12.10 14:23:05;CALL;13;4;111;0304711#;SIP1;", event));
+	EXPECT_EQ(fritz::MonitorEvent::CALL, event.type);
+	EXPECT_EQ(13, event.connId);
+	EXPECT_EQ("0304711#", event.partC);
+	EXPECT_EQ("SIP1", event.partD);
+
+	ASSERT_TRUE(fritz::MonitorDecoder::Decode("19.12.10 14:23:09;CONNECT;13;4;0304711;", event));
+	EXPECT_EQ(fritz::MonitorEvent::CONNECT, event.type);
+	EXPECT_EQ("0304711", event.partB);
+	EXPECT_EQ("", event.partC);
+	EXPECT_EQ("", event.partD);
+
+	ASSERT_TRUE(fritz::MonitorDecoder::Decode("19.12.10 14:25:00;DISCONNECT;13;111;", event));
+	EXPECT_EQ(fritz::MonitorEvent::DISCONNECT, event.type);
+	EXPECT_EQ("111", event.partA);
+}
+
+TEST(MonitorDecoder, Unknown) {
+	fritz::MonitorEvent event;
+	EXPECT_FALSE(fritz::MonitorDecoder::Decode("19.12.10 14:23:05;CALLS;1;", event));
+	EXPECT_FALSE(fritz::MonitorDecoder::Decode("19.12.10 14:23:05;RINF;1;", event));
+	EXPECT_FALSE(fritz::MonitorDecoder::Decode("", event));
+	EXPECT_EQ(0, fritz::MonitorDecoder::ParseTime("19.12.10", 8));
+}
+
+}
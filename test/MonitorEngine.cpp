@@ -0,0 +1,133 @@
+/*
+ * MonitorEngine.cpp
+ */
+
+#include "gtest/gtest.h"
+#include "FakeCallMonitor.h"
+
+#include <map>
+#include <mutex>
+#include <MonitorEngine.h>
+
+namespace test {
+
+class RecordingSink : public fritz::MonitorSink {
+public:
+	std::mutex mutex;
+	std::map<size_t, std::vector<std::string>> events;
+	std::map<size_t, int> connects;
+	void handleMonitorEvent(size_t box, fritz::MonitorEvent &event) override {
+		std::lock_guard<std::mutex> lock(mutex);
+		events[box].push_back(event.partA);
+	}
+	void handleMonitorConnected(size_t box) override {
+		std::lock_guard<std::mutex> lock(mutex);
+		connects[box]++;
+	}
+};
+
+TEST(MonitorEngine, MultipleBoxes) {
+	FakeCallMonitor box1({
+		"19.12.10 14:23:05;RING;0;0721123;111;SIP0;\r\n",
+		// a line split over two packets
+		"19.12.10 14:23:07;CONN",
+		"ECT;0;4;0721123;\r\n",
+	}, 1, 500);
+	FakeCallMonitor box2({
+		"19.12.10 14:23:06;RING;0;0721456;111;SIP0;\r\n",
+	}, 1, 500);
+	RecordingSink sink;
+	{
+		fritz::MonitorEngine engine;
+		size_t id1 = engine.addBox("127.0.0.1", box1.port, &sink);
+		size_t id2 = engine.addBox("127.0.0.1", box2.port, &sink);
+		EXPECT_NE(id1, id2);
+		std::this_thread::sleep_for(std::chrono::milliseconds(300));
+		std::lock_guard<std::mutex> lock(sink.mutex);
+		EXPECT_EQ(std::vector<std::string>({ "0721123", "4" }), sink.events[id1]);
+		EXPECT_EQ(std::vector<std::string>({ "0721456" }), sink.events[id2]);
+	}
+}
+
+TEST(MonitorEngine, Reconnect) {
+	FakeCallMonitor box({
+		"19.12.10 14:23:05;RING;0;0721123;111;SIP0;\r\n",
+	}, 2, 0);
+	RecordingSink sink;
+	fritz::MonitorEngine engine(1, 1);
+	size_t id = engine.addBox("127.0.0.1", box.port, &sink);
+	for (int i = 0; i < 30; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		std::lock_guard<std::mutex> lock(sink.mutex);
+		if (sink.connects[id] == 2 && sink.events[id].size() == 2)
+			break;
+	}
+	std::lock_guard<std::mutex> lock(sink.mutex);
+	EXPECT_EQ(2, sink.connects[id]);
+	EXPECT_EQ(2, (int) sink.events[id].size());
+	fritz::sMonitorMetrics metrics;
+	ASSERT_TRUE(engine.getMetrics(id, metrics));
+	EXPECT_EQ(2, (int) metrics.connects);
+	EXPECT_EQ(1, (int) metrics.reconnects);
+	EXPECT_EQ(0, (int) metrics.deadConnections);
+}
+
+TEST(MonitorEngine, IdleWatchdog) {
+	FakeCallMonitor box({
+		"19.12.10 14:23:05;RING;0;0721123;111;SIP0;\r\n",
+	}, 2, 2500);
+	RecordingSink sink;
+	fritz::sMonitorTimeouts timeouts;
+	timeouts.idleTimeout = 1;
+	fritz::MonitorEngine engine(60, 3600, timeouts);
+	size_t id = engine.addBox("127.0.0.1", box.port, &sink);
+	std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+	// the watchdog re-established the silent connection without waiting for the retry delay
+	fritz::sMonitorMetrics metrics;
+	ASSERT_TRUE(engine.getMetrics(id, metrics));
+	EXPECT_LE(1, (int) metrics.deadConnections);
+	EXPECT_LE(1, (int) metrics.reconnects);
+	EXPECT_LE(1000, (int) metrics.maxDetectionLatency);
+	EXPECT_GT(1500, (int) metrics.maxReconnectLatency);
+	EXPECT_EQ(metrics.connects, engine.getMetrics().connects);
+	EXPECT_FALSE(engine.getMetrics(id + 1, metrics));
+}
+
+TEST(MonitorEngine, StopImmediately) {
+	RecordingSink sink;
+	auto start = std::chrono::steady_clock::now();
+	{
+		// nobody listens on this port, so the engine waits for a retry
+		fritz::MonitorEngine engine;
+		size_t id = engine.addBox("127.0.0.1", 1, &sink);
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		engine.removeBox(id);
+	}
+	EXPECT_GT(500, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+	EXPECT_EQ(0, sink.connects[0]);
+}
+
+
+TEST(MonitorEngine, UnresolvableHost) {
+	FakeCallMonitor box({
+		"19.12.10 14:23:05;RING;0;0721123;111;SIP0;\r\n",
+	}, 1, 500);
+	RecordingSink sink;
+	auto start = std::chrono::steady_clock::now();
+	{
+		fritz::MonitorEngine engine;
+		// names are resolved outside the thread of the engine, the other box is not delayed
+		size_t unknown = engine.addBox("fritz.box.invalid", 1012, &sink);
+		size_t id = engine.addBox("127.0.0.1", box.port, &sink);
+		std::this_thread::sleep_for(std::chrono::milliseconds(300));
+		std::lock_guard<std::mutex> lock(sink.mutex);
+		EXPECT_EQ(std::vector<std::string>({ "0721123" }), sink.events[id]);
+		EXPECT_EQ(0, sink.connects[unknown]);
+		fritz::sMonitorMetrics metrics;
+		ASSERT_TRUE(engine.getMetrics(unknown, metrics));
+		EXPECT_EQ(1, (int) metrics.connectFailures);
+	}
+	EXPECT_GT(1000, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+}
@@ -0,0 +1,76 @@
+/*
+ * MonitorRecorder.cpp
+ */
+
+#include "gtest/gtest.h"
+#include "FakeCallMonitor.h"
+#include "ReplayServer.h"
+
+#include <atomic>
+#include <cstdio>
+#include <MonitorRecorder.h>
+
+namespace test {
+
+class CountingSink : public fritz::MonitorSink {
+public:
+	std::atomic<int> events{0};
+	void handleMonitorEvent(size_t, fritz::MonitorEvent &) override {
+		events++;
+	}
+};
+
+TEST(MonitorRecorder, RecordAndReplay) {
+	char fileName[] = "/tmp/libfritzrecXXXXXX";
+	close(mkstemp(fileName));
+	{
+		FakeCallMonitor box({
+			"19.12.10 14:23:05;RING;0;0721123;111;SIP0;\r\n",
+			"19.12.10 14:23:07;CONNECT;0;4;0721123;\r\n",
+		}, 1, 300);
+		fritz::MonitorRecorder recorder(fileName);
+		ASSERT_TRUE(recorder.isOpen());
+		fritz::MonitorEngine engine;
+		engine.addBox("127.0.0.1", box.port, &recorder);
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		EXPECT_EQ(2, (int) recorder.getLines());
+	}
+
+	std::vector<fritz::sRecordedLine> recording;
+	ASSERT_TRUE(fritz::MonitorRecorder::Load(fileName, recording));
+	unlink(fileName);
+	ASSERT_EQ(2, (int) recording.size());
+	EXPECT_EQ("19.12.10 14:23:05;RING;0;0721123;111;SIP0;\r\n", recording[0].line);
+	EXPECT_EQ("19.12.10 14:23:07;CONNECT;0;4;0721123;\r\n", recording[1].line);
+	EXPECT_EQ(0, (int) recording[1].box);
+	EXPECT_LE(recording[0].offset, recording[1].offset);
+
+	ReplayServer server;
+	server.start(recording, 10);
+	CountingSink sink;
+	{
+		fritz::MonitorEngine engine;
+		engine.addBox("127.0.0.1", server.port, &sink);
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	}
+	server.wait();
+	EXPECT_EQ(2, sink.events);
+}
+
+TEST(MonitorRecorder, Burst) {
+	std::vector<fritz::sRecordedLine> burst = ReplayServer::Burst(100);
+	ASSERT_EQ(300, (int) burst.size());
+	ReplayServer server;
+	server.start(burst, 0);
+	CountingSink sink;
+	{
+		fritz::MonitorEngine engine;
+		engine.addBox("127.0.0.1", server.port, &sink);
+		for (int i = 0; i < 50 && sink.events < 300; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	server.wait();
+	EXPECT_EQ(300, sink.events);
+}
+
+}
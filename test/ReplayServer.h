@@ -0,0 +1,116 @@
+/*
+ * ReplayServer.h
+ */
+
+#ifndef REPLAYSERVER_H_
+#define REPLAYSERVER_H_
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <MonitorRecorder.h>
+
+namespace test {
+
+/**
+ * Local stand-in for the call monitor of a Fritz!Box.
+ * Replays a recording made by fritz::MonitorRecorder to the first client, at the original
+ * speed or faster, and remembers when each line was sent.
+ */
+class ReplayServer {
+private:
+	int serverFd;
+	std::thread *thread;
+	std::vector<fritz::sRecordedLine> recording;
+	double speed;
+	void run() {
+		int fd = accept(serverFd, nullptr, nullptr);
+		if (fd < 0)
+			return;
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < recording.size(); i++) {
+			if (speed > 0)
+				std::this_thread::sleep_until(start + std::chrono::microseconds((uint64_t) (recording[i].offset * 1000 / speed)));
+			sendTimes[i] = std::chrono::steady_clock::now();
+			const std::string &line = recording[i].line;
+			if (write(fd, line.data(), line.size()) < 0)
+				break;
+		}
+		// wait until the client closes the connection
+		char buffer[64];
+		while (read(fd, buffer, sizeof(buffer)) > 0)
+			;
+		close(fd);
+	}
+public:
+	int port;
+	std::vector<std::chrono::steady_clock::time_point> sendTimes;
+	ReplayServer() : thread{nullptr}, speed{1} {
+		serverFd = socket(AF_INET, SOCK_STREAM, 0);
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		bind(serverFd, (sockaddr *) &addr, sizeof(addr));
+		socklen_t len = sizeof(addr);
+		getsockname(serverFd, (sockaddr *) &addr, &len);
+		port = ntohs(addr.sin_port);
+		timeval timeout = { 10, 0 };
+		setsockopt(serverFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		listen(serverFd, 1);
+	}
+	~ReplayServer() {
+		wait();
+		close(serverFd);
+	}
+	/**
+	 * Starts replaying in the background.
+	 * @param the lines to send
+	 * @param 1 for the original timing, 10 for ten times faster, 0 to send as fast as possible
+	 */
+	void start(const std::vector<fritz::sRecordedLine> &lines, double speed = 1) {
+		recording = lines;
+		this->speed = speed;
+		sendTimes.resize(lines.size());
+		thread = new std::thread(&ReplayServer::run, this);
+	}
+	/**
+	 * Waits until the client has closed the connection.
+	 */
+	void wait() {
+		if (thread) {
+			thread->join();
+			delete thread;
+			thread = nullptr;
+		}
+	}
+	/**
+	 * Synthesizes complete calls (RING, CONNECT, DISCONNECT), each on its own connection id.
+	 * @param the number of calls
+	 * @param ms between two calls
+	 * @return the recording
+	 */
+	static std::vector<fritz::sRecordedLine> Burst(size_t calls, uint64_t interval = 0) {
+		std::vector<fritz::sRecordedLine> lines;
+		for (size_t call = 0; call < calls; call++) {
+			std::string connId = std::to_string(call);
+			std::string number = "0721" + std::to_string(100000 + call);
+			uint64_t offset = call * interval;
+			lines.push_back({ offset, 0, "19.12.10 14:23:05;RING;" + connId + ";" + number + ";111;SIP0;\r\n" });
+			lines.push_back({ offset, 0, "19.12.10 14:23:07;CONNECT;" + connId + ";4;" + number + ";\r\n" });
+			lines.push_back({ offset, 0, "19.12.10 14:24:07;DISCONNECT;" + connId + ";60;\r\n" });
+		}
+		return lines;
+	}
+};
+
+}
+
+#endif /* REPLAYSERVER_H_ */
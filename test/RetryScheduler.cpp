@@ -0,0 +1,113 @@
+/*
+ * RetryScheduler.cpp
+ */
+
+#include "gtest/gtest.h"
+#include "FakeBoxFixture.h"
+
+#include <atomic>
+#include <Config.h>
+#include <FritzClient.h>
+#include <RetryScheduler.h>
+#include <SessionManager.h>
+
+namespace test {
+
+TEST(RetryScheduler, Delay) {
+	fritz::RetryPolicy policy(std::chrono::milliseconds(100), std::chrono::milliseconds(1000), 0.0);
+	EXPECT_EQ(100, policy.getDelay(1).count());
+	EXPECT_EQ(200, policy.getDelay(2).count());
+	EXPECT_EQ(800, policy.getDelay(4).count());
+	EXPECT_EQ(1000, policy.getDelay(5).count());
+	EXPECT_EQ(1000, policy.getDelay(100).count());
+	policy.jitter = 0.5;
+	for (int i = 0; i < 100; i++) {
+		EXPECT_LE(50, policy.getDelay(1).count());
+		EXPECT_GE(150, policy.getDelay(1).count());
+	}
+}
+
+TEST(RetryScheduler, RetryUntilSuccess) {
+	std::atomic<int> attempts{0};
+	std::thread::id caller = std::this_thread::get_id();
+	int result = fritz::RetryScheduler::Get().retry<int>([&attempts, caller]() {
+		// all attempts run in the calling thread
+		EXPECT_EQ(caller, std::this_thread::get_id());
+		if (++attempts < 3)
+			throw std::runtime_error("failed");
+		return 42;
+	}, fritz::RetryPolicy(std::chrono::milliseconds(10)), fritz::CancellationToken(), "test");
+	EXPECT_EQ(42, result);
+	EXPECT_EQ(3, attempts);
+}
+
+TEST(RetryScheduler, MaxAttempts) {
+	std::atomic<int> attempts{0};
+	EXPECT_THROW(fritz::RetryScheduler::Get().retry<void>([&attempts]() {
+		attempts++;
+		throw std::runtime_error("failed");
+	}, fritz::RetryPolicy(std::chrono::milliseconds(10), std::chrono::milliseconds(10), 0.0, 3), fritz::CancellationToken(), "test"),
+	   std::runtime_error);
+	EXPECT_EQ(3, attempts);
+}
+
+TEST(RetryScheduler, Deadline) {
+	std::atomic<int> attempts{0};
+	EXPECT_THROW(fritz::RetryScheduler::Get().retry<void>([&attempts]() {
+		attempts++;
+		throw std::runtime_error("failed");
+	}, fritz::RetryPolicy(std::chrono::milliseconds(40), std::chrono::milliseconds(40), 0.0, 0, std::chrono::milliseconds(100)),
+	   fritz::CancellationToken(), "test"), std::runtime_error);
+	EXPECT_EQ(3, attempts);
+}
+
+TEST(RetryScheduler, Cancel) {
+	fritz::CancellationToken token;
+	auto start = std::chrono::steady_clock::now();
+	std::thread canceler([&token]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		token.cancel();
+	});
+	EXPECT_THROW(fritz::RetryScheduler::Get().retry<void>([]() {
+		throw std::runtime_error("failed");
+	}, fritz::RetryPolicy(std::chrono::seconds(3600)), token, "test"), fritz::RetryCanceled);
+	EXPECT_GT(std::chrono::seconds(1), std::chrono::steady_clock::now() - start);
+	canceler.join();
+}
+
+TEST(RetryScheduler, ChildToken) {
+	fritz::CancellationToken parent;
+	fritz::CancellationToken child = parent.createChild();
+	fritz::CancellationToken other = parent.createChild();
+	other.cancel();
+	EXPECT_FALSE(parent.isCanceled());
+	EXPECT_FALSE(child.isCanceled());
+	parent.cancel();
+	EXPECT_TRUE(child.isCanceled());
+}
+
+// retries of a FritzClient against a FakeHttpServer
+class RetryingFritzClient : public FakeBoxFixture {
+};
+
+TEST_F(RetryingFritzClient, ShutdownCancelsRequests) {
+	// the box fails every request, with the default policy the next retry is a minute later
+	handler = [](const sFakeRequest &request) {
+		sFakeResponse response;
+		if (request.path == "/login_sid.lua")
+			return FakeLuaBox(request);
+		response.status = 500;
+		return response;
+	};
+	std::string callList = "none";
+	std::thread client([&callList]() {
+		fritz::FritzClient fc;
+		callList = fc.requestCallList();
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	fritz::gConfig->getShutdownToken().cancel();
+	client.join();
+	EXPECT_EQ("", callList);
+}
+
+}
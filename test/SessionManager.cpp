@@ -0,0 +1,75 @@
+/*
+ * SessionManager.cpp
+ */
+
+#include "gtest/gtest.h"
+#include "FakeBoxFixture.h"
+
+#include <atomic>
+#include <Config.h>
+#include <SessionManager.h>
+
+namespace test {
+
+class SessionManager : public FakeBoxFixture {
+protected:
+	std::atomic<int> logins{0};
+	std::atomic<int> refreshes{0};
+
+	SessionManager() {
+		handler = [this](const sFakeRequest &request) {
+			if (request.path == "/login_sid.lua" && request.method == "POST") {
+				logins++;
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			}
+			if (request.path == "/login_sid.lua" && request.target.find("sid=0123456789abcdef") != std::string::npos)
+				refreshes++;
+			return FakeLuaBox(request);
+		};
+	}
+};
+
+TEST_F(SessionManager, SharedLogin) {
+	std::vector<std::thread> threads;
+	std::atomic<int> successful{0};
+	for (int i = 0; i < 4; i++)
+		threads.emplace_back([&successful]() {
+			if (fritz::SessionManager::GetSessionManager()->login())
+				successful++;
+		});
+	for (auto &thread : threads)
+		thread.join();
+	EXPECT_EQ(4, successful);
+	EXPECT_EQ(1, logins);
+	EXPECT_EQ("0123456789abcdef", fritz::gConfig->getSid());
+}
+
+TEST_F(SessionManager, RefreshBeforeExpiry) {
+	// the SID lasts 3s, it is refreshed 2s before
+	fritz::SessionManager::CreateSessionManager(3, 2);
+	std::shared_ptr<fritz::SessionManager> session = fritz::SessionManager::GetSessionManager();
+	EXPECT_TRUE(session->login());
+	EXPECT_EQ(1, logins);
+	std::this_thread::sleep_for(std::chrono::milliseconds(4500));
+	EXPECT_LE(1, refreshes);
+	// the session is still valid, without another request
+	int requests = server.requests;
+	EXPECT_TRUE(session->login());
+	EXPECT_EQ(requests, server.requests);
+	EXPECT_EQ(1, logins);
+	// after the SID was rejected, it is checked again
+	session->invalidate();
+	EXPECT_TRUE(session->login());
+	EXPECT_LT(requests, server.requests);
+}
+
+TEST_F(SessionManager, LoginResponse) {
+	EXPECT_EQ("1234567z-9e224a41eeefa284df7bb0f26c2913e2", fritz::SessionManager::CalculateLoginResponse("1234567z", "äbc", "UTF-8"));
+	// characters above 0xFF are replaced by '.', one per UTF-16 unit
+	EXPECT_EQ("1234567z-5d39d7d3ced2f29d8fcf3d1f74ba7e95", fritz::SessionManager::CalculateLoginResponse("1234567z", "a€b", "UTF-8"));
+	EXPECT_EQ("1234567z-1af7dfaf25ff28d7b06373ca7762335d", fritz::SessionManager::CalculateLoginResponse("1234567z", "a\xF0\x9F\x98\x80" "b", "UTF-8"));
+	// a password in the system charset gives the same response
+	EXPECT_EQ("1234567z-9e224a41eeefa284df7bb0f26c2913e2", fritz::SessionManager::CalculateLoginResponse("1234567z", "\xE4" "bc", "ISO-8859-1"));
+}
+
+}
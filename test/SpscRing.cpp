@@ -0,0 +1,53 @@
+/*
+ * SpscRing.cpp
+ */
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <SpscRing.h>
+
+namespace test {
+
+TEST(SpscRing, PushPop) {
+	fritz::SpscRing<std::string> ring(3);
+	EXPECT_EQ(4, (int) ring.capacity());
+	EXPECT_TRUE(ring.empty());
+	for (std::string s : { "a", "b", "c", "d" }) {
+		std::string item = s;
+		EXPECT_TRUE(ring.push(item));
+	}
+	std::string item = "e";
+	EXPECT_FALSE(ring.push(item));
+	EXPECT_EQ(4, (int) ring.size());
+	for (std::string s : { "a", "b", "c", "d" }) {
+		ASSERT_TRUE(ring.pop(item));
+		EXPECT_EQ(s, item);
+	}
+	EXPECT_FALSE(ring.pop(item));
+	EXPECT_TRUE(ring.empty());
+}
+
+TEST(SpscRing, Threads) {
+	fritz::SpscRing<int> ring(16);
+	const int count = 100000;
+	std::thread producer([&ring]() {
+		for (int i = 0; i < count; i++) {
+			int item = i;
+			while (!ring.push(item))
+				std::this_thread::yield();
+		}
+	});
+	int expected = 0;
+	while (expected < count) {
+		int item;
+		if (ring.pop(item))
+			ASSERT_EQ(expected++, item);
+		else
+			std::this_thread::yield();
+	}
+	producer.join();
+	EXPECT_TRUE(ring.empty());
+}
+
+}
@@ -0,0 +1,142 @@
+/*
+ * Subscription.cpp
+ */
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <Listener.h>
+#include <Subscription.h>
+
+namespace test {
+
+// blocks in handleEvent() until released
+class GatedEventHandler : public fritz::EventHandler {
+public:
+	std::mutex mutex;
+	std::condition_variable released;
+	bool open = false;
+	std::vector<std::string> events;
+	virtual void handleEvent(const fritz::CallEventPtr &event) {
+		std::unique_lock<std::mutex> lock(mutex);
+		released.wait(lock, [this]() { return open; });
+		std::string name = event->type == fritz::CallEvent::CALL     ? "CALL"
+		                 : event->type == fritz::CallEvent::RESOLVED ? "RESOLVED"
+		                 : event->type == fritz::CallEvent::CONNECT  ? "CONNECT" : "DISCONNECT";
+		events.push_back(name + " " + std::to_string(event->connId) + (event->remoteName.size() ? " " + event->remoteName : ""));
+	}
+	void release() {
+		std::lock_guard<std::mutex> lock(mutex);
+		open = true;
+		released.notify_all();
+	}
+};
+
+static fritz::CallEventPtr Event(fritz::CallEvent::eType type, int connId, std::string remoteName = "") {
+	std::shared_ptr<fritz::CallEvent> event = std::make_shared<fritz::CallEvent>(type, connId);
+	event->remoteName = remoteName;
+	return event;
+}
+
+static void WaitForDelivery(fritz::Subscription &subscription, uint64_t count) {
+	for (int i = 0; i < 100 && subscription.getMetrics().delivered < count; i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+
+TEST(Subscription, DropOldest) {
+	GatedEventHandler handler;
+	fritz::Subscription subscription(&handler, fritz::Subscription::DROP_OLDEST, 2);
+	subscription.push(Event(fritz::CallEvent::CALL, 0));
+	// wait until the first event is taken by the delivery thread
+	while (subscription.getMetrics().depth)
+		std::this_thread::yield();
+	subscription.push(Event(fritz::CallEvent::CALL, 1));
+	subscription.push(Event(fritz::CallEvent::CALL, 2));
+	subscription.push(Event(fritz::CallEvent::CALL, 3));
+	fritz::sSubscriptionMetrics metrics = subscription.getMetrics();
+	EXPECT_EQ(2U, metrics.depth);
+	EXPECT_EQ(2U, metrics.maxDepth);
+	EXPECT_EQ(1U, metrics.dropped);
+	handler.release();
+	WaitForDelivery(subscription, 3);
+	std::vector<std::string> expected = { "CALL 0", "CALL 2", "CALL 3" };
+	std::lock_guard<std::mutex> lock(handler.mutex);
+	EXPECT_EQ(expected, handler.events);
+}
+
+TEST(Subscription, Coalesce) {
+	GatedEventHandler handler;
+	fritz::Subscription subscription(&handler, fritz::Subscription::COALESCE, 2);
+	subscription.push(Event(fritz::CallEvent::CALL, 9));
+	while (subscription.getMetrics().depth)
+		std::this_thread::yield();
+	subscription.push(Event(fritz::CallEvent::CALL, 1));
+	subscription.push(Event(fritz::CallEvent::CONNECT, 2));
+	subscription.push(Event(fritz::CallEvent::RESOLVED, 1, "Jo"));
+	subscription.push(Event(fritz::CallEvent::DISCONNECT, 2));
+	fritz::sSubscriptionMetrics metrics = subscription.getMetrics();
+	EXPECT_EQ(2U, metrics.coalesced);
+	EXPECT_EQ(0U, metrics.dropped);
+	handler.release();
+	WaitForDelivery(subscription, 3);
+	std::vector<std::string> expected = { "CALL 9", "CALL 1 Jo", "DISCONNECT 2" };
+	std::lock_guard<std::mutex> lock(handler.mutex);
+	EXPECT_EQ(expected, handler.events);
+}
+
+TEST(Subscription, BlockUntilStopped) {
+	GatedEventHandler handler;
+	fritz::Subscription subscription(&handler, fritz::Subscription::BLOCK, 1);
+	subscription.push(Event(fritz::CallEvent::CALL, 0));
+	while (subscription.getMetrics().depth)
+		std::this_thread::yield();
+	subscription.push(Event(fritz::CallEvent::CALL, 1));
+	std::thread producer([&subscription]() {
+		subscription.push(Event(fritz::CallEvent::CALL, 2));
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	EXPECT_EQ(1U, subscription.getMetrics().depth);
+	handler.release();
+	producer.join();
+	WaitForDelivery(subscription, 3);
+	EXPECT_EQ(3U, subscription.getMetrics().delivered);
+	EXPECT_EQ(0U, subscription.getMetrics().dropped);
+}
+
+
+// ends its subscription from handleEvent(), like a handler calling Listener::Unsubscribe()
+class UnsubscribingEventHandler : public fritz::EventHandler {
+public:
+	std::shared_ptr<fritz::Subscription> subscription;
+	std::atomic<int> handled{0};
+	virtual void handleEvent(const fritz::CallEventPtr &event __attribute__((unused))) {
+		handled++;
+		std::shared_ptr<fritz::Subscription> last;
+		last.swap(subscription);
+		if (last)
+			last->stop();
+	}
+};
+
+TEST(Subscription, StopFromHandler) {
+	UnsubscribingEventHandler handler;
+	std::weak_ptr<fritz::Subscription> weak;
+	{
+		std::shared_ptr<fritz::Subscription> subscription = std::make_shared<fritz::Subscription>(&handler, fritz::Subscription::DROP_OLDEST, 4);
+		weak = subscription;
+		handler.subscription = subscription;
+		subscription->push(Event(fritz::CallEvent::CALL, 0));
+		subscription->push(Event(fritz::CallEvent::CONNECT, 0));
+	}
+	// the thread ends on its own and deletes the subscription
+	for (int i = 0; i < 100 && !weak.expired(); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	EXPECT_TRUE(weak.expired());
+	EXPECT_EQ(1, handler.handled);
+}
+
+}
@@ -99,5 +99,28 @@ TEST_F(Tools, Tokenize) {
 	ASSERT_EQ(" Bumms)", fritz::Tools::Tokenize(input, ',', 3));
 }
 
+TEST_F(Tools, UrlEncode) {
+	EXPECT_EQ("Passw0rd", fritz::Tools::UrlEncode("Passw0rd"));
+	EXPECT_EQ("a%20b%26c%3dd%25", fritz::Tools::UrlEncode("a b&c=d%"));
+	EXPECT_EQ("", fritz::Tools::UrlEncode(""));
+}
+
+TEST_F(Tools, HashContent) {
+	std::string data = "Typ;Datum;Name;Rufnummer;Nebenstelle;Eigene Rufnummer;Dauer\n";
+	EXPECT_EQ(fritz::Tools::HashContent(data), fritz::Tools::HashContent(std::string(data)));
+	EXPECT_NE(fritz::Tools::HashContent(data), fritz::Tools::HashContent(data + "\n"));
+	std::string changed = data;
+	changed[20] ^= 1;
+	EXPECT_NE(fritz::Tools::HashContent(data), fritz::Tools::HashContent(changed));
+	EXPECT_NE(fritz::Tools::HashContent(""), fritz::Tools::HashContent(std::string(1, '\0')));
+	// the same hash, if the data is passed in pieces
+	for (size_t split : { 0, 3, 8, 13, 20 }) {
+		fritz::ContentHasher hasher;
+		hasher.update(data.data(), split);
+		hasher.update(data.data() + split, 5);
+		hasher.update(data.data() + split + 5, data.size() - split - 5);
+		EXPECT_EQ(fritz::Tools::HashContent(data), hasher.digest());
+	}
 }
 
+}
@@ -0,0 +1,167 @@
+/*
+ * ListenerBench.cpp
+ *
+ * Measures the latency from sending RING/CALL to handleCall() and the sustained
+ * event rate through fritz::Listener, using a local replay server instead of a box.
+ *
+ * Usage: libfritzbench [--calls n] [--interval ms] [--replay file] [--speed factor]
+ *        libfritzbench --record host[:port] file seconds
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+#include "ReplayServer.h"
+
+#include <Config.h>
+#include <FonbookManager.h>
+#include <Listener.h>
+#include <MonitorDecoder.h>
+#include <MonitorEngine.h>
+#include <MonitorRecorder.h>
+
+typedef std::chrono::steady_clock clock_type;
+
+class BenchEventHandler : public fritz::EventHandler {
+public:
+	std::mutex mutex;
+	std::condition_variable done;
+	std::map<int, std::vector<clock_type::time_point>> calls;   // by connection id, in order of arrival
+	size_t disconnects = 0;
+	clock_type::time_point lastEvent;
+	virtual void handleCall(bool, int connId, std::string, std::string, fritz::FonbookEntry::eType, std::string, std::string, std::string) {
+		clock_type::time_point now = clock_type::now();
+		std::lock_guard<std::mutex> lock(mutex);
+		calls[connId].push_back(now);
+		lastEvent = now;
+	}
+	virtual void handleConnect(int) {
+		std::lock_guard<std::mutex> lock(mutex);
+		lastEvent = clock_type::now();
+	}
+	virtual void handleDisconnect(int, std::string) {
+		std::lock_guard<std::mutex> lock(mutex);
+		lastEvent = clock_type::now();
+		disconnects++;
+		done.notify_all();
+	}
+};
+
+static int record(const std::string &target, const std::string &fileName, int seconds) {
+	std::string host = target;
+	int port = 1012;
+	size_t colon = target.find(':');
+	if (colon != std::string::npos) {
+		host = target.substr(0, colon);
+		port = atoi(target.c_str() + colon + 1);
+	}
+	fritz::MonitorRecorder recorder(fileName);
+	if (!recorder.isOpen())
+		return 1;
+	{
+		fritz::MonitorEngine engine;
+		engine.addBox(host, port, &recorder);
+		std::this_thread::sleep_for(std::chrono::seconds(seconds));
+	}
+	std::cout << "recorded " << recorder.getLines() << " lines to " << fileName << std::endl;
+	return 0;
+}
+
+static double percentile(std::vector<double> &values, double p) {
+	if (values.empty())
+		return 0;
+	size_t pos = std::min(values.size() - 1, (size_t) (p * values.size()));
+	std::nth_element(values.begin(), values.begin() + pos, values.end());
+	return values[pos];
+}
+
+int main(int argc, char *argv[]) {
+	size_t calls = 10000;
+	uint64_t interval = 0;
+	double speed = 0;
+	std::string replayFile;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--record") == 0 && i + 3 < argc)
+			return record(argv[i+1], argv[i+2], atoi(argv[i+3]));
+		else if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc)
+			calls = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+			interval = strtoull(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replayFile = argv[++i];
+		else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+			speed = atof(argv[++i]);
+		else {
+			std::cerr << "usage: " << argv[0] << " [--calls n] [--interval ms] [--replay file] [--speed factor]" << std::endl
+			          << "       " << argv[0] << " --record host[:port] file seconds" << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<fritz::sRecordedLine> lines;
+	if (replayFile.size()) {
+		if (!fritz::MonitorRecorder::Load(replayFile, lines)) {
+			std::cerr << "could not read " << replayFile << std::endl;
+			return 1;
+		}
+	} else {
+		lines = test::ReplayServer::Burst(calls, interval);
+		speed = interval ? 1 : 0;
+	}
+	if (lines.empty()) {
+		std::cerr << "nothing to replay" << std::endl;
+		return 1;
+	}
+	// remember when each RING/CALL was sent, by connection id
+	std::map<int, std::vector<size_t>> newCalls;
+	size_t expectedDisconnects = 0;
+	fritz::MonitorEvent event;
+	for (size_t i = 0; i < lines.size(); i++) {
+		if (!fritz::MonitorDecoder::Decode(lines[i].line, event))
+			continue;
+		if (event.type == fritz::MonitorEvent::RING || event.type == fritz::MonitorEvent::CALL)
+			newCalls[event.connId].push_back(i);
+		if (event.type == fritz::MonitorEvent::DISCONNECT)
+			expectedDisconnects++;
+	}
+
+	test::ReplayServer server;
+	fritz::Config::Setup("127.0.0.1");
+	fritz::Config::SetupPorts(server.port, 80, 49000);
+	fritz::FonbookManager::CreateFonbookManager({}, "", false);
+	BenchEventHandler handler;
+	server.start(lines, speed);
+	fritz::Listener::CreateListener(&handler);
+	{
+		std::unique_lock<std::mutex> lock(handler.mutex);
+		handler.done.wait_for(lock, std::chrono::seconds(60), [&]{ return handler.disconnects >= expectedDisconnects; });
+	}
+	// events the workers could not keep up with
+	fritz::sMonitorMetrics metrics;
+	fritz::Listener::GetMonitorMetrics(metrics);
+	fritz::Listener::DeleteListener();
+	server.wait();
+	fritz::Config::Shutdown();
+
+	std::vector<double> latencies;
+	for (auto &connection : handler.calls) {
+		std::vector<size_t> &sent = newCalls[connection.first];
+		for (size_t i = 0; i < connection.second.size() && i < sent.size(); i++)
+			latencies.push_back(std::chrono::duration<double, std::micro>(connection.second[i] - server.sendTimes[sent[i]]).count());
+	}
+	double elapsed = server.sendTimes.empty() ? 0 : std::chrono::duration<double>(handler.lastEvent - server.sendTimes.front()).count();
+	std::cout << "lines:              " << lines.size() << std::endl
+	          << "calls handled:      " << latencies.size() << std::endl
+	          << "disconnects:        " << handler.disconnects << " of " << expectedDisconnects << std::endl
+	          << "dropped events:     " << metrics.droppedEvents << std::endl
+	          << "events/s:           " << (elapsed > 0 ? lines.size() / elapsed : 0) << std::endl
+	          << "RING->handleCall us: p50 " << percentile(latencies, 0.5)
+	          << ", p99 " << percentile(latencies, 0.99)
+	          << ", max " << percentile(latencies, 1) << std::endl;
+	return handler.disconnects >= expectedDisconnects ? 0 : 1;
+}